@@ -0,0 +1,228 @@
+#include "gbookbuilder.h"
+#include "gselfplay.h"
+#include "../src/gtimer.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace nsg
+{
+
+GBookBuilder::GBookBuilder(GBook& book, const GOptions& options) :
+  m_book(book),
+  m_options(options)
+{}
+
+bool GBookBuilder::importSamples(std::istream& in)
+{
+  char magic[4];
+  std::uint32_t record_size = 0;
+  if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, "GSP1", sizeof(magic)) != 0 ||
+      !in.read((char*)&record_size, sizeof(record_size)) || record_size != sizeof(GSampleRecord))
+    return false;
+  std::vector<GBookEntry> entries;
+  GSampleRecord record;
+  while (in.read((char*)&record, sizeof(record)))
+  {
+    if (record.player > G_WHITE || record.move >= GRID_CELL_COUNT || record.result < -1 || record.result > 1)
+      return false;
+    GBookPosition position;
+    uint ply = 0;
+    for (uint id = 0; id < GRID_CELL_COUNT; ++id)
+    {
+      for (uint player = G_BLACK; player <= G_WHITE; ++player)
+      {
+        if ((record.stones[player][id / 8] >> (id % 8)) & 1)
+        {
+          position.add(fromCellId(GCellId(id)), GPlayer(player));
+          ++ply;
+        }
+      }
+    }
+    if (ply < m_options.ply)
+      addGame(entries, position, GPlayer(record.player), fromCellId(record.move), ply, uint(record.result + 1));
+  }
+  if (in.gcount() != 0)
+    return false;
+  m_book.merge(std::move(entries));
+  return true;
+}
+
+bool GBookBuilder::importGames(std::istream& in)
+{
+  std::vector<GBookEntry> entries;
+  Gomoku g;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream stream(line);
+    std::vector<GPoint> moves;
+    GPoint move;
+    char c = 0;
+    while (stream >> move.x >> c >> move.y)
+    {
+      if (c != ',')
+        return false;
+      moves.push_back(move);
+    }
+    if (!stream.eof())
+      return false;
+    if (moves.empty())
+      continue;
+    if (!g.setMoves(moves))
+      return false;
+    if (!g.getLine5() && !g.isDraw())
+      continue;
+
+    //Линию 5 строит последний ход
+    GPlayer winner = GPlayer((moves.size() - 1) % 2);
+    GBookPosition position;
+    for (uint i = 0; i < moves.size() && i < m_options.ply; ++i)
+    {
+      GPlayer player = GPlayer(i % 2);
+      uint points = g.getLine5() ? (player == winner ? 2 : 0) : 1;
+      addGame(entries, position, player, GCell(moves[i]), i, points);
+      position.add(GCell(moves[i]), player);
+    }
+  }
+  m_book.merge(std::move(entries));
+  return true;
+}
+
+void GBookBuilder::run(std::ostream& log, const std::function<bool()>& checkpoint)
+{
+  std::vector<GNode> nodes(1);
+  nodes[0].key = nodes[0].position.key(G_BLACK, &nodes[0].symmetry);
+  for (uint ply = 0; ply < m_options.ply && !nodes.empty(); ++ply)
+  {
+    GTimer timer;
+    std::uint64_t search_count = m_search_count;
+    m_next_node = 0;
+    std::vector<std::thread> threads;
+    for (uint i = 1; i < m_options.threads && i < nodes.size(); ++i)
+      threads.emplace_back(&GBookBuilder::work, this, std::ref(nodes));
+    work(nodes);
+    for (auto& thread: threads)
+      thread.join();
+
+    //Книга не меняется, пока потоки разбирают позиции уровня
+    std::vector<GBookEntry> entries;
+    for (const GNode& node: nodes)
+    {
+      if (node.searched)
+        entries.push_back(node.entry);
+    }
+    m_book.merge(std::move(entries));
+    log << "ply " << ply << ": positions " << nodes.size() << ", searches " << m_search_count - search_count
+        << ", book " << m_book.size() << ", time " << timer.elapsed() << " ms" << std::endl;
+    if (checkpoint && !checkpoint())
+      return;
+
+    //Следующий уровень без повторов симметричных позиций и перестановок ходов
+    std::vector<GNode> next;
+    std::unordered_set<std::uint64_t> keys;
+    for (const GNode& node: nodes)
+    {
+      for (const GCell& move: node.children)
+      {
+        GNode child;
+        child.moves = node.moves;
+        child.moves.push_back(move.point());
+        child.position = node.position;
+        child.position.add(move, GPlayer(ply % 2));
+        child.key = child.position.key(GPlayer((ply + 1) % 2), &child.symmetry);
+        if (keys.insert(child.key).second)
+          next.push_back(std::move(child));
+      }
+    }
+    nodes = std::move(next);
+  }
+}
+
+void GBookBuilder::work(std::vector<GNode>& nodes)
+{
+  for (uint i = m_next_node++; i < nodes.size(); i = m_next_node++)
+    expand(nodes[i]);
+}
+
+void GBookBuilder::expand(GNode& node)
+{
+  ++m_position_count;
+  uint ply = (uint)node.moves.size();
+  GPlayer player = GPlayer(ply % 2);
+
+  //Каждая позиция разбирается на новом поле, поэтому ход поиска не зависит от позиций,
+  //которые поток разбирал раньше
+  auto g = std::make_unique<Gomoku>();
+  g->setAiLevel(m_options.ai_level);
+  if (!g->setMoves(node.moves) || g->isGameOver())
+    return;
+
+  const uint inverse = GSymmetry::inverse(node.symmetry);
+  auto [first, last] = m_book.find(node.key);
+  const GBookEntry* book_search = nullptr;
+  for (const GBookEntry* entry = first; entry != last; ++entry)
+  {
+    if (entry->level > 0 && (!book_search || entry->level > book_search->level))
+      book_search = entry;
+  }
+
+  GCell search_move;
+  if (book_search && book_search->level >= g->getAiLevel())
+    search_move = GSymmetry::apply(fromCellId(book_search->move), inverse);
+  else
+  {
+    //Позиция просчитывается одинаково независимо от потока и порядка разбора
+    random_engine.seed(m_options.seed * 1000003u + uint(node.key));
+    int x, y;
+    if (!g->hint(x, y, player))
+      return;
+    ++m_search_count;
+    search_move = GCell(x, y);
+    node.searched = true;
+    node.entry = {node.key, 0, 0, toCellId(GSymmetry::apply(search_move, node.symmetry)),
+                  std::uint8_t(g->getAiLevel()), std::uint8_t(g->getLastHintKind()), std::uint8_t(ply)};
+  }
+
+  if (ply + 1 >= m_options.ply)
+    return;
+
+  auto add_child = [this, &node](const GCell& move)
+  {
+    if (node.children.size() < m_options.width &&
+        std::find(node.children.begin(), node.children.end(), move) == node.children.end())
+      node.children.push_back(move);
+  };
+
+  //Продолжения: ход поиска, ходы из партий по убыванию числа партий, ходы с наибольшим весом
+  add_child(search_move);
+  std::vector<const GBookEntry*> played;
+  for (const GBookEntry* entry = first; entry != last; ++entry)
+  {
+    if (entry->games >= GBook::MIN_GAMES)
+      played.push_back(entry);
+  }
+  std::stable_sort(played.begin(), played.end(),
+                   [](const GBookEntry* entry1, const GBookEntry* entry2){ return entry1->games > entry2->games; });
+  for (const GBookEntry* entry: played)
+    add_child(GSymmetry::apply(fromCellId(entry->move), inverse));
+  std::vector<GPoint> variants;
+  g->getBestVariants(player, m_options.width, variants);
+  for (const GPoint& variant: variants)
+    add_child(GCell(variant));
+}
+
+void GBookBuilder::addGame(std::vector<GBookEntry>& entries, const GBookPosition& position, GPlayer player,
+                           const GCell& move, uint ply, uint points) const
+{
+  uint symmetry;
+  std::uint64_t key = position.key(player, &symmetry);
+  entries.push_back({key, 1, std::uint16_t(points), toCellId(GSymmetry::apply(move, symmetry)), 0, G_HINT_NONE,
+                     std::uint8_t(ply)});
+}
+
+} //namespace nsg
@@ -0,0 +1,98 @@
+#ifndef GBOOKBUILDER_H
+#define GBOOKBUILDER_H
+
+#include "../src/gomoku.h"
+#include "../src/gbook.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace nsg
+{
+
+//Построитель дебютной книги (см. GBook).
+//Дерево дебютов обходится по уровням (числу камней). Позиции уровня делятся между потоками,
+//и позиция, для которой в книге нет поиска нужного уровня, просчитывается подсказкой ии уровня ai_level.
+//Позиция продолжается ходом поиска, ходами из партий (сыгранными не меньше GBook::MIN_GAMES раз)
+//и ходами с наибольшим весом, всего не больше width ходами.
+//Симметричные позиции и перестановки ходов имеют один ключ (см. GBookPosition) и просчитываются один раз.
+//
+//Книга дополняется после каждого уровня, а позиции, уже просчитанные поиском нужного уровня, не просчитываются повторно,
+//поэтому прерванное построение или построение с большей глубиной продолжает построенную книгу.
+class GBookBuilder
+{
+public:
+  struct GOptions
+  {
+    //Позиции книги содержат меньше ply камней
+    uint ply = 6;
+    //Число продолжений каждой позиции
+    uint width = 3;
+    uint threads = 1;
+    uint ai_level = 3;
+    uint seed = 1;
+  };
+
+  GBookBuilder(GBook& book, const GOptions& options);
+
+  DELETE_COPY(GBookBuilder)
+
+  //Добавляет в книгу статистику позиций выборки gomoku_selfplay (см. GSampleRecord)
+  bool importSamples(std::istream& in);
+
+  //Добавляет в книгу статистику партий в текстовом виде: партия в строке, ходы "x,y" через пробел,
+  //первыми ходят черные. Итог определяется по линии 5 или ничьей, незавершенные партии пропускаются
+  bool importGames(std::istream& in);
+
+  //Строит дерево дебютов, после каждого уровня вызывает checkpoint (например, сохраняет книгу).
+  //Построение прекращается, если checkpoint возвращает false
+  void run(std::ostream& log, const std::function<bool()>& checkpoint = {});
+
+  std::uint64_t positionCount() const
+  {
+    return m_position_count;
+  }
+
+  std::uint64_t searchCount() const
+  {
+    return m_search_count;
+  }
+
+protected:
+  struct GNode
+  {
+    std::vector<GPoint> moves;
+    GBookPosition position;
+    std::uint64_t key = 0;
+    //Преобразование позиции в каноническую (см. GBookPosition::key)
+    uint symmetry = 0;
+
+    //Результаты разбора позиции
+    bool searched = false;
+    GBookEntry entry = {};
+    std::vector<GCell> children;
+  };
+
+  void work(std::vector<GNode>& nodes);
+  void expand(GNode& node);
+
+  //Статистика хода move игрока, набравшего points очков (2 - выигрыш, 1 - ничья, 0 - проигрыш)
+  void addGame(std::vector<GBookEntry>& entries, const GBookPosition& position, GPlayer player, const GCell& move,
+               uint ply, uint points) const;
+
+protected:
+  GBook& m_book;
+
+  const GOptions m_options;
+
+  std::atomic<uint> m_next_node{0};
+
+  std::atomic<std::uint64_t> m_position_count{0};
+  std::atomic<std::uint64_t> m_search_count{0};
+};
+
+} //namespace nsg
+
+#endif
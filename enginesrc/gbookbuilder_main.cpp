@@ -0,0 +1,79 @@
+#include "gbookbuilder.h"
+#include "../src/gtimer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+using namespace nsg;
+
+//Построение дебютной книги.
+//Параметры: файл книги (читается, если существует, и перезаписывается после каждого уровня дерева),
+//число камней в позициях книги, число продолжений позиции, уровень ии поиска, число потоков
+//и файлы партий: выборки gomoku_selfplay или текстовые партии (см. GBookBuilder::importGames).
+//Статистика партий добавляется при каждом запуске, поэтому при продолжении построения партии повторно не передаются
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: gomoku_book file [ply] [width] [level] [threads] [games...]" << std::endl;
+    return 1;
+  }
+  GBook book;
+  if (std::ifstream(argv[1]) && !book.load(argv[1]))
+  {
+    std::cerr << "cannot load book " << argv[1] << std::endl;
+    return 1;
+  }
+
+  GBookBuilder::GOptions options;
+  if (argc > 2)
+    options.ply = (uint)std::atoi(argv[2]);
+  if (argc > 3)
+    options.width = (uint)std::atoi(argv[3]);
+  if (argc > 4)
+    options.ai_level = (uint)std::atoi(argv[4]);
+  options.threads = argc > 5 ? (uint)std::atoi(argv[5]) : std::thread::hardware_concurrency();
+
+  GTimer timer;
+  GBookBuilder builder(book, options);
+  for (int i = 6; i < argc; ++i)
+  {
+    std::ifstream in(argv[i], std::ios::binary);
+    char magic[4] = {};
+    in.read(magic, sizeof(magic));
+    in.clear();
+    in.seekg(0);
+    bool samples = std::memcmp(magic, "GSP1", sizeof(magic)) == 0;
+    if (!in.is_open() || !(samples ? builder.importSamples(in) : builder.importGames(in)))
+    {
+      std::cerr << "cannot import " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  //Книга записывается во временный файл, чтобы прерванная запись не испортила построенную книгу
+  std::string temp_path = std::string(argv[1]) + ".tmp";
+  auto save = [&book, &temp_path, path = argv[1]]()
+  {
+    if (!book.save(temp_path.c_str()))
+      return false;
+    std::remove(path);
+    return std::rename(temp_path.c_str(), path) == 0;
+  };
+
+  bool saved = true;
+  builder.run(std::cerr, [&saved, &save](){ return saved = save(); });
+  if (!saved || !save())
+  {
+    std::cerr << "cannot save " << argv[1] << std::endl;
+    return 1;
+  }
+  std::cerr << "positions: " << builder.positionCount()
+            << ", searches: " << builder.searchCount()
+            << ", book: " << book.size()
+            << ", time: " << timer.elapsed() << " ms" << std::endl;
+  return 0;
+}
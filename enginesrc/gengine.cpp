@@ -0,0 +1,234 @@
+#include "gengine.h"
+#include "../src/gtimer.h"
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+namespace nsg
+{
+
+GEngine::GEngine(std::ostream& out) : m_out(out)
+{
+  //Одновременные этапы подбора хода сокращают время хода только при нескольких ядрах
+  m_gomoku.setHintRace(std::thread::hardware_concurrency() > 1);
+}
+
+void GEngine::run(std::istream& in)
+{
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (!command(line))
+      break;
+  }
+}
+
+bool GEngine::command(const std::string& line)
+{
+  std::string cmd, args;
+  std::istringstream stream(line);
+  stream >> cmd;
+  std::getline(stream >> std::ws, args);
+  if (!args.empty() && args.back() == '\r')
+    args.pop_back();
+  std::transform(cmd.begin(), cmd.end(), cmd.begin(), [](unsigned char c){ return (char)std::toupper(c); });
+
+  //Между BOARD и DONE приходят только ходы
+  if (m_board_input)
+  {
+    if (cmd == "DONE")
+    {
+      m_board_input = false;
+      if (setupBoard())
+        think();
+    }
+    else
+      boardLine(line);
+    return true;
+  }
+
+  if (cmd == "START")
+    start(args);
+  else if (cmd == "RESTART")
+  {
+    m_gomoku.start();
+    m_out << "OK" << std::endl;
+  }
+  else if (cmd == "BEGIN")
+  {
+    m_player = G_BLACK;
+    think();
+  }
+  else if (cmd == "TURN")
+    turn(args);
+  else if (cmd == "BOARD")
+  {
+    m_board.clear();
+    m_board_input = true;
+  }
+  else if (cmd == "INFO")
+    info(args);
+  else if (cmd == "TAKEBACK")
+    takeback(args);
+  else if (cmd == "ABOUT")
+    m_out << "name=\"gomoku_ai\", version=\"1.0\"" << std::endl;
+  else if (cmd == "END")
+    return false;
+  else if (!cmd.empty())
+    m_out << "UNKNOWN " << cmd << std::endl;
+  return true;
+}
+
+uint GEngine::turnTime() const
+{
+  uint time = m_timeout_turn;
+  if (m_timeout_match > 0)
+    time = std::min(time, m_time_left / MOVES_TO_GO);
+  //Время поиска оценивается по предыдущему уровню ии и может быть превышено,
+  //поэтому оставляем запас
+  time -= time / 10;
+  return time > TIME_RESERVE ? time - TIME_RESERVE : 0;
+}
+
+void GEngine::setWeights(const GWeights& weights)
+{
+  m_gomoku.setWeights(weights);
+}
+
+void GEngine::setBook(const GBook* book)
+{
+  m_gomoku.setBook(book);
+}
+
+void GEngine::start(const std::string& args)
+{
+  int size = 0;
+  std::istringstream(args) >> size;
+  if (size != G_FIELD_SIZE)
+  {
+    error("unsupported board size");
+    return;
+  }
+  m_gomoku.start();
+  m_out << "OK" << std::endl;
+}
+
+void GEngine::turn(const std::string& args)
+{
+  GPoint move;
+  if (!parseMove(args, move))
+  {
+    error("invalid move");
+    return;
+  }
+  //Если противник делает первый ход партии, движок играет за белых
+  if (m_gomoku.getMoveCount(G_BLACK) == 0)
+    m_player = G_WHITE;
+  if (!m_gomoku.doMove(move, !m_player))
+  {
+    error("invalid move");
+    return;
+  }
+  think();
+}
+
+void GEngine::boardLine(const std::string& line)
+{
+  GPoint move;
+  int who = 0;
+  char c1 = 0, c2 = 0;
+  std::istringstream stream(line);
+  if (!(stream >> move.x >> c1 >> move.y >> c2 >> who) || c1 != ',' || c2 != ',' || who < 1 || who > 3)
+  {
+    error("invalid board line");
+    return;
+  }
+  //3 - ход из продолжения партии по правилу continuous, считаем его ходом противника
+  m_board.push_back({move, who == 1});
+}
+
+void GEngine::info(const std::string& args)
+{
+  std::string key;
+  long long value = 0;
+  std::istringstream stream(args);
+  stream >> key >> value;
+  if (value < 0)
+    value = 0;
+  if (key == "timeout_turn")
+    m_timeout_turn = (uint)value;
+  else if (key == "timeout_match")
+  {
+    m_timeout_match = (uint)value;
+    m_time_left = m_timeout_match;
+  }
+  else if (key == "time_left")
+    m_time_left = (uint)value;
+}
+
+void GEngine::takeback(const std::string& args)
+{
+  GPoint move, last_move;
+  if (!parseMove(args, move) || !m_gomoku.undo(last_move))
+  {
+    error("invalid takeback");
+    return;
+  }
+  if (!(last_move == move))
+  {
+    m_gomoku.doMove(last_move, m_gomoku.getMoveCount(G_BLACK) > m_gomoku.getMoveCount(G_WHITE) ? G_WHITE : G_BLACK);
+    error("invalid takeback");
+    return;
+  }
+  m_out << "OK" << std::endl;
+}
+
+bool GEngine::setupBoard()
+{
+  //Движок ходит после расстановки, поэтому при равном числе камней он играет за черных
+  uint own_count = (uint)std::count_if(m_board.begin(), m_board.end(), [](const auto& item){ return item.second; });
+  m_player = (own_count * 2 == m_board.size()) ? G_BLACK : G_WHITE;
+  m_gomoku.start();
+  for (const auto& [move, own]: m_board)
+  {
+    if (!m_gomoku.doMove(move, own ? m_player : !m_player))
+    {
+      m_board.clear();
+      error("invalid board");
+      return false;
+    }
+  }
+  m_board.clear();
+  return true;
+}
+
+void GEngine::think()
+{
+  GTimer timer;
+  int x, y;
+  //После ничьей менеджер ждет ходов до заполнения поля, подсказка дает их сразу (см. Gomoku::hint)
+  if (!m_gomoku.hintInTime(x, y, m_player, turnTime()))
+  {
+    error("no move");
+    return;
+  }
+  m_gomoku.doMove(x, y, m_player);
+  uint elapsed = timer.elapsed();
+  m_time_left = m_time_left > elapsed ? m_time_left - elapsed : 0;
+  m_out << x << "," << y << std::endl;
+}
+
+bool GEngine::parseMove(const std::string& args, GPoint& move) const
+{
+  char c = 0;
+  std::istringstream stream(args);
+  return (stream >> move.x >> c >> move.y) && c == ',';
+}
+
+void GEngine::error(const std::string& message)
+{
+  m_out << "ERROR " << message << std::endl;
+}
+
+} //namespace nsg
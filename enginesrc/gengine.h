@@ -0,0 +1,80 @@
+#ifndef GENGINE_H
+#define GENGINE_H
+
+#include "../src/gomoku.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace nsg
+{
+
+//Движок для турнирных менеджеров, работающий по текстовому протоколу Gomocup (Piskvork).
+//Команды читаются построчно, ответы выводятся в поток out.
+//Позиция хранится между командами TURN и обновляется ходами противника и движка,
+//а не строится заново.
+class GEngine
+{
+public:
+  GEngine(std::ostream& out);
+
+  DELETE_COPY(GEngine)
+
+  //Обрабатывает команды до команды END или конца потока
+  void run(std::istream& in);
+
+  //Обрабатывает одну строку протокола, возвращает false после команды END
+  bool command(const std::string& line);
+
+  //Время на очередной ход (мс) с учетом ограничений на ход и на партию
+  uint turnTime() const;
+
+  void setWeights(const GWeights& weights);
+
+  //См. Gomoku::setBook
+  void setBook(const GBook* book);
+
+protected:
+  void start(const std::string& args);
+  void turn(const std::string& args);
+  void boardLine(const std::string& line);
+  void info(const std::string& args);
+  void takeback(const std::string& args);
+
+  //Расставляет ходы, переданные командой BOARD
+  bool setupBoard();
+
+  //Подбирает и выводит ход движка
+  void think();
+
+  bool parseMove(const std::string& args, GPoint& move) const;
+
+  void error(const std::string& message);
+
+protected:
+  //Запас времени на ввод-вывод и на погрешность оценки времени поиска
+  static const uint TIME_RESERVE = 50;
+
+  //Ожидаемое число оставшихся ходов движка при ограничении времени на партию
+  static const uint MOVES_TO_GO = 20;
+
+  std::ostream& m_out;
+
+  Gomoku m_gomoku;
+
+  //Игрок, за которого играет движок
+  GPlayer m_player = G_BLACK;
+
+  //Ходы, переданные командой BOARD (второй элемент: true - ход движка)
+  std::vector<std::pair<GPoint, bool>> m_board;
+  bool m_board_input = false;
+
+  //Ограничения времени в мс (0 - нет ограничения на партию, ход как можно быстрее)
+  uint m_timeout_turn = 5000;
+  uint m_timeout_match = 0;
+  uint m_time_left = 0;
+};
+
+} //namespace nsg
+
+#endif
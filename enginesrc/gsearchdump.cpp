@@ -0,0 +1,78 @@
+#include "gsearchdump.h"
+#include <iomanip>
+
+namespace nsg
+{
+
+bool GSearchDump::build(const std::vector<GSearchRecord>& records)
+{
+  m_nodes.clear();
+  std::vector<uint> open;
+  for (const GSearchRecord& record: records)
+  {
+    if (record.kind == G_NODE_EXIT)
+    {
+      if (open.empty())
+        return false;
+      GNode& node = m_nodes[open.back()];
+      node.result = record.value;
+      node.subtree = uint(m_nodes.size() - open.back());
+      open.pop_back();
+      continue;
+    }
+    if (record.kind >= G_NODE_KIND_COUNT || record.value > G_WHITE)
+      return false;
+    m_nodes.push_back({GSearchNodeKind(record.kind), GPlayer(record.value), record.move, record.depth,
+                       GSearchRecord::NO_RESULT, (uint)open.size(), 0});
+    open.push_back(uint(m_nodes.size() - 1));
+  }
+  return open.empty();
+}
+
+void GSearchDump::print(std::ostream& out, uint min_nodes, uint max_level) const
+{
+  for (uint i = 0; i < m_nodes.size(); )
+  {
+    const GNode& node = m_nodes[i];
+    if (node.subtree < min_nodes || node.level > max_level)
+    {
+      //Поддерево пропускается целиком
+      i += node.subtree;
+      continue;
+    }
+    out << std::string(node.level * 2, ' ') << searchNodeName(node.kind)
+        << (node.player == G_BLACK ? " black" : " white");
+    if (node.move != GSearchRecord::NO_MOVE)
+      out << " " << node.move % GRID_WIDTH << "," << node.move / GRID_WIDTH;
+    out << " depth=" << (uint)node.depth;
+    if (node.result != GSearchRecord::NO_RESULT)
+      out << " result=" << (uint)node.result;
+    out << " nodes=" << node.subtree << std::endl;
+    ++i;
+  }
+}
+
+void GSearchDump::printSummary(std::ostream& out) const
+{
+  std::uint64_t count[G_NODE_KIND_COUNT] = {};
+  std::uint64_t success[G_NODE_KIND_COUNT] = {};
+  std::uint64_t subtree[G_NODE_KIND_COUNT] = {};
+  for (const GNode& node: m_nodes)
+  {
+    ++count[node.kind];
+    success[node.kind] += node.result == 1;
+    subtree[node.kind] += node.subtree;
+  }
+  out << "nodes: " << m_nodes.size() << std::endl;
+  for (uint kind = G_NODE_EXIT + 1; kind < G_NODE_KIND_COUNT; ++kind)
+  {
+    if (count[kind] == 0)
+      continue;
+    out << std::left << std::setw(16) << searchNodeName(GSearchNodeKind(kind)) << std::right
+        << " count=" << count[kind] << " success=" << success[kind]
+        << " avg_subtree=" << std::fixed << std::setprecision(1) << double(subtree[kind]) / count[kind]
+        << std::endl;
+  }
+}
+
+} //namespace nsg
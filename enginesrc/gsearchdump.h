@@ -0,0 +1,47 @@
+#ifndef GSEARCHDUMP_H
+#define GSEARCHDUMP_H
+
+#include "../src/gsearchlog.h"
+#include <iostream>
+#include <vector>
+
+namespace nsg
+{
+
+//Разбор журнала поиска (см. GSearchLog) в дерево с числом узлов в поддеревьях.
+//Узлы хранятся в порядке обхода в глубину, поэтому поддерево узла i занимает узлы [i, i + subtree).
+class GSearchDump
+{
+public:
+  struct GNode
+  {
+    GSearchNodeKind kind;
+    GPlayer player;
+    std::uint8_t move;
+    std::uint8_t depth;
+    std::uint8_t result;
+    uint level;    //уровень вложенности
+    uint subtree;  //число узлов поддерева, включая сам узел
+  };
+
+  //Возвращает false, если журнал не является корректным обходом дерева
+  bool build(const std::vector<GSearchRecord>& records);
+
+  const std::vector<GNode>& nodes() const
+  {
+    return m_nodes;
+  }
+
+  //Выводит узлы с поддеревом не меньше min_nodes и вложенностью не больше max_level
+  void print(std::ostream& out, uint min_nodes, uint max_level) const;
+
+  //Выводит число узлов каждого типа, число успешных результатов и средний размер поддерева
+  void printSummary(std::ostream& out) const;
+
+protected:
+  std::vector<GNode> m_nodes;
+};
+
+} //namespace nsg
+
+#endif
@@ -0,0 +1,71 @@
+#include "gsearchdump.h"
+#include "../src/gomoku.h"
+#include "../src/gtimer.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace nsg;
+
+//Запись и разбор журнала дерева поиска угроз.
+//  record file level x,y ... - подбирает ход в позиции (первыми ходят черные) и сохраняет журнал поиска
+//  print file [min_nodes] [max_level] - выводит сводку и узлы с крупными поддеревьями
+int main(int argc, char** argv)
+{
+  if (argc < 3 || (strcmp(argv[1], "record") != 0 && strcmp(argv[1], "print") != 0))
+  {
+    std::cerr << "usage: gomoku_searchdump record file level x,y ..." << std::endl
+              << "       gomoku_searchdump print file [min_nodes] [max_level]" << std::endl;
+    return 1;
+  }
+
+  GSearchLog log;
+  if (strcmp(argv[1], "record") == 0)
+  {
+    std::vector<GPoint> moves;
+    for (int i = 4; i < argc; ++i)
+    {
+      GPoint move;
+      char comma;
+      std::istringstream in(argv[i]);
+      if (!(in >> move.x >> comma >> move.y) || comma != ',')
+      {
+        std::cerr << "invalid move " << argv[i] << std::endl;
+        return 1;
+      }
+      moves.push_back(move);
+    }
+    Gomoku g;
+    g.setAiLevel(argc > 3 ? (uint)std::atoi(argv[3]) : 1);
+    if (!g.setMoves(moves))
+    {
+      std::cerr << "invalid position" << std::endl;
+      return 1;
+    }
+    g.setSearchLog(&log);
+    GTimer timer;
+    int x, y;
+    if (!g.hint(x, y))
+    {
+      std::cerr << "game over" << std::endl;
+      return 1;
+    }
+    std::cerr << "hint " << x << "," << y << ", time: " << timer.elapsed() << " ms, records: "
+              << log.records().size() << ", dropped nodes: " << log.dropped() << std::endl;
+    return log.save(argv[2]) ? 0 : 1;
+  }
+
+  std::ifstream in(argv[2], std::ios::binary);
+  GSearchDump dump;
+  if (!log.load(in) || !dump.build(log.records()))
+  {
+    std::cerr << "invalid search log " << argv[2] << std::endl;
+    return 1;
+  }
+  uint min_nodes = argc > 3 ? (uint)std::atoi(argv[3]) : 1000;
+  uint max_level = argc > 4 ? (uint)std::atoi(argv[4]) : 8;
+  dump.printSummary(std::cout);
+  dump.print(std::cout, min_nodes, max_level);
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "gselfplay.h"
+#include "../src/grandom.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace nsg
+{
+
+GSelfPlay::GSelfPlay(std::ostream& out, const GOptions& options) :
+  m_out(out),
+  m_options(options)
+{}
+
+void GSelfPlay::run()
+{
+  const char magic[4] = {'G', 'S', 'P', '1'};
+  std::uint32_t record_size = sizeof(GSampleRecord);
+  m_out.write(magic, sizeof(magic));
+  m_out.write((const char*)&record_size, sizeof(record_size));
+
+  std::vector<std::thread> threads;
+  for (uint i = 1; i < m_options.threads; ++i)
+    threads.emplace_back(&GSelfPlay::work, this);
+  work();
+  for (auto& thread: threads)
+    thread.join();
+  m_out.flush();
+}
+
+void GSelfPlay::work()
+{
+  //Каждая партия ведется на новом поле: порядок кандидатов в ходы зависит от истории поля,
+  //и при повторном использовании поля партия зависела бы от предыдущих партий потока
+  const uint max_pending = MAX_PENDING_GAMES * std::max(m_options.threads, 1u);
+  for (uint game = m_next_game++; game < m_options.games; game = m_next_game++)
+  {
+    {
+      //Все предыдущие партии уже взяты потоками, и партия m_next_write не ждет,
+      //поэтому ожидание завершается после ее вывода
+      std::unique_lock<std::mutex> lock(m_out_mutex);
+      m_written.wait(lock, [this, game, max_pending] { return game < m_next_write + max_pending; });
+    }
+    auto g = std::make_unique<Gomoku>();
+    playGame(*g, game);
+  }
+}
+
+void GSelfPlay::playGame(Gomoku& g, uint game)
+{
+  //Партия воспроизводима при заданном seed независимо от того, в каком потоке она сыграна
+  random_engine.seed(m_options.seed * 1000003u + game);
+  std::minstd_rand sampler(m_options.seed ^ (game * 2654435761u));
+  std::bernoulli_distribution is_sample(m_options.sample_rate);
+  std::uniform_int_distribution<int> random_coord(-2, 2);
+
+  g.setAiLevel(m_options.ai_level);
+
+  std::vector<GSampleRecord> records;
+  GSampleRecord position = {};
+  GPlayer player = G_BLACK;
+
+  for (uint move_number = 0; !g.isGameOver(); ++move_number, player = !player)
+  {
+    int x, y;
+    if (move_number < m_options.random_moves)
+    {
+      //Случайные ходы в окрестности центра поля
+      do
+      {
+        x = GRID_WIDTH / 2 + random_coord(sampler);
+        y = GRID_HEIGHT / 2 + random_coord(sampler);
+      }
+      while (!g.isValidNextMove(x, y));
+    }
+    else
+    {
+      if (!g.hint(x, y, player))
+        break;
+      ++m_position_count;
+      if (is_sample(sampler))
+      {
+        GSampleRecord& record = records.emplace_back(position);
+        record.player = (std::uint8_t)player;
+        record.move = (std::uint8_t)(y * GRID_WIDTH + x);
+        record.hint_kind = g.getLastHintKind();
+      }
+    }
+    g.doMove(x, y, player);
+    uint index = uint(y * GRID_WIDTH + x);
+    position.stones[player][index / 8] |= std::uint8_t(1 << (index % 8));
+  }
+
+  //Последний ход сделал победитель, если партия завершилась линией 5
+  bool is_draw = !g.getLine5();
+  GPlayer winner = !player;
+  for (GSampleRecord& record: records)
+    record.result = is_draw ? 0 : (record.player == winner ? 1 : -1);
+
+  write(game, std::move(records));
+}
+
+void GSelfPlay::write(uint game, std::vector<GSampleRecord>&& records)
+{
+  std::unique_lock<std::mutex> lock(m_out_mutex);
+  m_pending.emplace(game, std::move(records));
+  assert(m_pending.size() <= MAX_PENDING_GAMES * std::max(m_options.threads, 1u));
+  const uint next_write = m_next_write;
+  for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_next_write; it = m_pending.erase(it))
+  {
+    const std::vector<GSampleRecord>& game_records = it->second;
+    m_out.write((const char*)game_records.data(), std::streamsize(game_records.size() * sizeof(GSampleRecord)));
+    m_sample_count += game_records.size();
+    ++m_next_write;
+  }
+  const bool written = m_next_write != next_write;
+  lock.unlock();
+  if (written)
+    m_written.notify_all();
+}
+
+} //namespace nsg
@@ -0,0 +1,101 @@
+#ifndef GSELFPLAY_H
+#define GSELFPLAY_H
+
+#include "../src/gomoku.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace nsg
+{
+
+//Запись обучающей выборки фиксированного размера.
+//Позиция хранится битовыми масками камней (бит y * GRID_WIDTH + x),
+//ход - номером ячейки y * GRID_WIDTH + x.
+struct GSampleRecord
+{
+  static constexpr uint MASK_SIZE = (GRID_CELL_COUNT + 7) / 8;
+
+  std::uint8_t stones[2][MASK_SIZE]; //камни черных и белых
+  std::uint8_t player;               //игрок, выбравший ход (G_BLACK, G_WHITE)
+  std::uint8_t move;                 //выбранный ход
+  std::uint8_t hint_kind;            //этап подбора хода (GHintKind)
+  std::int8_t result;                //итог партии для игрока: 1 - выигрыш, 0 - ничья, -1 - проигрыш
+};
+
+static_assert(sizeof(GSampleRecord) == 2 * GSampleRecord::MASK_SIZE + 4);
+
+//Генератор обучающей выборки из партий ии с самим собой.
+//Партии играются в нескольких потоках, каждый поток ведет свою партию инкрементально
+//и подбирает ходы в сохраняемом между ходами контексте поиска, поэтому позиции не переигрываются.
+//Записи партии выводятся после ее завершения, когда известен итог, в порядке номеров партий,
+//поэтому выборка не зависит от числа потоков. Партии, завершенные раньше предыдущих, ждут вывода в памяти,
+//поэтому поток не начинает партию, пока вывод отстает от нее больше чем на MAX_PENDING_GAMES партий на поток.
+//
+//Формат файла: заголовок (4 байта "GSP1", 4 байта размер записи) и записи GSampleRecord.
+class GSelfPlay
+{
+public:
+  struct GOptions
+  {
+    uint games = 100;
+    uint threads = 1;
+    uint ai_level = 1;
+    //Доля позиций, попадающих в выборку
+    double sample_rate = 1.0;
+    //Число случайных ходов в начале партии для разнообразия дебютов.
+    //Алгоритмы первых ходов (см. Gomoku::hintForthMove) рассчитаны на нормальную игру,
+    //поэтому по умолчанию случайным делается только первый ход
+    uint random_moves = 1;
+    uint seed = 1;
+  };
+
+  GSelfPlay(std::ostream& out, const GOptions& options);
+
+  DELETE_COPY(GSelfPlay)
+
+  void run();
+
+  std::uint64_t positionCount() const
+  {
+    return m_position_count;
+  }
+
+  std::uint64_t sampleCount() const
+  {
+    return m_sample_count;
+  }
+
+protected:
+  //Число партий на поток, которые могут ожидать вывода
+  static const uint MAX_PENDING_GAMES = 2;
+
+  void work();
+  void playGame(Gomoku& g, uint game);
+  void write(uint game, std::vector<GSampleRecord>&& records);
+
+protected:
+  std::ostream& m_out;
+
+  const GOptions m_options;
+
+  std::mutex m_out_mutex;
+  //Номер следующей выводимой партии и завершенные партии, ожидающие вывода
+  uint m_next_write = 0;
+  std::map<uint, std::vector<GSampleRecord>> m_pending;
+  //Сигнал о выводе партий для потоков, ожидающих начала партии
+  std::condition_variable m_written;
+
+  std::atomic<uint> m_next_game{0};
+
+  std::atomic<std::uint64_t> m_position_count{0};
+  std::atomic<std::uint64_t> m_sample_count{0};
+};
+
+} //namespace nsg
+
+#endif
@@ -0,0 +1,42 @@
+#include "gselfplay.h"
+#include "../src/gtimer.h"
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+using namespace nsg;
+
+//Генерация обучающей выборки из партий ии с самим собой.
+//Параметры: файл выборки, число партий, число потоков, уровень ии, доля позиций в выборке, seed
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: gomoku_selfplay file [games] [threads] [level] [sample_rate] [seed]" << std::endl;
+    return 1;
+  }
+  GSelfPlay::GOptions options;
+  if (argc > 2)
+    options.games = (uint)std::atoi(argv[2]);
+  options.threads = argc > 3 ? (uint)std::atoi(argv[3]) : std::thread::hardware_concurrency();
+  if (argc > 4)
+    options.ai_level = (uint)std::atoi(argv[4]);
+  if (argc > 5)
+    options.sample_rate = std::atof(argv[5]);
+  if (argc > 6)
+    options.seed = (uint)std::atoi(argv[6]);
+
+  std::ofstream out(argv[1], std::ios::binary);
+  if (!out)
+  {
+    std::cerr << "cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+  GTimer timer;
+  GSelfPlay selfplay(out, options);
+  selfplay.run();
+  std::cerr << "positions: " << selfplay.positionCount()
+            << ", samples: " << selfplay.sampleCount()
+            << ", time: " << timer.elapsed() << " ms" << std::endl;
+  return out ? 0 : 1;
+}
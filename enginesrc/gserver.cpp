@@ -0,0 +1,410 @@
+#include "gserver.h"
+#include "../src/ggeometry.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace nsg
+{
+
+namespace
+{
+
+void skipSpaces(const std::string& s, size_t& pos)
+{
+  while (pos < s.size() && std::isspace((unsigned char)s[pos]))
+    ++pos;
+}
+
+bool parseJsonString(const std::string& s, size_t& pos, std::string& value)
+{
+  if (pos >= s.size() || s[pos] != '"')
+    return false;
+  value.clear();
+  for (++pos; pos < s.size(); ++pos)
+  {
+    char c = s[pos];
+    if (c == '"')
+    {
+      ++pos;
+      return true;
+    }
+    if (c == '\\')
+    {
+      if (++pos == s.size())
+        return false;
+      c = s[pos];
+      if (c == 'n')
+        c = '\n';
+      else if (c == 't')
+        c = '\t';
+    }
+    value += c;
+  }
+  return false;
+}
+
+std::string quote(const std::string& s)
+{
+  std::string result = "\"";
+  for (char c: s)
+  {
+    if (c == '"' || c == '\\')
+      result += '\\';
+    result += c;
+  }
+  return result + '"';
+}
+
+bool getUint(const GJsonObject& object, const char* key, uint& value)
+{
+  auto it = object.find(key);
+  if (it == object.end())
+    return false;
+  char* end = 0;
+  unsigned long v = std::strtoul(it->second.c_str(), &end, 10);
+  if (it->second.empty() || *end)
+    return false;
+  value = (uint)v;
+  return true;
+}
+
+} //namespace
+
+bool parseJsonLine(const std::string& line, GJsonObject& object)
+{
+  object.clear();
+  size_t pos = 0;
+  skipSpaces(line, pos);
+  if (pos >= line.size() || line[pos] != '{')
+    return false;
+  ++pos;
+  skipSpaces(line, pos);
+  if (pos < line.size() && line[pos] == '}')
+    return true;
+  for (; ; )
+  {
+    std::string key, value;
+    skipSpaces(line, pos);
+    if (!parseJsonString(line, pos, key))
+      return false;
+    skipSpaces(line, pos);
+    if (pos >= line.size() || line[pos++] != ':')
+      return false;
+    skipSpaces(line, pos);
+    if (pos < line.size() && line[pos] == '"')
+    {
+      if (!parseJsonString(line, pos, value))
+        return false;
+    }
+    else
+    {
+      //числа, true, false, null
+      while (pos < line.size() && line[pos] != ',' && line[pos] != '}' && !std::isspace((unsigned char)line[pos]))
+        value += line[pos++];
+      if (value.empty())
+        return false;
+    }
+    object[key] = value;
+    skipSpaces(line, pos);
+    if (pos >= line.size())
+      return false;
+    if (line[pos] == '}')
+      return true;
+    if (line[pos++] != ',')
+      return false;
+  }
+}
+
+bool GSession::doMove(const GPoint& move)
+{
+  if (!isMoveAllowed() || move.x < 0 || move.x >= GRID_WIDTH || move.y < 0 || move.y >= GRID_HEIGHT)
+    return false;
+  uint index = toIndex(move);
+  if (m_stones[0][index] || m_stones[1][index])
+    return false;
+  uint player = m_moves.size() % 2;
+  m_stones[player][index] = true;
+  m_moves.push_back((std::uint8_t)index);
+  m_line5 = isLine5(player, move);
+
+  //Окно становится мертвым, когда в нем впервые встречаются камни обоих игроков
+  GCell cell(move);
+  const std::uint16_t* windows = geometry.cellWindows(cell);
+  for (uint i = 0; i < geometry.cellWindowCount(cell); ++i)
+  {
+    const auto& window = geometry.window(windows[i]);
+    uint own = 0, opponent = 0;
+    GCell window_cell = window.start;
+    for (uint j = 0; j < 5; ++j, window_cell += dirs1[window.dir])
+    {
+      uint window_index = toIndex(window_cell.point());
+      own += m_stones[player][window_index];
+      opponent += m_stones[1 - player][window_index];
+    }
+    if (own == 1 && opponent > 0)
+      ++m_dead_windows;
+  }
+  return true;
+}
+
+void GSession::getMoves(std::vector<GPoint>& moves) const
+{
+  moves.clear();
+  for (std::uint8_t index: m_moves)
+    moves.push_back({index % GRID_WIDTH, index / GRID_WIDTH});
+}
+
+bool GSession::isLine5(uint player, const GPoint& move) const
+{
+  auto isPlayerCell = [&](const GPoint& p)
+  {
+    return p.x >= 0 && p.x < GRID_WIDTH && p.y >= 0 && p.y < GRID_HEIGHT && m_stones[player][toIndex(p)];
+  };
+  for (const GVector& v1: vecs1)
+  {
+    uint count = 1;
+    for (GPoint p = move + v1; isPlayerCell(p); p += v1)
+      ++count;
+    for (GPoint p = move - v1; isPlayerCell(p); p -= v1)
+      ++count;
+    if (count >= 5)
+      return true;
+  }
+  return false;
+}
+
+GServer::GServer(std::ostream& out, uint worker_count, uint queue_capacity, GTrace* trace) :
+  m_out(out),
+  m_queue_capacity(queue_capacity),
+  m_trace(trace)
+{
+  if (worker_count == 0)
+    worker_count = 1;
+  for (uint i = 0; i < worker_count; ++i)
+    m_workers.emplace_back(&GServer::work, this);
+}
+
+GServer::~GServer()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_task_ready.notify_all();
+  for (auto& worker: m_workers)
+    worker.join();
+}
+
+void GServer::run(std::istream& in)
+{
+  std::string line;
+  while (std::getline(in, line))
+    request(line);
+  wait();
+}
+
+void GServer::request(const std::string& line)
+{
+  GJsonObject req;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!parseJsonLine(line, req))
+  {
+    if (line.find_first_not_of(" \t\r") != std::string::npos)
+      reply(req, "\"error\":\"invalid request\"");
+    return;
+  }
+  const std::string& cmd = req["cmd"];
+  if (cmd == "new")
+    newSession(req);
+  else if (cmd == "move")
+    move(req);
+  else if (cmd == "hint")
+    hint(req);
+  else if (cmd == "close")
+    close(req);
+  else if (cmd == "stats")
+    stats(req);
+  else
+    reply(req, "\"error\":\"unknown command\"");
+}
+
+void GServer::wait()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this]{ return m_queue.empty() && m_running == 0; });
+}
+
+void GServer::newSession(const GJsonObject& req)
+{
+  uint id = m_next_session_id++;
+  GSession& session = m_sessions[id];
+  uint ai_level;
+  if (getUint(req, "level", ai_level))
+    session.m_ai_level = std::min(ai_level, IGomoku::getMaxAiLevel());
+  reply(req, "\"session\":" + std::to_string(id));
+}
+
+void GServer::move(const GJsonObject& req)
+{
+  GSession* session = findSession(req);
+  if (!session)
+    return;
+  uint x, y;
+  if (!getUint(req, "x", x) || !getUint(req, "y", y))
+  {
+    reply(req, "\"error\":\"invalid move\"");
+    return;
+  }
+  if (session->m_hint_pending)
+  {
+    reply(req, "\"error\":\"hint pending\"");
+    return;
+  }
+  if (!session->doMove({(int)x, (int)y}))
+  {
+    reply(req, "\"error\":\"invalid move\"");
+    return;
+  }
+  std::string body = "\"session\":" + req.at("session") + ",\"ok\":true";
+  if (session->isGameOver())
+    body += ",\"game_over\":true";
+  reply(req, body);
+}
+
+void GServer::hint(const GJsonObject& req)
+{
+  GSession* session = findSession(req);
+  if (!session)
+    return;
+  if (!session->isMoveAllowed())
+  {
+    reply(req, "\"error\":\"game over\"");
+    return;
+  }
+  if (session->m_hint_pending)
+  {
+    reply(req, "\"error\":\"hint pending\"");
+    return;
+  }
+  if (m_queue.size() >= m_queue_capacity)
+  {
+    ++m_rejected;
+    reply(req, "\"error\":\"server busy\"");
+    return;
+  }
+  GTask& task = m_queue.emplace_back();
+  task.session_id = (uint)std::stoul(req.at("session"));
+  task.ai_level = session->m_ai_level;
+  session->getMoves(task.moves);
+  auto it = req.find("id");
+  if (it != req.end())
+    task.id = it->second;
+  task.queued = std::chrono::steady_clock::now();
+  session->m_hint_pending = true;
+  m_task_ready.notify_one();
+}
+
+void GServer::close(const GJsonObject& req)
+{
+  if (!findSession(req))
+    return;
+  m_sessions.erase((uint)std::stoul(req.at("session")));
+  reply(req, "\"session\":" + req.at("session") + ",\"ok\":true");
+}
+
+void GServer::stats(const GJsonObject& req)
+{
+  std::uint64_t session_memory = 0;
+  for (const auto& item: m_sessions)
+    session_memory += item.second.memory();
+  std::ostringstream body;
+  body << "\"sessions\":" << m_sessions.size()
+       << ",\"session_bytes\":" << session_memory
+       << ",\"workers\":" << m_workers.size()
+       << ",\"queued\":" << m_queue.size()
+       << ",\"running\":" << m_running
+       << ",\"hints\":" << m_hint_count
+       << ",\"rejected\":" << m_rejected
+       << ",\"avg_queue_ms\":" << (m_hint_count ? m_queue_time_total / m_hint_count : 0)
+       << ",\"max_queue_ms\":" << m_queue_time_max;
+  reply(req, body.str());
+}
+
+void GServer::work()
+{
+  //Поле рабочего потока переиспользуется для всех сессий,
+  //совпадающее начало партии при смене позиции не переигрывается
+  auto g = std::make_unique<Gomoku>();
+  g->setTrace(m_trace);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (; ; )
+  {
+    m_task_ready.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+    if (m_queue.empty())
+      return;
+    GTask task = std::move(m_queue.front());
+    m_queue.pop_front();
+    ++m_running;
+    uint queue_time = (uint)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - task.queued).count();
+    ++m_hint_count;
+    m_queue_time_total += queue_time;
+    m_queue_time_max = std::max(m_queue_time_max, queue_time);
+
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    int x = -1, y = -1;
+    g->setAiLevel(task.ai_level);
+    bool found = g->setMoves(task.moves) && g->hint(x, y);
+    uint hint_time = (uint)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    lock.lock();
+
+    auto it = m_sessions.find(task.session_id);
+    //сессия могла быть закрыта, пока подбирался ход
+    if (it != m_sessions.end())
+    {
+      it->second.m_hint_pending = false;
+      std::string session = "\"session\":" + std::to_string(task.session_id);
+      if (found)
+        reply(task.id, session + ",\"x\":" + std::to_string(x) + ",\"y\":" + std::to_string(y) +
+              ",\"queue_ms\":" + std::to_string(queue_time) + ",\"hint_ms\":" + std::to_string(hint_time) +
+              (it->second.isGameOver() ? ",\"game_over\":true" : ""));
+      else
+        reply(task.id, session + ",\"error\":\"no move\"");
+    }
+    if (--m_running == 0 && m_queue.empty())
+      m_idle.notify_all();
+  }
+}
+
+GSession* GServer::findSession(const GJsonObject& req)
+{
+  uint id;
+  if (getUint(req, "session", id))
+  {
+    auto it = m_sessions.find(id);
+    if (it != m_sessions.end())
+      return &it->second;
+  }
+  reply(req, "\"error\":\"unknown session\"");
+  return 0;
+}
+
+void GServer::reply(const GJsonObject& req, const std::string& body)
+{
+  auto it = req.find("id");
+  reply(it == req.end() ? std::string() : it->second, body);
+}
+
+void GServer::reply(const std::string& id, const std::string& body)
+{
+  m_out << "{";
+  if (!id.empty())
+    m_out << "\"id\":" << quote(id) << ",";
+  m_out << body << "}" << std::endl;
+}
+
+} //namespace nsg
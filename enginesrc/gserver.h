@@ -0,0 +1,168 @@
+#ifndef GSERVER_H
+#define GSERVER_H
+
+#include "../src/gomoku.h"
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace nsg
+{
+
+//Плоский объект JSON из одной строки: значения хранятся строками
+using GJsonObject = std::map<std::string, std::string>;
+
+bool parseJsonLine(const std::string& line, GJsonObject& object);
+
+//Компактное состояние партии на сервере.
+//Полное поле Gomoku строится только в рабочем потоке на время подбора хода,
+//поэтому сессия занимает порядка сотни байт вместо сотен килобайт.
+class GSession
+{
+public:
+  //Игроки чередуются, первыми ходят черные.
+  //Как и Gomoku::doMove, ходы принимаются и после ничьей, до заполнения поля
+  bool doMove(const GPoint& move);
+
+  //Исход партии решен: построена линия 5 или ничья (см. isDraw)
+  bool isGameOver() const
+  {
+    return m_line5 || isDraw();
+  }
+
+  //Ни в одном окне (линии 5) нельзя построить линию 5, поскольку в каждом есть камни обоих игроков
+  //(заполненное поле без линии 5 - частный случай ничьей)
+  bool isDraw() const
+  {
+    return m_dead_windows == GGeometry::WINDOW_COUNT;
+  }
+
+  //Поле еще принимает ходы (в том числе после ничьей)
+  bool isMoveAllowed() const
+  {
+    return !m_line5 && m_moves.size() < GRID_CELL_COUNT;
+  }
+
+  void getMoves(std::vector<GPoint>& moves) const;
+
+  //Память, занимаемая сессией, в байтах
+  uint memory() const
+  {
+    return (uint)(sizeof(GSession) + m_moves.capacity());
+  }
+
+public:
+  uint m_ai_level = 1;
+
+  //Подбор хода поставлен в очередь и еще не завершен
+  bool m_hint_pending = false;
+
+protected:
+  bool isLine5(uint player, const GPoint& move) const;
+
+  static uint toIndex(const GPoint& p)
+  {
+    return uint(p.y * GRID_WIDTH + p.x);
+  }
+
+protected:
+  std::vector<std::uint8_t> m_moves;
+  std::bitset<GRID_CELL_COUNT> m_stones[2];
+  bool m_line5 = false;
+  //Число окон, содержащих камни обоих игроков
+  std::uint16_t m_dead_windows = 0;
+};
+
+//Сервер партий: обрабатывает запросы JSON (по одному в строке) для множества сессий.
+//Подбор хода выполняется ограниченным пулом рабочих потоков.
+//Очередь подбора ограничена, и каждая сессия занимает в ней не больше одного места,
+//поэтому запросы обслуживаются в порядке поступления, и одна сессия не может вытеснить остальные.
+//
+//Запросы (поле id, если задано, возвращается в ответе):
+//  {"cmd":"new","level":2}                     -> {"session":1}
+//  {"cmd":"move","session":1,"x":7,"y":7}      -> {"session":1,"ok":true}
+//  {"cmd":"hint","session":1}                  -> {"session":1,"x":8,"y":8,"queue_ms":0,"hint_ms":12}
+//Ответы на ход и подсказку содержат "game_over":true, если исход партии решен.
+//После ничьей ходы и подсказки принимаются до заполнения поля (см. Gomoku::hint), после линии 5 - нет
+//  {"cmd":"close","session":1}                 -> {"session":1,"ok":true}
+//  {"cmd":"stats"}                             -> {"sessions":...}
+//При ошибке возвращается {"error":"..."}
+//Если задан журнал trace, в него записываются этапы подбора ходов всех рабочих потоков.
+class GServer
+{
+public:
+  GServer(std::ostream& out, uint worker_count, uint queue_capacity, GTrace* trace = nullptr);
+
+  DELETE_COPY(GServer)
+
+  ~GServer();
+
+  //Обрабатывает запросы до конца потока и дожидается завершения подбора ходов
+  void run(std::istream& in);
+
+  void request(const std::string& line);
+
+  //Дожидается опустошения очереди
+  void wait();
+
+protected:
+  struct GTask
+  {
+    uint session_id;
+    uint ai_level;
+    std::vector<GPoint> moves;
+    std::string id;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  void newSession(const GJsonObject& req);
+  void move(const GJsonObject& req);
+  void hint(const GJsonObject& req);
+  void close(const GJsonObject& req);
+  void stats(const GJsonObject& req);
+
+  void work();
+
+  //Вызываются под блокировкой m_mutex
+  GSession* findSession(const GJsonObject& req);
+  void reply(const GJsonObject& req, const std::string& body);
+  void reply(const std::string& id, const std::string& body);
+
+protected:
+  std::ostream& m_out;
+
+  const uint m_queue_capacity;
+
+  GTrace* const m_trace;
+
+  std::mutex m_mutex;
+  std::condition_variable m_task_ready;
+  std::condition_variable m_idle;
+
+  std::unordered_map<uint, GSession> m_sessions;
+  uint m_next_session_id = 1;
+
+  std::deque<GTask> m_queue;
+  uint m_running = 0;
+  bool m_stop = false;
+
+  //Метрики очереди
+  std::uint64_t m_hint_count = 0;
+  std::uint64_t m_queue_time_total = 0;
+  uint m_queue_time_max = 0;
+  uint m_rejected = 0;
+
+  std::vector<std::thread> m_workers;
+};
+
+} //namespace nsg
+
+#endif
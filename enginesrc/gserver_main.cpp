@@ -0,0 +1,27 @@
+#include "gserver.h"
+#include <cstdlib>
+#include <memory>
+
+using namespace nsg;
+
+//Сервер партий, принимающий запросы JSON через стандартный ввод.
+//Параметры: число рабочих потоков (по умолчанию по числу ядер), размер очереди подбора ходов
+//и файл журнала этапов подбора ходов (Chrome trace event JSON, см. GTrace)
+int main(int argc, char** argv)
+{
+  uint worker_count = argc > 1 ? (uint)std::atoi(argv[1]) : std::thread::hardware_concurrency();
+  uint queue_capacity = argc > 2 ? (uint)std::atoi(argv[2]) : 1024;
+  std::unique_ptr<GTrace> trace;
+  if (argc > 3)
+    trace = std::make_unique<GTrace>();
+  {
+    GServer server(std::cout, worker_count, queue_capacity, trace.get());
+    server.run(std::cin);
+  }
+  if (trace && !trace->save(argv[3]))
+  {
+    std::cerr << "cannot save " << argv[3] << std::endl;
+    return 1;
+  }
+  return 0;
+}
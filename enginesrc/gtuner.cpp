@@ -0,0 +1,143 @@
+#include "gtuner.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace nsg
+{
+
+//Минимальный вес линии из одного камня при настройке.
+//Оценка не меняется при умножении всех весов линий на общий множитель,
+//поэтому малые целые веса масштабируются, чтобы относительные смещения не терялись при округлении
+static const int MIN_TUNED_LINE_WGT = 20;
+
+GTuner::GTuner(const GOptions& options, const GWeights& weights) :
+  m_options(options),
+  m_theta(PARAM_COUNT, 1.0),
+  m_scale(PARAM_COUNT)
+{
+  assert(weights.isValid());
+  int factor = (MIN_TUNED_LINE_WGT + weights.line[1] - 1) / weights.line[1];
+  for (uint i = 1; i <= GWeights::MAX_LINE; ++i)
+    m_scale[i - 1] = weights.line[i] * factor;
+  m_scale[GWeights::MAX_LINE] = weights.variants;
+}
+
+void GTuner::run(std::ostream& log, const char* path)
+{
+  while (m_iteration < m_options.iterations)
+  {
+    double score = step();
+    GWeights w = weights();
+    log << "iteration " << m_iteration << " score " << score << ": ";
+    w.save(log);
+    if (path && !w.save(path))
+      log << "cannot save " << path << std::endl;
+  }
+}
+
+double GTuner::step()
+{
+  double k = m_iteration + 1;
+  double a_k = m_options.a / std::pow(k + m_options.iterations / 10, 0.602);
+  double c_k = m_options.c / std::pow(k, 0.101);
+
+  std::minstd_rand rand(m_options.seed * 7919u + m_iteration);
+  std::bernoulli_distribution sign;
+  std::vector<double> delta(PARAM_COUNT), plus(PARAM_COUNT), minus(PARAM_COUNT);
+  for (uint i = 0; i < PARAM_COUNT; ++i)
+  {
+    delta[i] = sign(rand) ? 1.0 : -1.0;
+    plus[i] = m_theta[i] + c_k * delta[i];
+    minus[i] = m_theta[i] - c_k * delta[i];
+  }
+
+  double score = playMatch(toWeights(plus), toWeights(minus));
+
+  //Разность результатов наборов: (score) - (1 - score)
+  double gradient = (2 * score - 1) / (2 * c_k);
+  for (uint i = 0; i < PARAM_COUNT; ++i)
+    m_theta[i] = std::max(0.0, m_theta[i] + a_k * gradient * delta[i]);
+
+  ++m_iteration;
+  return score;
+}
+
+GWeights GTuner::weights() const
+{
+  return toWeights(m_theta);
+}
+
+GWeights GTuner::toWeights(const std::vector<double>& theta) const
+{
+  GWeights w;
+  for (uint i = 1; i <= GWeights::MAX_LINE; ++i)
+  {
+    int wgt = (int)std::lround(theta[i - 1] * m_scale[i - 1]);
+    w.line[i] = std::max({1, wgt, w.line[i - 1]});
+  }
+  long variants = std::lround(theta[GWeights::MAX_LINE] * m_scale[GWeights::MAX_LINE]);
+  w.variants = (uint)std::clamp(variants, 1l, (long)GRID_CELL_COUNT);
+  assert(w.isValid());
+  return w;
+}
+
+double GTuner::playMatch(const GWeights& first, const GWeights& second)
+{
+  m_next_game = 0;
+  m_points = 0;
+
+  std::vector<std::thread> threads;
+  for (uint i = 1; i < m_options.threads; ++i)
+    threads.emplace_back(&GTuner::work, this, std::cref(first), std::cref(second));
+  work(first, second);
+  for (auto& thread: threads)
+    thread.join();
+
+  ++m_match;
+  return m_options.games ? m_points / (2.0 * m_options.games) : 0.5;
+}
+
+void GTuner::work(const GWeights& first, const GWeights& second)
+{
+  for (uint game = m_next_game++; game < m_options.games; game = m_next_game++)
+    m_points += playGame(first, second, game);
+}
+
+uint GTuner::playGame(const GWeights& first, const GWeights& second, uint game)
+{
+  //Дебют (случайный первый ход) общий для пары партий, в нечетной партии first играет белыми
+  uint opening = m_options.seed * 1000003u + m_match * 65537u + game / 2;
+  random_engine.seed(opening);
+  std::minstd_rand rand(opening);
+  std::uniform_int_distribution<int> random_coord(-2, 2);
+
+  //У каждого игрока свое поле: контекст поиска и веса ходов зависят от параметров оценки
+  std::unique_ptr<Gomoku> g[2] = {std::make_unique<Gomoku>(), std::make_unique<Gomoku>()};
+  GPlayer first_player = (game % 2 == 0) ? G_BLACK : G_WHITE;
+  g[first_player]->setWeights(first);
+  g[!first_player]->setWeights(second);
+
+  int x = GRID_WIDTH / 2 + random_coord(rand);
+  int y = GRID_HEIGHT / 2 + random_coord(rand);
+  GPlayer player = G_BLACK;
+  for (;; player = !player)
+  {
+    g[G_BLACK]->doMove(x, y, player);
+    g[G_WHITE]->doMove(x, y, player);
+    if (g[G_BLACK]->isGameOver())
+      break;
+    GPlayer next = !player;
+    if (!g[next]->hintInTime(x, y, next, m_options.time_limit))
+      break;
+  }
+
+  if (!g[G_BLACK]->getLine5())
+    return 1;
+  //Последний ход сделал победитель
+  return player == first_player ? 2 : 0;
+}
+
+} //namespace nsg
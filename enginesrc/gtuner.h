@@ -0,0 +1,83 @@
+#ifndef GTUNER_H
+#define GTUNER_H
+
+#include "../src/gomoku.h"
+#include "../src/gweights.h"
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+namespace nsg
+{
+
+//Автоматическая настройка параметров оценки (GWeights) методом SPSA.
+//На каждой итерации все параметры одновременно смещаются на случайный знак ±c_k,
+//и два полученных набора играют матч при фиксированном времени на ход.
+//Доля очков набора со смещением +c_k дает оценку градиента силы игры,
+//по которой параметры сдвигаются с убывающим шагом a_k.
+//Параметры нормируются на начальные значения, поэтому смещения относительные.
+class GTuner
+{
+public:
+  struct GOptions
+  {
+    uint iterations = 100;
+    //Число партий матча на итерацию (каждый дебют играется дважды со сменой цвета)
+    uint games = 16;
+    uint threads = 1;
+    //Время на ход (мс)
+    uint time_limit = 20;
+    //Коэффициенты SPSA: a_k = a / (k + 1 + A)^0.602, c_k = c / (k + 1)^0.101, A = iterations / 10
+    double a = 0.05;
+    double c = 0.1;
+    uint seed = 1;
+  };
+
+  GTuner(const GOptions& options, const GWeights& weights);
+
+  DELETE_COPY(GTuner)
+
+  //Выполняет итерации, после каждой выводит текущие параметры в log и сохраняет их в файл path
+  void run(std::ostream& log, const char* path = nullptr);
+
+  //Одна итерация SPSA, возвращает долю очков набора со смещением +c_k
+  double step();
+
+  GWeights weights() const;
+
+  //Матч двух наборов параметров, возвращает долю очков first
+  double playMatch(const GWeights& first, const GWeights& second);
+
+  uint iteration() const
+  {
+    return m_iteration;
+  }
+
+protected:
+  //Параметры: веса линий 1..MAX_LINE и число проверяемых вариантов
+  static const uint PARAM_COUNT = GWeights::MAX_LINE + 1;
+
+  GWeights toWeights(const std::vector<double>& theta) const;
+
+  void work(const GWeights& first, const GWeights& second);
+
+  //Возвращает очки first в удвоенных единицах: 2 - выигрыш, 1 - ничья, 0 - проигрыш
+  uint playGame(const GWeights& first, const GWeights& second, uint game);
+
+protected:
+  const GOptions m_options;
+
+  //Нормированные параметры (1.0 - начальное значение) и масштаб нормировки
+  std::vector<double> m_theta;
+  std::vector<double> m_scale;
+
+  uint m_iteration = 0;
+  uint m_match = 0;
+
+  std::atomic<uint> m_next_game{0};
+  std::atomic<uint> m_points{0};
+};
+
+} //namespace nsg
+
+#endif
@@ -0,0 +1,37 @@
+#include "gtuner.h"
+#include "../src/gtimer.h"
+#include <cstdlib>
+#include <thread>
+
+using namespace nsg;
+
+//Настройка параметров оценки по матчам ии с самим собой.
+//Параметры: файл параметров (читается, если существует, и перезаписывается после каждой итерации),
+//число итераций, число партий на итерацию, время на ход (мс), число потоков, seed
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: gomoku_tune file [iterations] [games] [time_ms] [threads] [seed]" << std::endl;
+    return 1;
+  }
+  GWeights weights;
+  weights.load(argv[1]);
+
+  GTuner::GOptions options;
+  if (argc > 2)
+    options.iterations = (uint)std::atoi(argv[2]);
+  if (argc > 3)
+    options.games = (uint)std::atoi(argv[3]);
+  if (argc > 4)
+    options.time_limit = (uint)std::atoi(argv[4]);
+  options.threads = argc > 5 ? (uint)std::atoi(argv[5]) : std::thread::hardware_concurrency();
+  if (argc > 6)
+    options.seed = (uint)std::atoi(argv[6]);
+
+  GTimer timer;
+  GTuner tuner(options, weights);
+  tuner.run(std::cerr, argv[1]);
+  std::cerr << "time: " << timer.elapsed() << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,34 @@
+#include "gengine.h"
+#include "../src/gbook.h"
+#include <memory>
+
+using namespace nsg;
+
+//Исполняемый файл движка для турнирных менеджеров (Piskvork и др.)
+//Параметры: файл весов оценки (см. GWeights) и файл дебютной книги (см. GBook)
+int main(int argc, char** argv)
+{
+  GBook book;
+  auto engine = std::make_unique<GEngine>(std::cout);
+  if (argc > 1)
+  {
+    GWeights weights;
+    if (!weights.load(argv[1]))
+    {
+      std::cerr << "cannot load weights " << argv[1] << std::endl;
+      return 1;
+    }
+    engine->setWeights(weights);
+  }
+  if (argc > 2)
+  {
+    if (!book.load(argv[2]))
+    {
+      std::cerr << "cannot load book " << argv[2] << std::endl;
+      return 1;
+    }
+    engine->setBook(&book);
+  }
+  engine->run(std::cin);
+  return 0;
+}
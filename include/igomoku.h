@@ -30,7 +30,7 @@ public:
   virtual unsigned getAiLevel() const = 0;
   virtual void setAiLevel(unsigned level) = 0;
 
-  static unsigned getMaxAiLevel()
+  static constexpr unsigned getMaxAiLevel()
   {
     return 4;
   }
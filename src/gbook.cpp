@@ -0,0 +1,162 @@
+#include "gbook.h"
+#include "ggeometry.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace nsg
+{
+
+//Ключ очереди хода белых - ключ ячейки рамки, в которой камней не бывает
+static const std::uint64_t WHITE_TO_MOVE_KEY = geometry.zobrist(GCell::fromIndex(0), G_BLACK);
+
+void GBookPosition::clear()
+{
+  for (auto& hash: m_hashes)
+    hash = 0;
+}
+
+void GBookPosition::add(const GCell& cell, GPlayer player)
+{
+  for (uint symmetry = 0; symmetry < GSymmetry::COUNT; ++symmetry)
+    m_hashes[symmetry] ^= geometry.zobrist(GSymmetry::apply(cell, symmetry), player);
+}
+
+std::uint64_t GBookPosition::key(GPlayer player, uint* symmetry) const
+{
+  std::uint64_t side = player == G_WHITE ? WHITE_TO_MOVE_KEY : 0;
+  uint best = 0;
+  for (uint i = 1; i < GSymmetry::COUNT; ++i)
+  {
+    if ((m_hashes[i] ^ side) < (m_hashes[best] ^ side))
+      best = i;
+  }
+  if (symmetry)
+    *symmetry = best;
+  return m_hashes[best] ^ side;
+}
+
+void GBook::clear()
+{
+  m_entries.clear();
+  m_max_ply = 0;
+}
+
+std::pair<const GBookEntry*, const GBookEntry*> GBook::find(std::uint64_t key) const
+{
+  const GBookEntry* end = m_entries.data() + m_entries.size();
+  const GBookEntry* first = std::lower_bound(m_entries.data(), end, key,
+                                             [](const GBookEntry& entry, std::uint64_t key){ return entry.key < key; });
+  const GBookEntry* last = first;
+  for (; last != end && last->key == key; ++last);
+  return {first, last};
+}
+
+uint GBook::searchLevel(std::uint64_t key) const
+{
+  uint level = 0;
+  auto [first, last] = find(key);
+  for (const GBookEntry* entry = first; entry != last; ++entry)
+    level = std::max(level, (uint)entry->level);
+  return level;
+}
+
+void GBook::merge(std::vector<GBookEntry> entries)
+{
+  entries.insert(entries.end(), m_entries.begin(), m_entries.end());
+  std::sort(entries.begin(), entries.end());
+  m_entries.clear();
+  for (const GBookEntry& entry: entries)
+  {
+    if (m_entries.empty() || m_entries.back() < entry)
+    {
+      m_entries.push_back(entry);
+      continue;
+    }
+    GBookEntry& merged = m_entries.back();
+    uint games = merged.games + entry.games;
+    uint points = merged.points + entry.points;
+    //При переполнении счетчиков статистика уменьшается вдвое, доля очков сохраняется
+    for (; games > UINT16_MAX; games /= 2, points /= 2);
+    merged.games = std::uint16_t(games);
+    merged.points = std::uint16_t(points);
+    if (entry.level > merged.level)
+    {
+      merged.level = entry.level;
+      merged.hint_kind = entry.hint_kind;
+    }
+  }
+  updateMaxPly();
+}
+
+bool GBook::hint(const GBookPosition& position, GPlayer player, uint max_level, GCell& move) const
+{
+  uint symmetry;
+  auto [first, last] = find(position.key(player, &symmetry));
+  const GBookEntry* best = nullptr;
+  for (const GBookEntry* entry = first; entry != last; ++entry)
+  {
+    if (entry->level > 0 && entry->level <= max_level && (!best || entry->level > best->level))
+      best = entry;
+  }
+  if (!best)
+    return false;
+  move = GSymmetry::apply(fromCellId(best->move), GSymmetry::inverse(symmetry));
+  return true;
+}
+
+bool GBook::load(std::istream& in)
+{
+  char magic[4];
+  std::uint32_t record_size = 0;
+  if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, "GBK1", sizeof(magic)) != 0 ||
+      !in.read((char*)&record_size, sizeof(record_size)) || record_size != sizeof(GBookEntry))
+    return false;
+  std::vector<GBookEntry> entries;
+  GBookEntry entry;
+  while (in.read((char*)&entry, sizeof(entry)))
+  {
+    //Записи упорядочены и не повторяются
+    if (!entries.empty() && !(entries.back() < entry))
+      return false;
+    if (entry.move >= GRID_CELL_COUNT)
+      return false;
+    entries.push_back(entry);
+  }
+  if (in.gcount() != 0)
+    return false;
+  m_entries = std::move(entries);
+  updateMaxPly();
+  return true;
+}
+
+bool GBook::load(const char* path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return in && load(in);
+}
+
+void GBook::save(std::ostream& out) const
+{
+  const char magic[4] = {'G', 'B', 'K', '1'};
+  std::uint32_t record_size = sizeof(GBookEntry);
+  out.write(magic, sizeof(magic));
+  out.write((const char*)&record_size, sizeof(record_size));
+  out.write((const char*)m_entries.data(), std::streamsize(m_entries.size() * sizeof(GBookEntry)));
+}
+
+bool GBook::save(const char* path) const
+{
+  std::ofstream out(path, std::ios::binary);
+  save(out);
+  return (bool)out;
+}
+
+void GBook::updateMaxPly()
+{
+  m_max_ply = 0;
+  for (const GBookEntry& entry: m_entries)
+    m_max_ply = std::max(m_max_ply, (uint)entry.ply);
+}
+
+} //namespace nsg
@@ -0,0 +1,146 @@
+#ifndef GBOOK_H
+#define GBOOK_H
+
+#include "gcell.h"
+#include "gplayer.h"
+#include "gint.h"
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace nsg
+{
+
+//Преобразования симметрии поля: отражение относительно главной диагонали (бит 2),
+//затем отражения по x (бит 0) и по y (бит 1).
+//Для неквадратного поля допустимы только отражения без диагонального
+struct GSymmetry
+{
+  static constexpr uint COUNT = GRID_WIDTH == GRID_HEIGHT ? 8 : 4;
+
+  static GCell apply(const GCell& cell, uint symmetry)
+  {
+    assert(symmetry < COUNT);
+    int x = cell.x(), y = cell.y();
+    if (symmetry & 4)
+      std::swap(x, y);
+    if (symmetry & 1)
+      x = GRID_WIDTH - 1 - x;
+    if (symmetry & 2)
+      y = GRID_HEIGHT - 1 - y;
+    return GCell(x, y);
+  }
+
+  //Обратное преобразование: после диагонального отражения отражения по x и по y меняются местами
+  static uint inverse(uint symmetry)
+  {
+    return (symmetry & 4) ? (4 | (symmetry & 1) << 1 | (symmetry & 2) >> 1) : symmetry;
+  }
+};
+
+//Позиция дебютной книги: хэши камней во всех симметричных преобразованиях позиции.
+//Ключ позиции - наименьший из хэшей, поэтому он одинаков для симметричных позиций
+//и не зависит от порядка ходов
+class GBookPosition
+{
+public:
+  void clear();
+
+  //Ставит камень (повторный вызов снимает его)
+  void add(const GCell& cell, GPlayer player);
+
+  //Ключ позиции с очередью хода player и преобразование, переводящее позицию в каноническую
+  //(по ключу которой записаны ходы книги)
+  std::uint64_t key(GPlayer player, uint* symmetry = nullptr) const;
+
+protected:
+  std::uint64_t m_hashes[GSymmetry::COUNT] = {};
+};
+
+//Запись книги: ход в канонической позиции (см. GBookPosition) и его статистика
+struct GBookEntry
+{
+  std::uint64_t key;
+  //Партии с этим ходом и набранные в них очки игрока (2 - выигрыш, 1 - ничья)
+  std::uint16_t games;
+  std::uint16_t points;
+  //Ход в канонической позиции (см. GCellId)
+  GCellId move;
+  //Уровень ии поиска, выбравшего ход (0 - ход только из партий)
+  std::uint8_t level;
+  //Этап подбора хода поиска (GHintKind)
+  std::uint8_t hint_kind;
+  //Число камней в позиции
+  std::uint8_t ply;
+
+  bool operator<(const GBookEntry& entry) const
+  {
+    return key < entry.key || (key == entry.key && move < entry.move);
+  }
+};
+
+static_assert(sizeof(GBookEntry) == 16);
+
+//Дебютная книга: записи, упорядоченные по ключу позиции и ходу.
+//Ход книги - ход поиска наибольшего уровня, не превышающего уровень ии подсказки, поэтому книга не делает ии сильнее.
+//Статистика партий в подсказке не участвует: она задает продолжения дерева дебютов (см. GBookBuilder).
+//
+//Формат файла: заголовок (4 байта "GBK1", 4 байта размер записи) и записи GBookEntry.
+class GBook
+{
+public:
+  static const uint MIN_GAMES = 4;
+
+  bool empty() const
+  {
+    return m_entries.empty();
+  }
+
+  uint size() const
+  {
+    return (uint)m_entries.size();
+  }
+
+  const std::vector<GBookEntry>& entries() const
+  {
+    return m_entries;
+  }
+
+  //Наибольшее число камней в позициях книги
+  uint maxPly() const
+  {
+    return m_max_ply;
+  }
+
+  void clear();
+
+  //Записи позиции [first, second)
+  std::pair<const GBookEntry*, const GBookEntry*> find(std::uint64_t key) const;
+
+  //Наибольший уровень поиска среди ходов позиции (0 - поиска не было)
+  uint searchLevel(std::uint64_t key) const;
+
+  //Добавляет записи: статистика записей с одинаковыми позицией и ходом складывается,
+  //уровень поиска и этап берутся от поиска большего уровня
+  void merge(std::vector<GBookEntry> entries);
+
+  //Ход книги в позиции с очередью хода player: ход поиска наибольшего уровня, не превышающего max_level
+  bool hint(const GBookPosition& position, GPlayer player, uint max_level, GCell& move) const;
+
+  bool load(std::istream& in);
+  bool load(const char* path);
+  void save(std::ostream& out) const;
+  bool save(const char* path) const;
+
+protected:
+  void updateMaxPly();
+
+protected:
+  std::vector<GBookEntry> m_entries;
+  uint m_max_ply = 0;
+};
+
+} //namespace nsg
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef GCELL_H
+#define GCELL_H
+
+#include "gdefs.h"
+#include "gpoint.h"
+#include <cstdint>
+
+namespace nsg
+{
+
+//Смещение между ячейками в линейном массиве поля
+//(направление или направление, умноженное на число шагов)
+using GOffset = int;
+
+//Ячейка поля, заданная индексом в линейном массиве.
+//Поле окружено рамкой из стен шириной BORDER,
+//поэтому от любой ячейки поля можно сделать до BORDER шагов в любом направлении,
+//не выходя за пределы массива. Соседние строки разделяет общая стена:
+//правая стена строки одновременно является левой стеной следующей строки.
+//GPoint используется только во внешнем интерфейсе.
+class GCell
+{
+public:
+  //Ширина рамки достаточна для линии 5 и соседних с ней ячеек
+  static constexpr int BORDER = 5;
+
+  //Шаг строки
+  static constexpr int STRIDE = GRID_WIDTH + BORDER;
+
+  //Размер линейного массива
+  static constexpr int INDEX_COUNT = (GRID_HEIGHT + 2 * BORDER) * STRIDE + BORDER;
+
+  GCell() = default;
+
+  constexpr GCell(int x, int y) : index(std::int16_t((y + BORDER) * STRIDE + x + BORDER))
+  {}
+
+  constexpr GCell(const GPoint& p) : GCell(p.x, p.y)
+  {}
+
+  static constexpr GCell fromIndex(int index)
+  {
+    GCell cell(0, 0);
+    cell.index = std::int16_t(index);
+    return cell;
+  }
+
+  constexpr int x() const
+  {
+    return index % STRIDE - BORDER;
+  }
+
+  constexpr int y() const
+  {
+    return index / STRIDE - BORDER;
+  }
+
+  constexpr GPoint point() const
+  {
+    return {x(), y()};
+  }
+
+  constexpr bool isValid() const
+  {
+    return x() >= 0 && x() < GRID_WIDTH && y() >= 0 && y() < GRID_HEIGHT;
+  }
+
+  constexpr bool operator==(const GCell& cell) const
+  {
+    return index == cell.index;
+  }
+
+  constexpr bool operator!=(const GCell& cell) const
+  {
+    return index != cell.index;
+  }
+
+  constexpr GCell operator+(GOffset offset) const
+  {
+    return fromIndex(index + offset);
+  }
+
+  constexpr GCell operator-(GOffset offset) const
+  {
+    return fromIndex(index - offset);
+  }
+
+  constexpr void operator+=(GOffset offset)
+  {
+    index = std::int16_t(index + offset);
+  }
+
+  constexpr void operator-=(GOffset offset)
+  {
+    index = std::int16_t(index - offset);
+  }
+
+public:
+  std::int16_t index;
+};
+
+//Компактный номер ячейки поля: y * GRID_WIDTH + x (помещается в байт).
+//Используется в массивах, которые хранятся для каждой ячейки (см. GCellStack)
+using GCellId = std::uint8_t;
+
+static_assert(GRID_CELL_COUNT <= 256, "GCellId does not fit in a byte");
+
+constexpr GCellId toCellId(const GCell& cell)
+{
+  return GCellId(cell.y() * GRID_WIDTH + cell.x());
+}
+
+constexpr GCell fromCellId(GCellId id)
+{
+  return GCell(id % GRID_WIDTH, id / GRID_WIDTH);
+}
+
+//Смещение в линейном массиве, соответствующее вектору на поле
+constexpr GOffset toOffset(const GVector& v)
+{
+  return v.y * GCell::STRIDE + v.x;
+}
+
+} //namespace nsg
+
+#endif
@@ -11,6 +11,14 @@
 
 #define GRID_CELL_COUNT (GRID_WIDTH * GRID_HEIGHT)
 
+//Кандидатами в ходы считаются пустые ячейки на расстоянии не больше
+//радиуса кандидатов от занятых (по каждой из координат).
+//CANDIDATE_RADIUS - радиус по умолчанию, поле меняет его без пересборки (см. Gomoku::setCandidateRadius).
+//Радиус 2 покрывает все ходы шахов и открытых троек
+#ifndef CANDIDATE_RADIUS
+#define CANDIDATE_RADIUS 2
+#endif
+
 #define DELETE_COPY(ClassName) \
   ClassName(const ClassName&) = delete;\
   ClassName& operator=(const ClassName&) = delete;
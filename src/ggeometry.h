@@ -0,0 +1,183 @@
+#ifndef GGEOMETRY_H
+#define GGEOMETRY_H
+
+#include "gcell.h"
+#include "gint.h"
+#include <cstdint>
+
+namespace nsg
+{
+
+//Направления линий на поле
+constexpr GVector vecs1[] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}};
+
+//Смещения в линейном массиве поля, соответствующие vecs1
+constexpr GOffset dirs1[] = {toOffset(vecs1[0]), toOffset(vecs1[1]), toOffset(vecs1[2]), toOffset(vecs1[3])};
+
+//Таблицы геометрии поля, вычисляемые на этапе компиляции.
+//Размер поля задан константами GRID_WIDTH, GRID_HEIGHT,
+//поэтому таблицы общие для всех экземпляров и доступны только для чтения.
+//Таблицы индексируются индексом ячейки в линейном массиве поля (см. GCell).
+class GGeometry
+{
+public:
+  //Максимальная длина луча (число ячеек линии 5 по одну сторону от центра)
+  static constexpr uint MAX_RAY = 4;
+
+  //Число линий 5 (окон), которые полностью лежат в поле
+  static constexpr uint WINDOW_COUNT =
+    2 * (GRID_WIDTH - 4) * (GRID_HEIGHT - 4) + (GRID_WIDTH - 4) * GRID_HEIGHT + GRID_WIDTH * (GRID_HEIGHT - 4);
+
+  //Максимальное число окон, содержащих одну ячейку
+  static constexpr uint MAX_CELL_WINDOWS = 4 * 5;
+
+  //Окно - линия 5 с началом start в направлении dirs1[dir]
+  struct GWindow
+  {
+    GCell start;
+    std::uint8_t dir;
+  };
+
+  constexpr GGeometry()
+  {
+    for (int y = 0; y < GRID_HEIGHT; ++y)
+    {
+      for (int x = 0; x < GRID_WIDTH; ++x)
+      {
+        GCell cell(x, y);
+        for (uint dir = 0; dir < 4; ++dir)
+        {
+          m_ray[cell.index][dir * 2] = rayLength({x, y}, vecs1[dir]);
+          m_ray[cell.index][dir * 2 + 1] = rayLength({x, y}, {-vecs1[dir].x, -vecs1[dir].y});
+        }
+      }
+    }
+
+    //Окна перечисляются по направлениям, а внутри направления по возрастанию индекса начала,
+    //поэтому окна каждой ячейки одного направления также упорядочены по возрастанию начала
+    for (uint dir = 0; dir < 4; ++dir)
+    {
+      for (int y = 0; y < GRID_HEIGHT; ++y)
+      {
+        for (int x = 0; x < GRID_WIDTH; ++x)
+        {
+          GCell start(x, y);
+          if (m_ray[start.index][dir * 2] < MAX_RAY)
+            continue;
+          m_windows[m_window_count] = {start, std::uint8_t(dir)};
+          GCell cell = start;
+          for (uint i = 0; i < 5; ++i, cell += dirs1[dir])
+          {
+            auto& cell_windows = m_cell_windows[cell.index];
+            cell_windows.ids[cell_windows.count++] = std::uint16_t(m_window_count);
+            ++cell_windows.dir_count[dir];
+          }
+          ++m_window_count;
+        }
+      }
+    }
+
+    //Ключи Зобриста для хэша позиции
+    std::uint64_t seed = 0;
+    for (int i = 0; i < GCell::INDEX_COUNT; ++i)
+    {
+      m_zobrist[i][0] = splitMix64(seed);
+      m_zobrist[i][1] = splitMix64(seed);
+    }
+  }
+
+  //Число ячеек поля (не больше MAX_RAY) от ячейки в направлении dirs1[dir] (backward = false)
+  //или в противоположном направлении (backward = true)
+  constexpr uint ray(const GCell& cell, uint dir, bool backward) const
+  {
+    return m_ray[cell.index][dir * 2 + backward];
+  }
+
+  //Начальный вес хода в ячейку на пустом поле (число содержащих ее окон)
+  constexpr int initWgt(const GCell& cell) const
+  {
+    return m_cell_windows[cell.index].count;
+  }
+
+  constexpr const GWindow& window(uint id) const
+  {
+    return m_windows[id];
+  }
+
+  constexpr uint windowCount() const
+  {
+    return m_window_count;
+  }
+
+  //Окна, содержащие ячейку, сгруппированы по направлениям
+  constexpr uint cellWindowCount(const GCell& cell) const
+  {
+    return m_cell_windows[cell.index].count;
+  }
+
+  constexpr const std::uint16_t* cellWindows(const GCell& cell) const
+  {
+    return m_cell_windows[cell.index].ids;
+  }
+
+  //Окна ячейки в направлении dirs1[dir], упорядоченные по возрастанию начала
+  constexpr const std::uint16_t* cellWindows(const GCell& cell, uint dir, uint& count) const
+  {
+    const auto& cell_windows = m_cell_windows[cell.index];
+    uint first = 0;
+    for (uint i = 0; i < dir; ++i)
+      first += cell_windows.dir_count[i];
+    count = cell_windows.dir_count[dir];
+    return cell_windows.ids + first;
+  }
+
+  //Ключ камня игрока player (0 - черные, 1 - белые) в ячейке. Хэш позиции - xor ключей всех камней
+  constexpr std::uint64_t zobrist(const GCell& cell, uint player) const
+  {
+    return m_zobrist[cell.index][player];
+  }
+
+protected:
+  static constexpr std::uint64_t splitMix64(std::uint64_t& state)
+  {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  static constexpr std::uint8_t rayLength(GPoint p, const GVector& v1)
+  {
+    std::uint8_t len = 0;
+    for (; len < MAX_RAY; ++len)
+    {
+      p.x += v1.x;
+      p.y += v1.y;
+      if (p.x < 0 || p.x >= GRID_WIDTH || p.y < 0 || p.y >= GRID_HEIGHT)
+        break;
+    }
+    return len;
+  }
+
+  struct GCellWindows
+  {
+    std::uint16_t ids[MAX_CELL_WINDOWS] = {};
+    std::uint8_t dir_count[4] = {};
+    std::uint8_t count = 0;
+  };
+
+protected:
+  std::uint8_t m_ray[GCell::INDEX_COUNT][8] = {};
+  GWindow m_windows[WINDOW_COUNT] = {};
+  uint m_window_count = 0;
+  GCellWindows m_cell_windows[GCell::INDEX_COUNT] = {};
+  std::uint64_t m_zobrist[GCell::INDEX_COUNT][2] = {};
+};
+
+inline constexpr GGeometry geometry{};
+
+static_assert(geometry.windowCount() == GGeometry::WINDOW_COUNT);
+
+} //namespace nsg
+
+#endif
@@ -2,8 +2,7 @@
 #define GGRID_H
 
 #include "gstack.h"
-#include "gpoint.h"
-#include <list>
+#include "gcell.h"
 
 namespace nsg
 {
@@ -96,31 +95,29 @@ public:
   }
 };
 
-template <typename T, int W = GRID_WIDTH, int H = GRID_HEIGHT>
+//Данные хранятся в линейном массиве с рамкой из стен (см. GCell),
+//ячейки рамки инициализируются пустым значением
+template <typename T>
 class TGridConst
 {
 public:
 
   TGridConst()
   {
-    GPoint p{0, 0};
-    do
-    {
-      TCleaner<T>::clear(ref(p));
-    }
-    while (next(p));
+    for (auto& item: m_data)
+      TCleaner<T>::clear(item);
   }
 
   DELETE_COPY(TGridConst)
 
   static constexpr int width()
   {
-    return W;
+    return GRID_WIDTH;
   }
 
   static constexpr int height()
   {
-    return H;
+    return GRID_HEIGHT;
   }
 
   static constexpr int gridSize()
@@ -128,27 +125,38 @@ public:
     return width() * height();
   }
 
-  bool isEmptyCell(const GPoint& p) const
+  bool isEmptyCell(const GCell& cell) const
   {
-    return TEmptyChecker<T>::empty(get(p));
+    return TEmptyChecker<T>::empty(get(cell));
   }
 
-  const T& get(const GPoint& p) const
+  //Ячейки рамки также доступны для чтения
+  const T& get(const GCell& cell) const
   {
-    assert(isValidCell(p));
-    return m_data[p.x][p.y];
+    assert(isIndex(cell));
+    return m_data[cell.index];
   }
 
 protected:
-  void clearCell(const GPoint& p)
+  void clearCell(const GCell& cell)
+  {
+    TCleaner<T>::clear(ref(cell));
+  }
+
+  T& ref(const GCell& cell)
   {
-    TCleaner<T>::clear(ref(p));
+    assert(isIndex(cell));
+    return m_data[cell.index];
   }
 
-  T& ref(const GPoint& p)
+  //Заполнение рамки заданным значением
+  void setBorder(const T& value)
   {
-    assert(isValidCell(p));
-    return m_data[p.x][p.y];
+    for (int i = 0; i < GCell::INDEX_COUNT; ++i)
+    {
+      if (!GCell::fromIndex(i).isValid())
+        m_data[i] = value;
+    }
   }
 
   static bool isValidCell(const GPoint& p)
@@ -156,29 +164,62 @@ protected:
     return p.x >= 0 && p.x < width() && p.y >= 0 && p.y < height();
   }
 
-  static bool next(GPoint& p)
+  static bool isValidCell(const GCell& cell)
+  {
+    return isIndex(cell) && cell.isValid();
+  }
+
+  static bool isIndex(const GCell& cell)
   {
-    assert(isValidCell(p));
-    if (++p.x == width())
+    return cell.index >= 0 && cell.index < GCell::INDEX_COUNT;
+  }
+
+  static bool next(GCell& cell)
+  {
+    assert(isValidCell(cell));
+    if (cell.x() == width() - 1)
     {
-      if (++p.y == height())
+      if (cell.y() == height() - 1)
         return false;
-      p.x = 0;
+      //переходим через стену к началу следующей строки
+      cell += GCell::BORDER + 1;
     }
+    else
+      cell += 1;
     return true;
   }
+
 protected:
-  T m_data[width()][height()];
+  T m_data[GCell::INDEX_COUNT];
+};
+
+//Плотный массив значений по ячейкам поля с произвольным доступом
+template <typename T>
+class TGrid : public TGridConst<T>
+{
+private:
+  using Base = TGridConst<T>;
+
+public:
+  T& operator[](const GCell& cell)
+  {
+    return Base::ref(cell);
+  }
+
+  const T& operator[](const GCell& cell) const
+  {
+    return Base::get(cell);
+  }
 };
 
-template <typename T, int W = GRID_WIDTH, int H = GRID_HEIGHT>
-class TGridStack : public TGridConst<T, W, H>
+template <typename T>
+class TGridStack : public TGridConst<T>
 {
 private:
-  using Base = TGridConst<T, W, H>;
+  using Base = TGridConst<T>;
 
 protected:
-  TStack<GPoint, W * H> m_cells;
+  TStack<GCell, Base::gridSize()> m_cells;
 
 public:
 
@@ -194,23 +235,23 @@ public:
     return m_cells;
   }
 
-  const GPoint& lastCell() const
+  const GCell& lastCell() const
   {
     return cells().back();
   }
 
-  T& operator[](const GPoint& p)
+  T& operator[](const GCell& cell)
   {
-    T& data = Base::ref(p);
+    T& data = Base::ref(cell);
     if (TEmptyChecker<T>::empty(data))
-      m_cells.push() = p;
+      m_cells.push() = cell;
     return data;
   }
 
-  T& push(const GPoint& p)
+  T& push(const GCell& cell)
   {
-    m_cells.push() = p;
-    return Base::ref(p);
+    m_cells.push() = cell;
+    return Base::ref(cell);
   }
 
   void pop()
@@ -221,45 +262,69 @@ public:
   }
 };
 
-template<typename T>
-using ListIter = typename std::list<T>::iterator;
-
-//Множество точек с быстрым поиском, добавлением и удалением (хэш таблица)
-template<int W = GRID_WIDTH, int H = GRID_HEIGHT>
-class TGridSet : public TGridConst<ListIter<GPoint>, W, H>
+//Множество ячеек с быстрым поиском, добавлением и удалением.
+//Для каждой ячейки хранится ее номер в списке ячеек множества, увеличенный на 1,
+//поэтому удаление заменяет ячейку последней ячейкой списка.
+//Удаления можно отменить в обратном порядке (см. restore), и тогда порядок списка восстанавливается
+class GGridSet : public TGridConst<std::int16_t>
 {
 private:
-  using Base = TGridConst<ListIter<GPoint>, W, H>;
+  using Base = TGridConst<std::int16_t>;
+
+protected:
+  TStack<GCell, Base::gridSize()> m_cells;
 
 public:
-  const std::list<GPoint>& cells() const
+  const decltype(m_cells)& cells() const
   {
     return m_cells;
   }
 
-  void insert(const GPoint& p)
+  bool contains(const GCell& cell) const
   {
-    auto& iter = Base::ref(p);
-    //if (isEmptyItem(iter))
-    if (TEmptyChecker<ListIter<GPoint>>::empty(iter))
-    {
-      iter = m_cells.emplace(m_cells.begin());
-      (GPoint&)(*iter) = p;
-    }
+    return !Base::isEmptyCell(cell);
   }
 
-  void remove(const GPoint& p)
+  void insert(const GCell& cell)
   {
-    auto& iter = Base::ref(p);
-    //if (isEmptyItem(iter))
-    if (TEmptyChecker<ListIter<GPoint>>::empty(iter))
+    auto& pos = Base::ref(cell);
+    if (pos != 0)
       return;
-    m_cells.erase(iter);
-    TCleaner<ListIter<GPoint>>::clear(iter);
+    m_cells.push() = cell;
+    pos = std::int16_t(m_cells.size());
   }
 
-protected:
-  std::list<GPoint> m_cells;
+  //Возвращает номер удаленной ячейки в списке, увеличенный на 1 (0 - ячейки не было в множестве)
+  uint remove(const GCell& cell)
+  {
+    auto& pos = Base::ref(cell);
+    uint removed_pos = uint(pos);
+    if (pos == 0)
+      return 0;
+    const GCell& last = m_cells.back();
+    m_cells[pos - 1] = last;
+    Base::ref(last) = pos;
+    m_cells.pop();
+    pos = 0;
+    return removed_pos;
+  }
+
+  //Возвращает ячейку на место, с которого ее убрал remove (pos - результат remove)
+  void restore(const GCell& cell, uint pos)
+  {
+    assert(pos > 0 && pos <= m_cells.size() + 1 && !contains(cell));
+    if (pos <= m_cells.size())
+    {
+      //ячейка, занявшая место удаленной, возвращается в конец списка
+      GCell moved = m_cells[pos - 1];
+      m_cells.push() = moved;
+      Base::ref(moved) = std::int16_t(m_cells.size());
+      m_cells[pos - 1] = cell;
+    }
+    else
+      m_cells.push() = cell;
+    Base::ref(cell) = std::int16_t(pos);
+  }
 };
 
 } //namespace nsg
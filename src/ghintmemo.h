@@ -0,0 +1,80 @@
+#ifndef GHINTMEMO_H
+#define GHINTMEMO_H
+
+#include "gcell.h"
+#include "gdefs.h"
+#include "gint.h"
+#include <cstdint>
+#include <vector>
+
+namespace nsg
+{
+
+//Результаты проверок безопасности позиции, запоминаемые между подсказками (см. Gomoku::hint).
+//Таблица прямого отображения: запись с тем же номером вытесняет прежнюю.
+//Очистка меняет номер поколения записей, поэтому не зависит от размера таблицы.
+//Таблица выделяется при первой записи, поэтому поле без поиска ее не заполняет
+class GHintMemo
+{
+public:
+  struct GEntry
+  {
+    std::uint64_t key = 0;
+    uint generation = 0;
+    bool result = false;
+    bool long_attack_possible = false;
+    std::uint8_t variant_count = 0;
+    GCell variants[4];
+  };
+
+  explicit GHintMemo(uint size_log2 = 12) :
+    m_size_log2(size_log2)
+  {}
+
+  DELETE_COPY(GHintMemo)
+
+  //nullptr, если результата для ключа нет
+  const GEntry* find(std::uint64_t key) const
+  {
+    if (m_entries.empty())
+      return nullptr;
+    const GEntry& entry = m_entries[key & (m_entries.size() - 1)];
+    return entry.generation == m_generation && entry.key == key ? &entry : nullptr;
+  }
+
+  GEntry& insert(std::uint64_t key)
+  {
+    if (m_entries.empty())
+      m_entries.resize(std::size_t(1) << m_size_log2);
+    GEntry& entry = m_entries[key & (m_entries.size() - 1)];
+    entry = GEntry();
+    entry.key = key;
+    entry.generation = m_generation;
+    return entry;
+  }
+
+  bool isAllocated() const
+  {
+    return !m_entries.empty();
+  }
+
+  void clear()
+  {
+    if (++m_generation == 0)
+    {
+      //номера поколений исчерпаны, старые записи стираются явно
+      for (GEntry& entry: m_entries)
+        entry.generation = 0;
+      m_generation = 1;
+    }
+  }
+
+protected:
+  uint m_size_log2;
+  std::vector<GEntry> m_entries;
+  uint m_generation = 1;
+};
+
+} //namespace nsg
+
+#endif
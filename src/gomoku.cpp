@@ -1,8 +1,21 @@
 #include "gomoku.h"
+#include "gparallel.h"
+#include "gbook.h"
+#include "gpool.h"
+#include <array>
 
 namespace nsg
 {
 
+//Контексты поиска полей, удаленных в этом потоке (см. Gomoku::hint).
+//Новая партия берет готовый контекст, поэтому конструирование и initMovesWgt не повторяются для каждой партии
+static TPool<Gomoku>& searchContextPool()
+{
+  static const uint MAX_FREE_CONTEXTS = 2;
+  thread_local TPool<Gomoku> pool(MAX_FREE_CONTEXTS);
+  return pool;
+}
+
 GomokuPtr CreateGomoku()
 {
   return std::make_unique<Gomoku>();
@@ -31,13 +44,52 @@ void getNextPoint(const GLine& line, int& x, int& y)
   y += line.v1.y;
 }
 
-const GVector Gomoku::vecs1[] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}};
+static_assert(CANDIDATE_RADIUS > 0 && CANDIDATE_RADIUS <= GCell::BORDER);
+
+//Число ячеек квадратной окрестности радиуса radius без центральной ячейки
+static constexpr uint neighbourCount(uint radius)
+{
+  return (2 * radius + 1) * (2 * radius + 1) - 1;
+}
+
+//Смещения ячеек окрестности для каждого допустимого радиуса кандидатов, по строкам.
+//Окрестность не выходит за рамку поля (GCell::BORDER), поэтому смещенные ячейки лежат в массиве
+static constexpr auto neighbourhoods = []()
+{
+  std::array<std::array<GOffset, neighbourCount(GCell::BORDER)>, GCell::BORDER + 1> offsets{};
+  for (int radius = 1; radius <= GCell::BORDER; ++radius)
+  {
+    uint i = 0;
+    for (int dy = -radius; dy <= radius; ++dy)
+    {
+      for (int dx = -radius; dx <= radius; ++dx)
+      {
+        if (dx != 0 || dy != 0)
+          offsets[radius][i++] = toOffset({dx, dy});
+      }
+    }
+  }
+  return offsets;
+}();
 
 Gomoku::Gomoku() :
   m_ai_level(0),
   m_line5({-1, -1}, {0, 0})
 {
+  setBorder(G_WALL);
   initMovesWgt();
+  for (int i = 0; i < GCell::INDEX_COUNT; ++i)
+  {
+    GCell cell = GCell::fromIndex(i);
+    m_live_windows[G_BLACK][cell] = m_live_windows[G_WHITE][cell] = std::uint8_t(geometry.cellWindowCount(cell));
+  }
+}
+
+Gomoku::~Gomoku()
+{
+  //Контекст возвращается в пул потока, удаляющего поле
+  if (m_search_context)
+    searchContextPool().release(std::move(m_search_context));
 }
 
 void Gomoku::start()
@@ -67,12 +119,16 @@ bool Gomoku::doMove(const GPoint& move)
   return doMove(move.x, move.y);
 }
 
-bool Gomoku::doMove(const GPoint& move, GPlayer player)
+bool Gomoku::doMove(const GPoint& point, GPlayer player)
 {
-  if (isGameOver() || !isValidCell(move) || !isEmptyCell(move))
+  //После ничьей ходы принимаются до заполнения поля (см. isDraw)
+  if (getLine5() || !isValidCell(point) || !isEmptyCell(point))
     return false;
 
-  push(move).player = player;
+  GCell move(point);
+
+  placeStone(move, player);
+  addCandidates();
 
   if (isMove5(player, move))
     buildLine5();
@@ -86,8 +142,8 @@ bool Gomoku::undo(int& x, int& y)
 {
   if (cells().empty())
     return false;
-  x = lastCell().x;
-  y = lastCell().y;
+  x = lastCell().x();
+  y = lastCell().y();
   undoImpl();
   return true;
 }
@@ -112,20 +168,102 @@ bool Gomoku::hint(int &x, int &y)
 
 bool Gomoku::hint(int &x, int &y, GPlayer player)
 {
-  if (isGameOver())
+  if (getLine5())
+    return false;
+  //После ничьей исход уже не зависит от ходов, но ходы принимаются до заполнения поля (см. doMove),
+  //поэтому подсказывается первая свободная ячейка
+  if (isDraw())
+  {
+    for (y = 0; y < height(); ++y)
+    {
+      for (x = 0; x < width(); ++x)
+      {
+        if (isValidNextMove(x, y))
+          return true;
+      }
+    }
     return false;
+  }
 
-  //Работаем в стэке
-  Gomoku g;
-  g.copyFrom(*this);
+  //Контекст поиска берется из пула потока при первой подсказке, принадлежит партии и живет между подсказками,
+  //поэтому перед очередной подсказкой он продвигается только ходами,
+  //сделанными после предыдущей (обычно ход ии и ответ противника).
+  //Контекст из пула содержит позицию прошлой партии, copyFrom откатывает ее до общего начала
+  if (!m_search_context)
+    m_search_context = searchContextPool().acquire();
+  Gomoku* g = m_search_context.get();
+  g->m_trace = m_trace;
+  g->m_search_log = m_search_log;
+  g->setSearchThreads(m_search_threads);
+  g->setHintRace(m_hint_race);
+  g->setLazySmp(m_lazy_smp);
+  GTraceScope scope(m_trace, "hint", "moves", (int)cells().size());
+  {
+    GTraceScope scope(m_trace, "copyFrom");
+    g->copyFrom(*this);
+  }
 
-  GPoint p = g.hintImpl(player);
-  x = p.x;
-  y = p.y;
+  GSearchNode node(m_search_log, G_NODE_HINT, player, cells().size());
+  GCell p;
+  if (g->m_lazy_smp && g->m_search_threads > 1)
+  {
+    if (!g->m_lazy || g->m_lazy->threadCount() != g->m_search_threads)
+      g->m_lazy = std::make_unique<GLazySmp>(g->m_search_threads);
+    p = g->m_lazy->hint(*g, player);
+  }
+  else
+    p = g->hintImpl(player);
+  //Все уровни арены закрываются вместе с ходами в уме
+  assert(g->m_arena.empty());
+  x = p.x();
+  y = p.y();
 
   return true;
 }
 
+GHintKind Gomoku::getLastHintKind() const
+{
+  return m_search_context ? m_search_context->m_hint_kind : G_HINT_NONE;
+}
+
+bool Gomoku::hintInTime(int& x, int& y, GPlayer player, uint time_limit)
+{
+  //Время поиска с ростом уровня ии растет примерно в TIME_GROWTH раз,
+  //поэтому повышаем уровень, пока поиск следующего уровня предположительно укладывается в отведенное время
+  const uint TIME_GROWTH = 8;
+
+  uint ai_level = m_ai_level;
+  GTimer timer;
+  //Уровень, не уложившийся в срок, прерывается (см. isCancelled)
+  GDeadline deadline(time_limit);
+  m_deadline = &deadline;
+  bool result = false;
+  for (uint level = 1; level <= getMaxAiLevel(); ++level)
+  {
+    uint level_start = timer.elapsed();
+    m_ai_level = level;
+    GTraceScope scope(m_trace, "hintLevel", "level", level);
+    int level_x, level_y;
+    if (!hint(level_x, level_y, player))
+      break;
+    //Ход прерванного уровня берется, только если не завершился ни один уровень
+    if (deadline.tripped() && result)
+      break;
+    x = level_x;
+    y = level_y;
+    result = true;
+    if (deadline.tripped())
+      break;
+    //Время уровня меньше миллисекунды считается равным миллисекунде
+    uint level_time = std::max(timer.elapsed() - level_start, 1u);
+    if (timer.elapsed() + level_time * TIME_GROWTH > time_limit)
+      break;
+  }
+  m_deadline = nullptr;
+  m_ai_level = ai_level;
+  return result;
+}
+
 uint Gomoku::getAiLevel() const
 {
   return m_ai_level;
@@ -133,24 +271,167 @@ uint Gomoku::getAiLevel() const
 
 void Gomoku::setAiLevel(uint ai_level)
 {
-  m_ai_level = (ai_level > getMaxAiLevel()) ? getMaxAiLevel() : ai_level;
+  ai_level = (ai_level > getMaxAiLevel()) ? getMaxAiLevel() : ai_level;
+  if (ai_level != m_ai_level)
+    m_memo.clear();
+  m_ai_level = ai_level;
 }
 
 uint Gomoku::getMoveCount(GPlayer player)
 {
   uint count = 0;
-  for (const GPoint& move: cells())
+  for (const GCell& move: cells())
   {
-    if (get(move).player == player)
+    if (get(move) == player)
       ++count;
   }
   return count;
 }
 
-GPoint Gomoku::hintImpl(GPlayer player)
+bool Gomoku::setMoves(const std::vector<GPoint>& moves)
+{
+  uint common = 0;
+  for (; common < cells().size() && common < moves.size(); ++common)
+  {
+    const GCell& move = cells()[common];
+    if (move != GCell(moves[common]) || get(move) != GPlayer(common % 2))
+      break;
+  }
+  while (cells().size() > common)
+    undo();
+  for (; common < moves.size(); ++common)
+  {
+    if (!doMove(moves[common], GPlayer(common % 2)))
+      return false;
+  }
+  return true;
+}
+
+const GWeights& Gomoku::getWeights() const
+{
+  return m_weights;
+}
+
+void Gomoku::setWeights(const GWeights& weights)
+{
+  assert(weights.isValid());
+
+  //Веса ходов накоплены по старым весам линий, поэтому партия переигрывается с начального поля
+  std::vector<std::pair<GPoint, GPlayer>> moves;
+  takeMoves(moves);
+  m_weights = weights;
+  m_memo.clear();
+  initMovesWgt();
+  replayMoves(moves);
+}
+
+uint Gomoku::getCandidateRadius() const
+{
+  return m_candidate_radius;
+}
+
+void Gomoku::setCandidateRadius(uint radius)
+{
+  assert(radius > 0 && radius <= GCell::BORDER);
+
+  //Счетчики соседей накоплены по старой окрестности, поэтому партия переигрывается с начального поля
+  std::vector<std::pair<GPoint, GPlayer>> moves;
+  takeMoves(moves);
+  m_candidate_radius = radius;
+  replayMoves(moves);
+}
+
+void Gomoku::takeMoves(std::vector<std::pair<GPoint, GPlayer>>& moves)
+{
+  moves.clear();
+  for (const GCell& move: cells())
+    moves.emplace_back(move.point(), get(move));
+  start();
+  //Порядок вариантов зависит от весов и кандидатов
+  for (GSortedVariants& sorted: m_sorted_variants)
+    sorted.valid = false;
+}
+
+void Gomoku::replayMoves(const std::vector<std::pair<GPoint, GPlayer>>& moves)
+{
+  for (const auto& [move, player]: moves)
+    doMove(move, player);
+}
+
+void Gomoku::setTrace(GTrace* trace)
+{
+  m_trace = trace;
+}
+
+void Gomoku::setSearchLog(GSearchLog* log)
+{
+  m_search_log = log;
+}
+
+void Gomoku::setSearchThreads(uint thread_count)
+{
+  m_search_threads = std::max(thread_count, 1u);
+  if (m_parallel && m_parallel->threadCount() != m_search_threads)
+    m_parallel.reset();
+}
+
+void Gomoku::setHintRace(bool race)
+{
+  m_hint_race = race;
+}
+
+void Gomoku::setLazySmp(bool lazy_smp)
+{
+  m_lazy_smp = lazy_smp;
+}
+
+void Gomoku::setBook(const GBook* book)
+{
+  m_book = book;
+}
+
+void Gomoku::getBestVariants(GPlayer player, uint count, std::vector<GPoint>& variants)
+{
+  variants.clear();
+  if (count == 0 || m_candidates.cells().empty())
+    return;
+  GVariantsIndex& variants_index = m_variants_index[player];
+  sortMaxN(player, variants_index, count);
+  for (uint i = 0; i < count && i < variants_index.size(); ++i)
+    variants.push_back(variants_index[i].point());
+}
+
+GCell Gomoku::hintImpl(GPlayer player)
 {
   assert(!isGameOver());
 
+  //Этапы подбора хода для журнала (см. GTrace)
+  GTracePhase phase(m_trace);
+
+  GCell move;
+
+  //Финальный ход
+  m_hint_kind = G_HINT_MOVE5;
+  phase.next("hintMove5");
+  if (hintMove5(player, move))
+    return move;
+
+  //Блокировка финального хода противника
+  m_hint_kind = G_HINT_BLOCK5;
+  phase.next("hintBlock5");
+  if (hintBlock5(player, move))
+    return move;
+
+  //Ход книги заменяет и алгоритмы первых ходов, но не финальный ход и не блокировку:
+  //ключ другой позиции может случайно совпасть с ключом позиции книги
+  m_hint_kind = G_HINT_BOOK;
+  phase.next("book");
+  if (hintBook(player, move))
+    return move;
+
+  m_hint_kind = G_HINT_OPENING;
+  phase.next("opening");
+
   //Первый ход (Х)
   if (cells().empty())
     return {width() / 2, height() / 2};
@@ -167,82 +448,83 @@ GPoint Gomoku::hintImpl(GPlayer player)
   if (cells().size() == 3 && getMoveCount(player) == 1)
     return hintForthMove(player);
 
-  GPoint move;
-
-  //Финальный ход
-  if (hintMove5(player, move))
-    return move;
-
-  //Блокировка финального хода противника
-  if (hintBlock5(player, move))
-    return move;
+  //Рассматриваем варианты от большего веса к меньшему.
+  //Соседние варианты случайно переставляются заранее, чтобы позиционный этап мог выполняться одновременно с поиском атаки
+  phase.next("sortVariants");
+  GVariantsIndex& p_variants_index = m_variants_index[player];
+  sortVariantsByWgt(player, p_variants_index);
+  GCell* variant = p_variants_index.begin();
+  const GCell* end = p_variants_index.begin() + std::min(m_weights.variants, p_variants_index.size());
+  for (; randomFromTwo(p_variants_index, variant, end); ++variant);
+  const GCell* defense_end = variant;
 
-  for (uint depth = 0; depth <= maxAttackDepth(); ++depth)
+  if (m_hint_race)
   {
-    if (findVictoryMove4Chain(player, depth, nullptr, &move))
+    //Этапы до позиционного включительно выполняются одновременно, m_hint_kind устанавливается по выбранному этапу
+    phase.next("race");
+    if (!m_race)
+      m_race = std::make_unique<GPhaseRace>();
+    if (m_race->run(*this, player, p_variants_index.begin(), defense_end, move))
       return move;
-    if (!m_long_attack_possible)
-      break;
   }
-
-  for (uint depth = 0; depth <= maxAttackDepth(); ++depth)
+  else
   {
-    if (findVictoryAttack(player, depth, &move))
+    m_hint_kind = G_HINT_VICTORY_MOVE4_CHAIN;
+    phase.next("victoryMove4Chain");
+    if (hintVictoryMove4Chain(player, move))
       return move;
-    if (!m_long_attack_possible)
-      break;
-  }
 
-  if (m_long_attack_possible && findLongAttack(player, maxAttackDepth(), &move))
-    return move;
+    m_hint_kind = G_HINT_VICTORY_ATTACK;
+    phase.next("victoryAttack");
+    if (hintVictoryAttack(player, move))
+      return move;
 
-  //Рассматриваем варианты от большего веса к меньшему
-  GVariantsIndex& p_variants_index = m_variants_index[player];
-  sortVariantsByWgt(player, p_variants_index);
+    m_hint_kind = G_HINT_LONG_ATTACK;
+    phase.next("longAttack");
+    if (m_long_attack_possible && hintLongAttack(player, move))
+      return move;
 
-  GPoint defense_variant{-1, -1};
-  //Ищем вариант с максимальным весом,
-  //в ответ на который противник не сможет провести выигрышную или длинную атаку,
-  //а с другой стороны игрок может продолжить его своей выигрышной атакой
-  GPoint* variant = p_variants_index.begin();
-  const GPoint* end = p_variants_index.begin() + 60;
-  for (; randomFromTwo(p_variants_index, variant, end); ++variant)
+    m_hint_kind = G_HINT_POSITIONAL;
+    phase.next("defenseVariants");
+    move = hintDefenseVariant(player, p_variants_index.begin(), defense_end);
+    if (isValidCell(move))
+      return move;
+  }
+
+  //Запасные стратегии перебирают одни и те же варианты, поэтому вариант классифицируется один раз,
+  //при первом обращении к нему
+  GStackArenaScope arena_scope(m_arena);
+  std::vector<GVariantInfo, TStackAllocator<GVariantInfo>> variant_info(p_variants_index.size(),
+                                                                       TStackAllocator<GVariantInfo>(m_arena));
+  auto classify = [this, player, &p_variants_index, &variant_info](const GCell* variant) -> const GVariantInfo&
   {
-    //Шахи и полушахи проверены выше - они не результативны с точки зрения атаки
-    if (isDangerMove4(player, *variant) || isDangerOpen3(player, *variant))
-      continue;
-    GMoveMaker gmm(this, player, *variant);
-    if (findLongAttack(!player, maxAttackDepth()))
-      continue;
-    if (findLongAttack(player, maxAttackDepth()))
-    {
-      assert(variant - p_variants_index.begin() < 50);
-      return *variant;
-    }
-    if (!isValidCell(defense_variant))
+    GVariantInfo& info = variant_info[uint(variant - p_variants_index.begin())];
+    if (!info.known)
     {
-      assert(variant - p_variants_index.begin() < 50);
-      defense_variant = *variant;
+      info.known = true;
+      info.shah = isDangerMove4(player, *variant);
+      if (!info.shah)
+      {
+        GMoveMaker gmm(this, player, *variant);
+        info.open3 = isDangerOpen3(&info.blocks);
+      }
     }
-  }
-
-  //Возвращаем ход, позволяющий избежать длинной атаки противника
-  if (isValidCell(defense_variant))
-    return defense_variant;
+    return info;
+  };
 
-  GStack<gridSize()> blocks;
+  m_hint_kind = G_HINT_BLOCK_THREAT;
+  phase.next("blockOpen3");
   //Ищем полушах с максимальным весом (кроме шахов) такой,
   //чтобы он блокировал существующую угрозу противника,
   //и ни один из защитных ходов противника не создавал новую угрозу
-  for (const GPoint* variant = &p_variants_index[0]; isEmptyCell(*variant); ++variant)
+  for (const GCell* variant = p_variants_index.begin(); variant != p_variants_index.end(); ++variant)
   {
-    if (isDangerMove4(player, *variant))
+    const GVariantInfo& info = classify(variant);
+    if (!info.open3)
       continue;
     GMoveMaker gmm(this, player, *variant);
-    if (!isDangerOpen3(&blocks))
-      continue;
-    const GPoint* block;
-    for (block = blocks.begin(); block != blocks.end(); ++block)
+    const GCell* block;
+    for (block = info.blocks.begin(); block != info.blocks.end(); ++block)
     {
       GMoveMaker gmm(this, !player, *block);
       //Блокировка может быть контршахом
@@ -256,16 +538,17 @@ GPoint Gomoku::hintImpl(GPlayer player)
       else if (findLongAttack(!player, maxAttackDepth()))
         break;
     }
-    if (block == blocks.end()) //ни один из блоков не дает преимущество противнику
+    if (block == info.blocks.end()) //ни один из блоков не дает преимущество противнику
       return *variant;
   }
 
   //Ищем шах с максимальным весом такой,
   //чтобы он блокировал существующую угрозу противника,
   //а ответный защитный ход противника не создавал новую угрозу
-  for (const GPoint* variant = &p_variants_index[0]; isEmptyCell(*variant); ++variant)
+  phase.next("blockShah");
+  for (const GCell* variant = p_variants_index.begin(); variant != p_variants_index.end(); ++variant)
   {
-    if (!isDangerMove4(player, *variant))
+    if (!classify(variant).shah)
       continue;
 
     GMoveMaker gmm(this, player, *variant);
@@ -286,21 +569,21 @@ GPoint Gomoku::hintImpl(GPlayer player)
 
   //Ищем полушах такой, чтобы противник не смог следующим ходом начать
   //длинную или выигрышную атаку
-  for (const GPoint* variant = &p_variants_index[0]; isEmptyCell(*variant); ++variant)
+  phase.next("safeOpen3");
+  for (const GCell* variant = p_variants_index.begin(); variant != p_variants_index.end(); ++variant)
   {
-    if (isDangerMove4(player, *variant))
+    if (!classify(variant).open3)
       continue;
     GMoveMaker gmm(this, player, *variant);
-    if (!isDangerOpen3())
-      continue;
     if (!findLongAttack(!player, maxAttackDepth()))
       return *variant;
   }
 
   //Ищем шах такой, чтобы блокирующий ход противника не мог начать выигрышную атаку
-  for (const GPoint* variant = &p_variants_index[0]; isEmptyCell(*variant); ++variant)
+  phase.next("safeShah");
+  for (const GCell* variant = p_variants_index.begin(); variant != p_variants_index.end(); ++variant)
   {
-    if (!isDangerMove4(player, *variant))
+    if (!classify(variant).shah)
       continue;
     GMoveMaker gmm(this, player, *variant);
     if (!findLongAttack(!player, m_moves5[player].lastCell(), maxAttackDepth()))
@@ -308,11 +591,13 @@ GPoint Gomoku::hintImpl(GPlayer player)
   }
 
   //Ищем вариант, который позволяет максимально затянуть выигрышную атаку противника
+  m_hint_kind = G_HINT_DELAY_DEFEAT;
+  phase.next("delayDefeat");
   uint max_min_defeat_depth = 0;
-  defense_variant = p_variants_index[0];
+  GCell defense_variant = p_variants_index[0];
   for (variant = p_variants_index.begin(); variant != end && isEmptyCell(*variant); ++variant)
   {
-    bool shah = isDangerMove4(player, *variant);
+    bool shah = classify(variant).shah;
     GMoveMaker gmm(this, player, *variant);
     uint depth;
     for (depth = max_min_defeat_depth; depth <= maxAttackDepth(); ++depth)
@@ -327,7 +612,6 @@ GPoint Gomoku::hintImpl(GPlayer player)
       return *variant;
     if (depth > max_min_defeat_depth)
     {
-      assert(variant - p_variants_index.begin() < 50);
       max_min_defeat_depth = depth;
       defense_variant = *variant;
     }
@@ -336,11 +620,22 @@ GPoint Gomoku::hintImpl(GPlayer player)
   return defense_variant;
 }
 
-GPoint Gomoku::hintSecondMove() const
+bool Gomoku::hintBook(GPlayer player, GCell& move) const
+{
+  if (!m_book || cells().size() > m_book->maxPly())
+    return false;
+  GBookPosition position;
+  for (const GCell& cell: cells())
+    position.add(cell, get(cell));
+  //Ключ другой позиции может случайно совпасть с ключом позиции книги, поэтому ход проверяется
+  return m_book->hint(position, player, m_ai_level, move) && isEmptyCell(move);
+}
+
+GCell Gomoku::hintSecondMove() const
 {
   assert(cells().size() == 1);
 
-  const GPoint& first_move = cells()[0];
+  const GPoint first_move = cells()[0].point();
 
   GPoint center{width() / 2, height() / 2};
 
@@ -370,24 +665,24 @@ GPoint Gomoku::hintSecondMove() const
   return res;
 }
 
-GPoint Gomoku::hintThirdMove(GPlayer player)
+GCell Gomoku::hintThirdMove(GPlayer player)
 {
   //Случайно выбираем из ходов с максимальным хранимым весом
   GVariantsIndex& p_variants_index = m_variants_index[player];
   sortVariantsByWgt(player, p_variants_index);
 
-  int max_wgt = get(p_variants_index[0]).wgt[player];
+  int max_wgt = m_wgt[player][p_variants_index[0]];
   uint max_wgt_count;
-  for (max_wgt_count = 1; max_wgt_count <= gridSize(); ++max_wgt_count)
+  for (max_wgt_count = 1; max_wgt_count < p_variants_index.size(); ++max_wgt_count)
   {
-    int wgt = get(p_variants_index[max_wgt_count]).wgt[player];
+    int wgt = m_wgt[player][p_variants_index[max_wgt_count]];
     if (wgt < max_wgt)
       break;
   }
   return  p_variants_index[(uint)random(0, max_wgt_count)];
 }
 
-GPoint Gomoku::hintForthMove(GPlayer player)
+GCell Gomoku::hintForthMove(GPlayer player)
 {
   //Этот алгоритм должен работать при нормальной игре,
   //когда заданный игрок уже сделал один ход, а противник два
@@ -440,8 +735,10 @@ GPoint Gomoku::hintForthMove(GPlayer player)
   return vi.best();
 }
 
-bool Gomoku::hintMove5(GPlayer player, GPoint &point) const
+bool Gomoku::hintMove5(GPlayer player, GCell &point) const
 {
+  if (m_open_moves5[player] == 0)
+    return false;
   const auto& line5Moves = m_moves5[player].cells();
   for (const auto& move: line5Moves)
   {
@@ -453,27 +750,86 @@ bool Gomoku::hintMove5(GPlayer player, GPoint &point) const
   return false;
 }
 
-bool Gomoku::hintBlock5(GPlayer player, GPoint &point) const
+bool Gomoku::hintBlock5(GPlayer player, GCell &point) const
 {
   return hintMove5(!player, point);
 }
 
-bool Gomoku::findVictoryMove4Chain(GPlayer player, uint depth, GBaseStack* defense_variants, GPoint* victory_move)
+bool Gomoku::hintVictoryMove4Chain(GPlayer player, GCell& move)
+{
+  //Потоки ленивого параллельного поиска начинают с разной глубины
+  for (uint depth = std::min(m_search_order % 2, maxAttackDepth()); depth <= maxAttackDepth(); ++depth)
+  {
+    GTraceScope scope(m_trace, "findVictoryMove4Chain", "depth", depth);
+    if (findVictoryMove4Chain(player, depth, nullptr, &move))
+      return true;
+    if (!m_long_attack_possible)
+      break;
+  }
+  return false;
+}
+
+bool Gomoku::hintVictoryAttack(GPlayer player, GCell& move)
+{
+  for (uint depth = std::min(m_search_order % 2, maxAttackDepth()); depth <= maxAttackDepth(); ++depth)
+  {
+    GTraceScope scope(m_trace, "findVictoryAttack", "depth", depth);
+    if (findVictoryAttack(player, depth, &move))
+      return true;
+    if (!m_long_attack_possible)
+      break;
+  }
+  return false;
+}
+
+bool Gomoku::hintLongAttack(GPlayer player, GCell& move)
+{
+  return findLongAttack(player, maxAttackDepth(), &move);
+}
+
+GCell Gomoku::hintDefenseVariant(GPlayer player, const GCell* begin, const GCell* end)
+{
+  GCell defense_variant{-1, -1};
+  //Ищем вариант с максимальным весом,
+  //в ответ на который противник не сможет провести выигрышную или длинную атаку,
+  //а с другой стороны игрок может продолжить его своей выигрышной атакой
+  for (const GCell* variant = begin; variant != end; ++variant)
+  {
+    //Прерванный поиск не проверяет атаки, поэтому дальнейший перебор ничего не уточнит
+    if (isValidCell(defense_variant) && isCancelled())
+      break;
+    //Шахи и полушахи проверены на этапах атаки - они не результативны с точки зрения атаки
+    if (isDangerMove4(player, *variant) || isDangerOpen3(player, *variant))
+      continue;
+    GMoveMaker gmm(this, player, *variant);
+    if (findLongAttack(!player, maxAttackDepth()))
+      continue;
+    if (findLongAttack(player, maxAttackDepth()))
+      return *variant;
+    if (!isValidCell(defense_variant))
+      defense_variant = *variant;
+  }
+  //Ход, позволяющий избежать длинной атаки противника
+  return defense_variant;
+}
+
+bool Gomoku::findVictoryMove4Chain(GPlayer player, uint depth, GBaseStack* defense_variants, GCell* victory_move)
 {
   m_long_attack_possible = false;
   return findVictoryMove4Chain(player, dangerMoves(player).cells(), depth, defense_variants, victory_move);
 }
 
-bool Gomoku::completeVictoryMove4Chain(GPlayer player, uint depth, GBaseStack* defense_variants, GPoint* victory_move)
+bool Gomoku::completeVictoryMove4Chain(GPlayer player, uint depth, GBaseStack* defense_variants, GCell* victory_move)
 {
-  GStack<32> chain_moves;
+  GStackArenaScope scope(m_arena);
+  GArenaStack chain_moves;
   getChainMoves(chain_moves);
   return findVictoryMove4Chain(player, chain_moves, depth, defense_variants, victory_move);
 }
 
-bool Gomoku::findVictoryMove4Chain(GPlayer player, const GBaseStack &variants, uint depth, GBaseStack *defense_variants, GPoint *victory_move)
+bool Gomoku::findVictoryMove4Chain(GPlayer player, const GBaseStack &variants, uint depth, GBaseStack *defense_variants, GCell *victory_move)
 {
-  for (const GPoint* attack_move = variants.end(); attack_move != variants.begin();)
+  for (const GCell* attack_move = variants.end(); attack_move != variants.begin();)
   {
     --attack_move;
 
@@ -487,25 +843,16 @@ bool Gomoku::findVictoryMove4Chain(GPlayer player, const GBaseStack &variants, u
   return false;
 }
 
-bool Gomoku::findVictoryMove4Chain(GPlayer player, const GPoint& move4, uint depth, GBaseStack* defense_variants)
+bool Gomoku::findVictoryMove4Chain(GPlayer player, const GCell& move4, uint depth, GBaseStack* defense_variants)
 {
+  GSearchNode node(m_search_log, G_NODE_MOVE4_CHAIN, player, depth, move4);
   if (!isEmptyCell(move4))
-    return false;
+    return node.exit(false);
   const auto& move4_data = dangerMoves(player).get(move4);
-  const auto& moves5 = move4_data.m_moves5;
-  uint move5_count = 0;
-  uint move5_pair[2];
-  for (uint i = 0; i < moves5.size(); ++i)
-  {
-    if (!isEmptyCell(moves5[i]))
-      continue;
-    if (++move5_count > 2)
-      break;
-    move5_pair[move5_count - 1] = i;
-  }
+  const uint move5_count = move4_data.m_open_moves5;
   if (move5_count == 0)
     //Все дополнения до линии 5 заблокированы
-    return false;
+    return node.exit(false);
   if (move5_count >= 2)
   {
     //вилка 4х4 (выигрыш)
@@ -517,22 +864,32 @@ bool Gomoku::findVictoryMove4Chain(GPlayer player, const GPoint& move4, uint dep
       //Иначе ни одно из них не может быть блокирующим ходом
       if (move5_count == 2)
       {
+        //Незанятые завершения нужны только здесь, поэтому ищутся перебором
+        const auto& moves5 = move4_data.m_moves5;
+        GCell move5_pair[2];
+        uint pair_count = 0;
+        for (uint i = 0; i < moves5.size() && pair_count < 2; ++i)
+        {
+          if (isEmptyCell(moves5[i]))
+            move5_pair[pair_count++] = moves5[i];
+        }
+        assert(pair_count == 2);
         //В случае 1хХхх2 ходы 1 и 2 являются защитными
         //В случае 1хххХ2 ход 2 не является защитным
-        if (isMate(player, moves5[move5_pair[0]]))
-          defense_variants->push() = moves5[move5_pair[0]];
-        else if (isMate(player, moves5[move5_pair[1]]))
-          defense_variants->push() = moves5[move5_pair[1]];
+        if (isMate(player, move5_pair[0]))
+          defense_variants->push() = move5_pair[0];
+        else if (isMate(player, move5_pair[1]))
+          defense_variants->push() = move5_pair[1];
         else
         {
-          defense_variants->push() = moves5[move5_pair[0]];
-          defense_variants->push() = moves5[move5_pair[1]];
+          defense_variants->push() = move5_pair[0];
+          defense_variants->push() = move5_pair[1];
         }
       }
       //Исходный шах в любом случае может быть блокирующим ходом
       defense_variants->push() = move4;
     }
-    return true;
+    return node.exit(true);
   }
 
   if (depth == 0)
@@ -541,7 +898,7 @@ bool Gomoku::findVictoryMove4Chain(GPlayer player, const GPoint& move4, uint dep
   {
     GMoveMaker gmm(this, player, move4);
 
-    const GPoint& enemy_block = m_moves5[player].lastCell();
+    const GCell& enemy_block = m_moves5[player].lastCell();
     if (isDefeatBlock5(!player, enemy_block, depth, defense_variants))
     {
       if (defense_variants)
@@ -549,20 +906,20 @@ bool Gomoku::findVictoryMove4Chain(GPlayer player, const GPoint& move4, uint dep
         //Как сам шах, так и ответ на него может быть блокирующим ходом
         defense_variants->push() = move4;
       }
-      return true;
+      return node.exit(true);
     }
   }
 
-  return false;
+  return node.exit(false);
 }
 
-bool Gomoku::isDefeatBlock5(GPlayer player, const GPoint &block, uint depth, GBaseStack *defense_variants)
+bool Gomoku::isDefeatBlock5(GPlayer player, const GCell &block, uint depth, GBaseStack *defense_variants)
 {
   assert(isEmptyCell(block));
   assert(depth > 0);
 
   GMoveMaker gmm(this, player, block);
-  const auto& block_data = get(block);
+  const auto& block_data = backup(block);
 
   if (block_data.m_moves5_count > 1)
     //Блокирующий ход реализует вилку 4х4, поэтому является выигрышным
@@ -573,7 +930,7 @@ bool Gomoku::isDefeatBlock5(GPlayer player, const GPoint &block, uint depth, GBa
   if (block_data.m_moves5_count == 1)
   {
     //Блокирующий ход является контршахом
-    const GPoint& enemy_move = m_moves5[player].lastCell();
+    const GCell& enemy_move = m_moves5[player].lastCell();
     //Блокирующий ход противника тоже может быть контршахом,
     //в этом случае имеем возможность продолжить цепочку шахов противника
     is_victory_enemy_move4 = findVictoryMove4Chain(!player, enemy_move, depth - 1, defense_variants);
@@ -591,9 +948,9 @@ bool Gomoku::isDefeatBlock5(GPlayer player, const GPoint &block, uint depth, GBa
     //поскольку противник будет вынужден блокировать контршах вместо продолжения атаки
     for (uint i = 0; i < block_data.m_moves4.size(); )
     {
-      const GPoint& move1 = block_data.m_moves4[i++];
+      const GCell& move1 = block_data.m_moves4[i++];
       assert(i < block_data.m_moves4.size());
-      const GPoint& move2 = block_data.m_moves4[i++];
+      const GCell& move2 = block_data.m_moves4[i++];
       assert(isEmptyCell(move1) && isEmptyCell(move2));
       //Если один из ходов пары является ходом 5,
       //значит блокирующий ход уже является контршахом,
@@ -615,12 +972,19 @@ bool Gomoku::isDefeatBlock5(GPlayer player, const GPoint &block, uint depth, GBa
 
 bool Gomoku::findLongOrVictoryMove4Chain(GPlayer player, uint depth)
 {
-  return findLongOrVictoryMove4Chain(player, dangerMoves(player).cells(), depth);
+  //Результат зависит только от позиции, игрока и глубины
+  std::uint64_t key = memoKey(G_MEMO_LONG_CHAIN, player << 8 | depth);
+  if (const GHintMemo::GEntry* entry = m_memo.find(key))
+    return entry->result;
+  bool result = findLongOrVictoryMove4Chain(player, dangerMoves(player).cells(), depth);
+  m_memo.insert(key).result = result;
+  return result;
 }
 
 bool Gomoku::completeLongOrVictoryMove4Chain(GPlayer player, uint depth)
 {
-  GStack<32> chain_moves;
+  GStackArenaScope scope(m_arena);
+  GArenaStack chain_moves;
   getChainMoves(chain_moves);
   return findLongOrVictoryMove4Chain(player, chain_moves, depth);
 }
@@ -628,7 +992,7 @@ bool Gomoku::completeLongOrVictoryMove4Chain(GPlayer player, uint depth)
 bool Gomoku::findLongOrVictoryMove4Chain(GPlayer player, const GBaseStack &variants, uint depth)
 {
   //for (const auto& move4: variants)
-  for (const GPoint* move4 = variants.end(); move4 != variants.begin();)
+  for (const GCell* move4 = variants.end(); move4 != variants.begin();)
   {
     --move4;
     if (findLongOrVictoryMove4Chain(player, *move4, depth))
@@ -637,35 +1001,29 @@ bool Gomoku::findLongOrVictoryMove4Chain(GPlayer player, const GBaseStack &varia
   return false;
 }
 
-bool Gomoku::findLongOrVictoryMove4Chain(GPlayer player, const GPoint& move4, uint depth)
+bool Gomoku::findLongOrVictoryMove4Chain(GPlayer player, const GCell& move4, uint depth)
 {
+  GSearchNode node(m_search_log, G_NODE_LONG_MOVE4_CHAIN, player, depth, move4);
   if (!isEmptyCell(move4))
-    return false;
-  const auto& move4_data = dangerMoves(player).get(move4);
-  const auto& moves5 = move4_data.m_moves5;
-  uint move5_count = 0;
-  for (uint i = 0; i < moves5.size(); ++i)
-  {
-    if (!isEmptyCell(moves5[i]))
-      continue;
-    if (++move5_count == 2)
-      return true;
-  }
+    return node.exit(false);
+  const uint move5_count = dangerMoves(player).get(move4).m_open_moves5;
+  if (move5_count >= 2)
+    return node.exit(true);
   if (move5_count == 0)
-    return false;
+    return node.exit(false);
   if (depth == 0) //длинная цепочка
-    return true;
+    return node.exit(true);
   GMoveMaker gmm(this, player, move4);
-  const GPoint& enemy_block = m_moves5[player].lastCell();
-  return isLongOrDefeatBlock5(!player, enemy_block, depth);
+  const GCell& enemy_block = m_moves5[player].lastCell();
+  return node.exit(isLongOrDefeatBlock5(!player, enemy_block, depth));
 }
 
-bool Gomoku::isLongOrDefeatBlock5(GPlayer player, const GPoint &block, uint depth)
+bool Gomoku::isLongOrDefeatBlock5(GPlayer player, const GCell &block, uint depth)
 {
   assert(isEmptyCell(block));
   assert(depth > 0);
   GMoveMaker gmm(this, player, block);
-  const auto& block_data = get(block);
+  const auto& block_data = backup(block);
   if (block_data.m_moves5_count > 1)
     //Блокирующий ход реализует вилку 4х4, поэтому является выигрышным
     return false;
@@ -673,7 +1031,7 @@ bool Gomoku::isLongOrDefeatBlock5(GPlayer player, const GPoint &block, uint dept
   if (block_data.m_moves5_count == 1)
   {
     //Блокирующий ход является контршахом
-    const GPoint& enemy_move = m_moves5[player].lastCell();
+    const GCell& enemy_move = m_moves5[player].lastCell();
     //Блокирующий ход противника тоже может быть контршахом,
     //в этом случае имеем возможность продолжить цепочку шахов противника
     return findLongOrVictoryMove4Chain(!player, enemy_move, depth - 1);
@@ -682,245 +1040,604 @@ bool Gomoku::isLongOrDefeatBlock5(GPlayer player, const GPoint &block, uint dept
     return completeLongOrVictoryMove4Chain(!player, depth - 1);
 }
 
-bool Gomoku::findVictoryAttack(GPlayer player, uint depth, GPoint *victory_move)
+bool Gomoku::findVictoryAttack(GPlayer player, uint depth, GCell *victory_move)
 {
   m_long_attack_possible = false;
+  if (m_search_threads > 1 && !m_lazy_smp)
+  {
+    if (!m_parallel)
+      m_parallel = std::make_unique<GParallelSearch>(m_search_threads);
+    return m_parallel->findVictoryAttack(*this, player, dangerMoves(player).cells(), depth, victory_move, m_long_attack_possible);
+  }
   return findVictoryAttack(player, dangerMoves(player).cells(), depth, victory_move);
 }
 
-bool Gomoku::findVictoryAttack(GPlayer player, const GBaseStack &attack_moves, uint depth, GPoint* victory_move)
+bool Gomoku::findVictoryAttack(GPlayer player, const GBaseStack &attack_moves, uint depth, GCell* victory_move)
 {
-  //Сначала рассматриваем шахи, поскольку выигрышная цепочка шахов гарантирует выигрыш
-  for (const GPoint* attack_move = attack_moves.end(); attack_move != attack_moves.begin(); )
+  GAttackSearch search(this);
+  search.startVictoryAttack(player, attack_moves, depth);
+  if (!search.run())
+    return false;
+  if (victory_move)
+    *victory_move = search.move();
+  return true;
+}
+
+bool Gomoku::isVictoryMove(GPlayer player, const GCell &move, uint depth)
+{
+  return isVictoryMove4(player, move, depth) || isNearVictoryOpen3(player, move, depth);
+}
+
+bool Gomoku::isVictoryMove4(GPlayer player, const GCell &move, uint depth)
+{
+  GAttackSearch search(this);
+  search.startVictoryMove4(player, move, depth);
+  return search.run();
+}
+
+bool Gomoku::isNearVictoryOpen3(GPlayer player, const GCell &move, uint depth)
+{
+  GAttackSearch search(this);
+  search.startNearVictoryOpen3(player, move, depth);
+  return search.run();
+}
+
+bool Gomoku::isDefeatMove(GPlayer player, const GCell& move, uint depth)
+{
+  GAttackSearch search(this);
+  search.startDefeatMove(player, move, depth);
+  return search.run();
+}
+
+bool Gomoku::findLongAttack(GPlayer player, uint depth, GCell *move)
+{
+  if (m_search_threads > 1 && !m_lazy_smp)
   {
-    --attack_move;
-    if (isVictoryMove4(player, *attack_move, depth))
-    {
-      if (victory_move)
-        *victory_move = *attack_move;
-      return true;
-    }
+    if (!m_parallel)
+      m_parallel = std::make_unique<GParallelSearch>(m_search_threads);
+    return m_parallel->findLongAttack(*this, player, dangerMoves(player).cells(), depth, move);
   }
+  return findLongAttack(player, dangerMoves(player).cells(), depth, move);
+}
 
-  //На глубине 0 открытые тройки не рассматриваются,
-  //поскольку на глубине 0 нас интересует мат в один ход
-  if (depth == 0)
-  {
-    m_long_attack_possible = true;
+bool Gomoku::findLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth, GCell* move)
+{
+  GAttackSearch search(this);
+  search.startLongAttack(player, attack_moves, depth);
+  if (!search.run())
     return false;
+  if (move)
+    *move = search.move();
+  return true;
+}
+
+bool Gomoku::findLongAttack(GPlayer player, const GCell& move, uint depth)
+{
+  GAttackSearch search(this);
+  search.startLongAttack(player, move, depth);
+  return search.run();
+}
+
+void Gomoku::GAttackSearch::startVictoryAttack(GPlayer player, uint depth)
+{
+  //Признак возможной длинной атаки устанавливает поиск (см. findVictoryAttack)
+  m_g->m_long_attack_possible = false;
+  startVictoryAttack(player, m_g->dangerMoves(player).cells(), depth);
+}
+
+void Gomoku::GAttackSearch::startLongAttack(GPlayer player, uint depth)
+{
+  startLongAttack(player, m_g->dangerMoves(player).cells(), depth);
+}
+
+void Gomoku::GAttackSearch::startVictoryAttack(GPlayer player, const GBaseStack& attack_moves, uint depth)
+{
+  cancel();
+  GFrame& frame = push(G_VICTORY_LIST, player, depth);
+  frame.list = &attack_moves;
+}
+
+void Gomoku::GAttackSearch::startVictoryMove4(GPlayer player, const GCell& move, uint depth)
+{
+  cancel();
+  push(G_VICTORY_MOVE4, player, depth, move);
+}
+
+void Gomoku::GAttackSearch::startNearVictoryOpen3(GPlayer player, const GCell& move, uint depth)
+{
+  cancel();
+  push(G_VICTORY_OPEN3, player, depth, move);
+}
+
+void Gomoku::GAttackSearch::startDefeatMove(GPlayer player, const GCell& move, uint depth)
+{
+  cancel();
+  push(G_DEFEAT, player, depth, move);
+}
+
+void Gomoku::GAttackSearch::startLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth)
+{
+  cancel();
+  GFrame& frame = push(G_ATTACK_LIST, player, depth);
+  frame.list = &attack_moves;
+  frame.iter = attack_moves.size();
+}
+
+void Gomoku::GAttackSearch::startLongAttack(GPlayer player, const GCell& move, uint depth)
+{
+  cancel();
+  push(G_ATTACK_MOVE, player, depth, move);
+}
+
+bool Gomoku::GAttackSearch::run()
+{
+  if (!m_g->m_cancel && !m_g->m_deadline)
+  {
+    while (!step(UINT_MAX));
+    return m_result;
+  }
+  while (!step(CANCEL_CHECK_STEPS))
+  {
+    if (m_g->isCancelled())
+    {
+      cancel();
+      return false;
+    }
   }
+  return m_result;
+}
 
-  //Далее рассматриваем открытые тройки
-  //Если в атакующей цепочке участвует хотя бы одна открытая тройка,
-  //алгоритм определяет выигрыш с высокой, но не 100% вероятностью,
-  //поскольку не рассматривается защита контршахами.
-  //Алгоритм гарантирует только, что после реализации найденной потенциально выигрышной открытой тройки
-  //противник не сможет провести выигрышную цепочку контршахов.
-  for (const GPoint* attack_move = attack_moves.end(); attack_move != attack_moves.begin(); )
+bool Gomoku::GAttackSearch::step(uint budget)
+{
+  //Шаг кадра может вызвать проверки с собственным перебором (поиск цепочек шахов, защит от полушаха),
+  //поэтому бюджет расходуется и на шаги кадров, и на все ходы в уме
+  const std::uint64_t node_count = m_g->m_node_count;
+  for (uint steps = 0; !isFinished() && steps + (m_g->m_node_count - node_count) < budget; ++steps)
   {
-    --attack_move;
-    if (isNearVictoryOpen3(player, *attack_move, depth))
+    GFrame& frame = m_frames[m_frame_count - 1];
+    switch (frame.kind)
     {
-      if (victory_move)
-        *victory_move = *attack_move;
-      return true;
+    case G_ATTACK_LIST:
+      stepAttackList(frame);
+      break;
+    case G_ATTACK_MOVE:
+      stepAttackMove(frame);
+      break;
+    case G_DEFENSE:
+      stepDefense(frame);
+      break;
+    case G_VICTORY_LIST:
+      stepVictoryList(frame);
+      break;
+    case G_VICTORY_MOVE4:
+      stepVictoryMove4(frame);
+      break;
+    case G_VICTORY_OPEN3:
+      stepVictoryOpen3(frame);
+      break;
+    case G_DEFEAT:
+      stepDefeat(frame);
+      break;
     }
   }
-  return false;
+  return isFinished();
 }
 
-bool Gomoku::isVictoryMove(GPlayer player, const GPoint &move, uint depth)
+void Gomoku::GAttackSearch::cancel()
 {
-  return isVictoryMove4(player, move, depth) || isNearVictoryOpen3(player, move, depth);
+  while (!isFinished())
+  {
+    GFrame& frame = m_frames[--m_frame_count];
+    if (frame.made)
+      m_g->undoInMind();
+    if (frame.logged)
+      m_g->m_search_log->exit(GSearchRecord::NO_RESULT);
+  }
+}
+
+Gomoku::GAttackSearch::GFrame& Gomoku::GAttackSearch::push(GFrameKind kind, GPlayer player, uint depth, const GCell& move)
+{
+  assert(m_frame_count < MAX_FRAMES);
+  GFrame& frame = m_frames[m_frame_count++];
+  frame.kind = kind;
+  frame.phase = G_START;
+  frame.player = player;
+  frame.made = false;
+  frame.depth = depth;
+  frame.move = move;
+  frame.list = 0;
+  frame.moves.reset();
+  frame.iter = 0;
+  frame.open3 = false;
+  frame.cached = false;
+  frame.logged = false;
+  if (m_g->m_search_log)
+  {
+    //Перебор ходов выигрышной атаки не записывается в журнал, как и в рекурсивном поиске
+    static const GSearchNodeKind node_kinds[] = {G_NODE_LONG_ATTACK, G_NODE_LONG_ATTACK_MOVE, G_NODE_LONG_DEFENSE,
+                                                 G_NODE_EXIT, G_NODE_VICTORY_MOVE4, G_NODE_VICTORY_OPEN3, G_NODE_DEFEAT_MOVE};
+    if (kind == G_ATTACK_LIST)
+      frame.logged = m_g->m_search_log->enter(G_NODE_LONG_ATTACK, player, depth);
+    else if (kind != G_VICTORY_LIST)
+      frame.logged = m_g->m_search_log->enter(node_kinds[kind], player, depth, move);
+  }
+  return frame;
+}
+
+void Gomoku::GAttackSearch::finish(bool result)
+{
+  assert(!isFinished());
+  GFrame& frame = m_frames[--m_frame_count];
+  if (frame.made)
+    m_g->undoInMind();
+  if (frame.logged)
+    m_g->m_search_log->exit(result);
+  m_result = result;
+}
+
+void Gomoku::GAttackSearch::doMove(GFrame& frame)
+{
+  assert(!frame.made);
+  m_g->doInMind(frame.move, frame.player);
+  frame.made = true;
+}
+
+void Gomoku::GAttackSearch::stepAttackList(GFrame& frame)
+{
+  if (frame.phase == G_NEXT_CHILD && m_result)
+  {
+    //начальный ход атаки нужен только для корневого перебора
+    m_move = frame.variants().begin()[frame.iter];
+    finish(true);
+    return;
+  }
+  if (frame.iter == 0)
+  {
+    finish(false);
+    return;
+  }
+  frame.phase = G_NEXT_CHILD;
+  --frame.iter;
+  push(G_ATTACK_MOVE, frame.player, frame.depth, frame.variants().begin()[frame.iter]);
+}
+
+void Gomoku::GAttackSearch::stepAttackMove(GFrame& frame)
+{
+  GPlayer player = frame.player;
+  if (frame.phase == G_WAIT_CHILD)
+  {
+    finish(m_result);
+    return;
+  }
+  if (frame.phase == G_NEXT_CHILD)
+  {
+    if (!m_result)
+      finish(false);
+    else if (frame.iter == frame.moves.size())
+      finish(true);
+    else
+      push(G_DEFENSE, GPlayer(!player), frame.depth, frame.moves[frame.iter++]);
+    return;
+  }
+
+  if (!m_g->isEmptyCell(frame.move))
+  {
+    finish(false);
+    return;
+  }
+  const auto& danger_move_data = m_g->dangerMoves(player).get(frame.move);
+  const uint moves5_count = danger_move_data.m_open_moves5;
+  if (moves5_count >= 2)  //мат
+  {
+    finish(true);
+    return;
+  }
+  if (moves5_count == 0 && !danger_move_data.m_open3)  //ход не является шахом или полушахом
+  {
+    finish(false);
+    return;
+  }
+  doMove(frame);
+  if (frame.depth == 0)
+  {
+    finish(m_g->isLongAttackLeaf(player, moves5_count == 1));
+    return;
+  }
+  if (moves5_count == 1) //шах
+  {
+    frame.phase = G_WAIT_CHILD;
+    push(G_DEFENSE, GPlayer(!player), frame.depth, m_g->m_moves5[player].lastCell());
+    return;
+  }
+  //полушах
+  //Защит от полушаха не больше четырех (см. GHintMemo::GEntry)
+  frame.moves.reserve(m_g->m_arena, 4);
+  if (!m_g->isDangerOpen3(&frame.moves))
+  {
+    finish(false);
+    return;
+  }
+  //У противника не должно быть длинной или выигрышной цепочки шахов после очередной атакующей тройки игрока
+  if (m_g->findLongOrVictoryMove4Chain(GPlayer(!player), m_g->maxAttackDepth()))
+  {
+    finish(false);
+    return;
+  }
+  //первый вариант защиты рассматривается как продолжение перебора после успешной атаки
+  frame.phase = G_NEXT_CHILD;
+  m_result = true;
+}
+
+void Gomoku::GAttackSearch::stepDefense(GFrame& frame)
+{
+  if (frame.phase == G_WAIT_CHILD)
+  {
+    finish(m_result);
+    return;
+  }
+
+  assert(frame.depth > 0);
+  GPlayer player = frame.player;
+  doMove(frame);
+  const GStateBackup& md = m_g->backup(frame.move);
+  if (md.m_moves5_count > 1) //контрмат
+  {
+    finish(false);
+    return;
+  }
+  frame.phase = G_WAIT_CHILD;
+  if (md.m_moves5_count == 1) //контршах (у противника только один вариант потенциально длинной атаки)
+  {
+    push(G_ATTACK_MOVE, GPlayer(!player), frame.depth - 1, m_g->m_moves5[player].lastCell());
+    return;
+  }
+  GFrame& child = push(G_ATTACK_LIST, GPlayer(!player), frame.depth - 1);
+  m_g->getChainMoves(child.moves);
+  child.iter = child.moves.size();
+}
+
+void Gomoku::GAttackSearch::stepVictoryList(GFrame& frame)
+{
+  const GBaseStack& attack_moves = frame.variants();
+  const uint count = attack_moves.size();
+  //Ходы перебираются с конца, потоки ленивого параллельного поиска начинают перебор с разных ходов
+  auto attackMove = [&attack_moves, &frame, count](uint i) -> const GCell&
+  {
+    return attack_moves[(count - 1 - i + frame.shift) % count];
+  };
+
+  if (frame.phase == G_START)
+  {
+    frame.phase = G_NEXT_CHILD;
+    frame.shift = count > 0 ? m_g->m_search_order % count : 0;
+  }
+  else if (m_result)
+  {
+    m_move = attackMove(frame.iter - 1);
+    finish(true);
+    return;
+  }
+
+  //Сначала рассматриваем шахи, поскольку выигрышная цепочка шахов гарантирует выигрыш
+  if (frame.iter == count && !frame.open3)
+  {
+    //На глубине 0 открытые тройки не рассматриваются,
+    //поскольку на глубине 0 нас интересует мат в один ход
+    if (frame.depth == 0)
+    {
+      m_g->m_long_attack_possible = true;
+      finish(false);
+      return;
+    }
+    //Далее рассматриваем открытые тройки
+    //Если в атакующей цепочке участвует хотя бы одна открытая тройка,
+    //алгоритм определяет выигрыш с высокой, но не 100% вероятностью,
+    //поскольку не рассматривается защита контршахами.
+    //Алгоритм гарантирует только, что после реализации найденной потенциально выигрышной открытой тройки
+    //противник не сможет провести выигрышную цепочку контршахов.
+    frame.open3 = true;
+    frame.iter = 0;
+  }
+  if (frame.iter == count)
+  {
+    finish(false);
+    return;
+  }
+  const GCell& attack_move = attackMove(frame.iter++);
+  push(frame.open3 ? G_VICTORY_OPEN3 : G_VICTORY_MOVE4, frame.player, frame.depth, attack_move);
 }
 
-bool Gomoku::isVictoryMove4(GPlayer player, const GPoint &move, uint depth)
+void Gomoku::GAttackSearch::stepVictoryMove4(GFrame& frame)
 {
-  if (!isEmptyCell(move))
-    return false;
-  const auto& move_data = dangerMoves(player).get(move);
-  const auto& moves5 = move_data.m_moves5;
-  uint moves5_count = 0;
-  for (uint i = 0; i < moves5.size(); ++i)
+  if (frame.phase == G_WAIT_CHILD)
   {
-    if (!isEmptyCell(moves5[i]))
-      continue;
-    if (++moves5_count == 2)  //мат
-      return true;
+    finish(m_result);
+    return;
   }
-  if (moves5_count == 0)  //ход не является шахом
-    return false;
-  if (depth == 0)
-    return false;
-  GMoveMaker gmm(this, player, move);
-  return isDefeatMove(!player, m_moves5[player].lastCell(), depth);
+  GPlayer player = frame.player;
+  if (!m_g->isEmptyCell(frame.move))
+  {
+    finish(false);
+    return;
+  }
+  const uint moves5_count = m_g->dangerMoves(player).get(frame.move).m_open_moves5;
+  //мат, ход не является шахом или шахом на нулевой глубине
+  if (moves5_count != 1 || frame.depth == 0)
+  {
+    finish(moves5_count >= 2);
+    return;
+  }
+  doMove(frame);
+  frame.phase = G_WAIT_CHILD;
+  push(G_DEFEAT, GPlayer(!player), frame.depth, m_g->m_moves5[player].lastCell());
 }
 
-bool Gomoku::isNearVictoryOpen3(GPlayer player, const GPoint &move, uint depth)
+void Gomoku::GAttackSearch::stepVictoryOpen3(GFrame& frame)
 {
-  if (depth == 0)
-    return false;
-  if (!isEmptyCell(move))
-    return false;
-  const auto& move_data = dangerMoves(player).get(move);
-  if (!move_data.m_open3)  //ход не является полушахом
-    return false;
-  //Если ход одновременно является шахом, то он не обрабатывается как полушах
-  if (isDangerMove4(player, move))
-    return false;
-
-  GMoveMaker gmm(this, player, move);
-
-  GStack<4> defense_variants;
-  if (!isDangerOpen3(&defense_variants))
-    return false;
+  GPlayer player = frame.player;
+  if (frame.phase == G_NEXT_CHILD)
+  {
+    //Выигрыш требует проигрыша при любом варианте защиты
+    if (!m_result)
+      finish(false);
+    else if (frame.iter == frame.moves.size())
+      finish(true);
+    else
+      push(G_DEFEAT, GPlayer(!player), frame.depth, frame.moves[frame.iter++]);
+    return;
+  }
 
+  if (frame.depth == 0 || !m_g->isEmptyCell(frame.move))
+  {
+    finish(false);
+    return;
+  }
+  //Ход должен быть полушахом. Если ход одновременно является шахом, то он не обрабатывается как полушах
+  if (!m_g->dangerMoves(player).get(frame.move).m_open3 || m_g->isDangerMove4(player, frame.move))
+  {
+    finish(false);
+    return;
+  }
+  doMove(frame);
+  frame.moves.reserve(m_g->m_arena, 4);
+  if (!m_g->isDangerOpen3(&frame.moves))
+  {
+    finish(false);
+    return;
+  }
   //У противника не должно быть длинной или выигрышной цепочки шахов после очередной атакующей тройки игрока
-  if (findLongOrVictoryMove4Chain(!player, maxAttackDepth()))
-    return false;
-  for (const auto& defense_variant: defense_variants)
+  if (m_g->findLongOrVictoryMove4Chain(GPlayer(!player), m_g->maxAttackDepth()))
   {
-    if (!isDefeatMove(!player, defense_variant, depth))
-      return false;
+    finish(false);
+    return;
   }
-  return true;
-}
-
-bool Gomoku::isDefeatMove(GPlayer player, const GPoint& move, uint depth)
-{
-  if (!isEmptyCell(move))
-    return false;
-  assert(depth > 0);
-  GMoveMaker gmm(this, player, move);
-  const GMoveData& md = get(move);
-  if (md.m_moves5_count > 1) //контрмат
-    return false;
-  if (md.m_moves5_count == 1) //контршах (у противника только один вариант потенциально выигрышного хода)
-    return isVictoryMove(!player, m_moves5[player].lastCell(), depth - 1);
-  GStack<32> chain_moves;
-  getChainMoves(chain_moves);
-  return findVictoryAttack(!player, chain_moves, depth - 1);
+  frame.phase = G_NEXT_CHILD;
+  m_result = true;
 }
 
-bool Gomoku::findLongAttack(GPlayer player, uint depth, GPoint *move)
+void Gomoku::GAttackSearch::stepDefeat(GFrame& frame)
 {
-  return findLongAttack(player, dangerMoves(player).cells(), depth, move);
-}
+  GPlayer player = frame.player;
+  if (frame.phase == G_WAIT_CHILD && !m_result)
+  {
+    //Контршах не ведет к выигрышу цепочкой шахов, проверяем его как полушах (см. isVictoryMove)
+    frame.phase = G_NEXT_CHILD;
+    push(G_VICTORY_OPEN3, GPlayer(!player), frame.depth - 1, m_g->m_moves5[player].lastCell());
+    return;
+  }
+  if (frame.phase != G_START)
+  {
+    finishDefeat(frame, m_result);
+    return;
+  }
 
-bool Gomoku::findLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth, GPoint* move)
-{
-  for (const GPoint* attack_move = attack_moves.end(); attack_move != attack_moves.begin(); )
+  //Поиск отменен, результат не нужен
+  if (m_g->isCancelled() || !m_g->isEmptyCell(frame.move))
   {
-    --attack_move;
-    if (findLongAttack(player, *attack_move, depth))
+    finish(false);
+    return;
+  }
+  assert(frame.depth > 0);
+  if (m_g->m_threat_table)
+  {
+    //Результат зависит от позиции после защиты, глубины и предыдущего хода атакующего (см. getChainMoves).
+    //Признак возможной длинной атаки сохраняется вместе с результатом, поскольку его устанавливает поиск в поддереве
+    frame.key = (m_g->m_hash ^ geometry.zobrist(frame.move, player)) +
+                (std::uint64_t(m_g->lastCell().index) << 8 | frame.depth) * 0x9e3779b97f4a7c15ull;
+    bool result, long_attack_possible;
+    if (m_g->m_threat_table->find(frame.key, result, long_attack_possible))
     {
-      if (move)
-        *move = *attack_move;
-      return true;
+      m_g->m_long_attack_possible = m_g->m_long_attack_possible || long_attack_possible;
+      finish(result);
+      return;
     }
+    frame.cached = true;
+    frame.long_attack_possible = m_g->m_long_attack_possible;
+    m_g->m_long_attack_possible = false;
   }
-  return false;
-}
 
-bool Gomoku::findLongAttack(GPlayer player, const GPoint& move, uint depth)
-{
-  if (!isEmptyCell(move))
-    return false;
-  const auto& danger_move_data = dangerMoves(player).get(move);
-  const auto& moves5 = danger_move_data.m_moves5;
-  uint moves5_count = 0;
-  for (uint i = 0; i < moves5.size(); ++i)
+  doMove(frame);
+  const GStateBackup& md = m_g->backup(frame.move);
+  if (md.m_moves5_count > 1) //контрмат
   {
-    if (!isEmptyCell(moves5[i]))
-      continue;
-    if (++moves5_count == 2)  //мат
-      return true;
+    finishDefeat(frame, false);
+    return;
   }
-  if (moves5_count == 0 && !danger_move_data.m_open3)  //ход не является шахом или полушахом
-    return false;
-  GMoveMaker gmm(this, player, move);
-  if (depth == 0)
+  if (md.m_moves5_count == 1) //контршах (у противника только один вариант потенциально выигрышного хода)
   {
-    if (moves5_count == 1) //шах
-    {
-      GCounterShahChainMaker cm(this);
-      const auto& last_move_data = get(lastCell());
-      if (last_move_data.m_moves5_count > 1)
-        return last_move_data.player == player;
-      assert(last_move_data.m_moves5_count == 0);
-      //Считаем свою длинную атаку удачной,
-      //если противник по ходу защиты не создает угрозы своей длинной цепочки шахов
-      return !findLongOrVictoryMove4Chain(!player, maxAttackDepth());
-    }
-    else
-    {
-      if (!isDangerOpen3())
-        return false;
-      //Считаем свою длинную атаку удачной,
-      //если противник по ходу защиты не создает угрозы своей длинной или выигрышной цепочки шахов
-      return !findLongOrVictoryMove4Chain(!player, maxAttackDepth());
-    }
+    frame.phase = G_WAIT_CHILD;
+    push(G_VICTORY_MOVE4, GPlayer(!player), frame.depth - 1, m_g->m_moves5[player].lastCell());
+    return;
   }
-  if (moves5_count == 1) //шах
-    return isLongDefense(!player, m_moves5[player].lastCell(), depth);
-  else  //полушах
+  frame.phase = G_NEXT_CHILD;
+  GFrame& child = push(G_VICTORY_LIST, GPlayer(!player), frame.depth - 1);
+  m_g->getChainMoves(child.moves);
+}
+
+void Gomoku::GAttackSearch::finishDefeat(GFrame& frame, bool result)
+{
+  if (frame.cached)
   {
-    GStack<4> defense_variants;
-    if (!isDangerOpen3(&defense_variants))
-      return false;
-    //У противника не должно быть длинной или выигрышной цепочки шахов после очередной атакующей тройки игрока
-    if (findLongOrVictoryMove4Chain(!player, maxAttackDepth()))
-      return false;
-    for (const auto& dv: defense_variants)
-    {
-      if (!isLongDefense(!player, dv, depth))
-        return false;
-    }
-    return true;
+    //Результат отмененного поиска может быть неверным
+    if (!m_g->isCancelled())
+      m_g->m_threat_table->store(frame.key, result, m_g->m_long_attack_possible);
+    m_g->m_long_attack_possible = m_g->m_long_attack_possible || frame.long_attack_possible;
   }
+  finish(result);
 }
 
-bool Gomoku::isLongDefense(GPlayer player, const GPoint& move, uint depth)
+bool Gomoku::isLongAttackLeaf(GPlayer player, bool shah)
 {
-  assert(depth > 0);
-  GMoveMaker gmm(this, player, move);
-  const GMoveData& md = get(move);
-  if (md.m_moves5_count > 1) //контрмат
-    return false;
-  if (md.m_moves5_count == 1) //контршах (у противника только один вариант потенциально длинной атаки)
-    return findLongAttack(!player, m_moves5[player].lastCell(), depth - 1);
-  GStack<32> chain_moves;
-  getChainMoves(chain_moves);
-  return findLongAttack(!player, chain_moves, depth - 1);
+  if (shah)
+  {
+    GCounterShahChainMaker cm(this);
+    const auto& last_move_data = backup(lastCell());
+    if (last_move_data.m_moves5_count > 1)
+      return lastMovePlayer() == player;
+    assert(last_move_data.m_moves5_count == 0);
+    //Считаем свою длинную атаку удачной,
+    //если противник по ходу защиты не создает угрозы своей длинной цепочки шахов
+    return !findLongOrVictoryMove4Chain(!player, maxAttackDepth());
+  }
+  else
+  {
+    if (!isDangerOpen3())
+      return false;
+    //Считаем свою длинную атаку удачной,
+    //если противник по ходу защиты не создает угрозы своей длинной или выигрышной цепочки шахов
+    return !findLongOrVictoryMove4Chain(!player, maxAttackDepth());
+  }
 }
 
-void Gomoku::getChainMoves(GStack<32>& chain_moves)
+void Gomoku::getChainMoves(GArenaStack& chain_moves)
 {
+  //Не больше четырех ячеек в каждую сторону по каждому из четырех направлений
+  chain_moves.reserve(m_arena, 4 * 2 * 4);
   //Рассматриваем ходы, лежащие на одной линии с предыдущим в заданном направлении
   GPlayer player = curPlayer();
-  GPoint move = cells()[cells().size() - 2];
+  GCell move = cells()[cells().size() - 2];
   //Функция вызывается при игре в уме,
   //поэтому есть уверенность, что два последних хода принадлежат разным игрокам
-  assert(get(move).player == player);
+  assert(get(move) == player);
   for (int i = 0; i < 4; ++i)
   {
     //На направлении должно быть достаточно места для построения пятерки
-    if (!isSpace5(player, move, vecs1[i]))
+    if (!isSpace5(player, move, i))
       continue;
-    getChainMoves(player, move, vecs1[i], chain_moves);
-    getChainMoves(player, move, -vecs1[i], chain_moves);
+    getChainMoves(player, move, i, false, chain_moves);
+    getChainMoves(player, move, i, true, chain_moves);
   }
+  chain_moves.fit();
 }
 
-void Gomoku::getChainMoves(GPlayer player, GPoint move, const GVector &v1, GStack<32> &chain_moves)
+void Gomoku::getChainMoves(GPlayer player, GCell move, uint dir, bool backward, GBaseStack &chain_moves)
 {
   assert(cells().size() >= 2);
-  for (int i = 0; i < 4; ++i)
+  GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
+  for (uint i = geometry.ray(move, dir, backward); i > 0; --i)
   {
     move += v1;
-    if (!isValidCell(move))
-      return;
-    int move_player = get(move).player;
+    GPlayer move_player = get(move);
     if (move_player == !player)
       return;
     if (move_player == G_EMPTY)
@@ -928,20 +1645,21 @@ void Gomoku::getChainMoves(GPlayer player, GPoint move, const GVector &v1, GStac
   }
 }
 
-bool Gomoku::isSpace5(GPlayer player, const GPoint& move, const GVector &v1)
+bool Gomoku::isSpace5(GPlayer player, const GCell& move, uint dir)
 {
   int space = 1;
-  getSpace(player, move, v1, space);
-  getSpace(player, move, -v1, space);
+  getSpace(player, move, dir, false, space);
+  getSpace(player, move, dir, true, space);
   return space == 5;
 }
 
-void Gomoku::getSpace(GPlayer player, GPoint move, const GVector &v1, int &space)
+void Gomoku::getSpace(GPlayer player, GCell move, uint dir, bool backward, int &space)
 {
-  while (space < 5)
+  GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
+  for (uint i = geometry.ray(move, dir, backward); i > 0 && space < 5; --i)
   {
     move += v1;
-    if (!isValidCell(move) || get(move).player == !player)
+    if (get(move) == !player)
       return;
     ++space;
   }
@@ -949,7 +1667,13 @@ void Gomoku::getSpace(GPlayer player, GPoint move, const GVector &v1, int &space
 
 bool Gomoku::isGameOver() const
 {
-  return getLine5() || cells().size() == width() * height();
+  //Заполненное поле без линии 5 - частный случай ничьей
+  return getLine5() || isDraw();
+}
+
+bool Gomoku::isDraw() const
+{
+  return m_dead_windows == GGeometry::WINDOW_COUNT;
 }
 
 const GLine* Gomoku::getLine5() const
@@ -957,7 +1681,7 @@ const GLine* Gomoku::getLine5() const
   return isValidCell(m_line5.start) ? &m_line5 : nullptr;
 }
 
-bool Gomoku::randomFromTwo(GVariantsIndex& var_index, GPoint*& cur, const GPoint* end)
+bool Gomoku::randomFromTwo(GVariantsIndex& var_index, GCell*& cur, const GCell* end)
 {
   assert(cur >= var_index.begin() && end >= cur);
   if (cur == end || !isEmptyCell(*cur))
@@ -974,26 +1698,52 @@ bool Gomoku::randomFromTwo(GVariantsIndex& var_index, GPoint*& cur, const GPoint
 void Gomoku::copyFrom(const Gomoku &g)
 {
   setAiLevel(g.getAiLevel());
-
-  start();
-  for (const GPoint& p: g.cells())
-    doMove(p);
+  m_book = g.m_book;
+  m_deadline = g.m_deadline;
+  if (m_weights != g.m_weights)
+    setWeights(g.m_weights);
+  if (m_candidate_radius != g.m_candidate_radius)
+    setCandidateRadius(g.m_candidate_radius);
+
+  //Откатываем только ходы, которые расходятся с ходами g,
+  //поэтому повторное копирование той же партии обходится дешево
+  uint common = 0;
+  for (; common < cells().size() && common < g.cells().size(); ++common)
+  {
+    const GCell& move = cells()[common];
+    if (move != g.cells()[common] || get(move) != g.get(move))
+      break;
+  }
+  while (cells().size() > common)
+    undo();
+  for (; common < g.cells().size(); ++common)
+  {
+    const GCell& move = g.cells()[common];
+    doMove(move.point(), g.get(move));
+  }
 }
 
 void Gomoku::undoImpl()
 {
-  if (isGameOver())
+  //Последний ход, заполнивший поле без линии 5, обновлял состояние ходов как обычный ход
+  if (getLine5())
     undoLine5();
   else
     restoreRelatedMovesState();
-  pop();
+  removeCandidates();
+  removeStone();
 }
 
-void Gomoku::doInMind(const GPoint &move, GPlayer player)
+void Gomoku::doInMind(const GCell &move, GPlayer player)
 {
-  assert(!isGameOver() && !isShah(player));
+  //Ход в уме возможен и после ничьей, если поле не заполнено
+  assert(!getLine5() && !isShah(player));
 
-  push(move).player = player;
+  m_arena.enter();
+  ++m_node_count;
+
+  placeStone(move, player);
+  addCandidates();
 
   assert(!isShah(!player));
 
@@ -1002,15 +1752,175 @@ void Gomoku::doInMind(const GPoint &move, GPlayer player)
 
 void Gomoku::undoInMind()
 {
-  assert(!isGameOver());
+  //Ход в уме может заполнить поле, но не может построить линию 5
+  assert(!getLine5());
   restoreRelatedMovesState();
+  removeCandidates();
+  removeStone();
+
+  m_arena.leave();
+}
+
+void Gomoku::placeStone(const GCell& move, GPlayer player)
+{
+  push(move) = player;
+  m_hash ^= geometry.zobrist(move, player);
+  const auto* windows = geometry.cellWindows(move);
+  std::uint8_t dead_dirs = 0;
+  for (uint i = geometry.cellWindowCount(move); i > 0; )
+  {
+    const uint window = windows[--i];
+    std::uint8_t* counts = m_window_stones[window];
+    if (counts[player]++ == 0)
+    {
+      //Первый камень игрока закрывает окно для противника, окно с камнями обоих игроков мертво
+      setWindowLive(window, !player, false);
+      if (counts[!player] > 0)
+      {
+        ++m_dead_windows;
+        dead_dirs |= std::uint8_t(1 << geometry.window(window).dir);
+      }
+    }
+  }
+  m_dead_dirs[move] = dead_dirs;
+  //Занятая ячейка перестает быть завершением линии 5 для ходов 4, с которыми она образует пару,
+  //поэтому в ее собственном списке завершений (пары симметричны) перечислены как раз эти ходы 4
+  for (GPlayer p: {G_BLACK, G_WHITE})
+  {
+    if (isMove5(p, move))
+      --m_open_moves5[p];
+    auto& danger_moves = dangerMoves(p);
+    for (const GCell& move4: danger_moves.get(move).m_moves5)
+    {
+      assert(danger_moves[move4].m_open_moves5 > 0);
+      --danger_moves[move4].m_open_moves5;
+    }
+  }
+}
+
+void Gomoku::removeStone()
+{
+  //Все изменения, сделанные после хода, уже откачены, поэтому пары завершений те же, что и при ходе
+  const GCell& move = lastCell();
+  for (GPlayer p: {G_BLACK, G_WHITE})
+  {
+    if (isMove5(p, move))
+      ++m_open_moves5[p];
+    auto& danger_moves = dangerMoves(p);
+    for (const GCell& move4: danger_moves.get(move).m_moves5)
+      ++danger_moves[move4].m_open_moves5;
+  }
+  const GPlayer player = get(move);
+  const auto* windows = geometry.cellWindows(move);
+  for (uint i = geometry.cellWindowCount(move); i > 0; )
+  {
+    const uint window = windows[--i];
+    std::uint8_t* counts = m_window_stones[window];
+    if (--counts[player] == 0)
+    {
+      setWindowLive(window, !player, true);
+      if (counts[!player] > 0)
+        --m_dead_windows;
+    }
+  }
+  m_hash ^= geometry.zobrist(move, get(move));
   pop();
 }
 
+void Gomoku::setWindowLive(uint window, GPlayer player, bool live)
+{
+  auto& live_windows = m_live_windows[player];
+  const auto& w = geometry.window(window);
+  GCell cell = w.start;
+  for (uint i = 0; i < 5; ++i, cell += dirs1[w.dir])
+  {
+    if (live)
+      ++live_windows[cell];
+    else
+      --live_windows[cell];
+  }
+}
+
+void Gomoku::addCandidates()
+{
+  const GCell& move = lastCell();
+  m_candidate_pos[move] = std::uint8_t(m_candidates.remove(move));
+  //Ячейки, умершие при ходе, лежат в умерших окнах хода, то есть на линиях хода не дальше четырех ячеек от него
+  const std::uint8_t move_count = std::uint8_t(cells().size());
+  for (uint dir = 0; dir < 4; ++dir)
+  {
+    if (!(m_dead_dirs[move] & (1 << dir)))
+      continue;
+    for (bool backward: {false, true})
+    {
+      const GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
+      GCell cell = move;
+      for (uint i = std::min(geometry.ray(move, dir, backward), 4u); i > 0; --i)
+      {
+        cell += v1;
+        if (m_candidates.contains(cell) && isDeadCell(cell))
+        {
+          m_dead_candidate_pos[cell] = std::uint8_t(m_candidates.remove(cell));
+          m_dead_candidate_move[cell] = move_count;
+        }
+      }
+    }
+  }
+  const auto& neighbourhood = neighbourhoods[m_candidate_radius];
+  for (uint i = 0; i < neighbourCount(m_candidate_radius); ++i)
+  {
+    GOffset offset = neighbourhood[i];
+    GCell cell = move + offset;
+    //стены и занятые ячейки кандидатами не являются
+    if (++m_neighbours[cell] == 1 && isEmptyCell(cell) && !isDeadCell(cell))
+      m_candidates.insert(cell);
+  }
+}
+
+void Gomoku::removeCandidates()
+{
+  //Вызывается перед откатом последнего хода.
+  //Изменения отменяются в обратном порядке, поэтому порядок кандидатов зависит только от сделанных ходов,
+  //но не от того, какие ходы делались и откатывались при поиске
+  const GCell& move = lastCell();
+  const auto& neighbourhood = neighbourhoods[m_candidate_radius];
+  for (uint i = neighbourCount(m_candidate_radius); i > 0; )
+  {
+    GCell cell = move + neighbourhood[--i];
+    if (--m_neighbours[cell] == 0)
+      m_candidates.remove(cell);
+  }
+  //Кандидаты, умершие при ходе, возвращаются в обратном порядке
+  const std::uint8_t move_count = std::uint8_t(cells().size());
+  for (uint dir = 4; dir > 0; )
+  {
+    if (!(m_dead_dirs[move] & (1 << --dir)))
+      continue;
+    for (bool backward: {true, false})
+    {
+      const GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
+      uint count = std::min(geometry.ray(move, dir, backward), 4u);
+      GCell cell = move + v1 * int(count);
+      for (; count > 0; --count, cell -= v1)
+      {
+        if (m_dead_candidate_pos[cell] > 0 && m_dead_candidate_move[cell] == move_count)
+        {
+          m_candidates.restore(cell, m_dead_candidate_pos[cell]);
+          m_dead_candidate_pos[cell] = 0;
+        }
+      }
+    }
+  }
+  //Ход в мертвую ячейку не был кандидатом
+  assert(m_candidate_pos[move] == 0 || m_neighbours[move] > 0);
+  if (m_candidate_pos[move] > 0)
+    m_candidates.restore(move, m_candidate_pos[move]);
+}
+
 GPlayer Gomoku::lastMovePlayer() const
 {
   assert(!cells().empty());
-  return get(lastCell()).player;
+  return get(lastCell());
 }
 
 GPlayer Gomoku::curPlayer() const
@@ -1024,24 +1934,29 @@ bool Gomoku::isAiDepth(uint depth) const
   return (depth & 1) == 0;
 }
 
-void Gomoku::addMove5(GPlayer player, const GPoint& p)
+void Gomoku::addMove5(GPlayer player, const GCell& p)
 {
+  assert(isEmptyCell(p));
   m_moves5[player].push(p) = true;
+  ++m_open_moves5[player];
 }
 
 void Gomoku::removeMove5(GPlayer player)
 {
   assert(!m_moves5[player].cells().empty());
+  //ячейки, занятые после добавления хода 5, уже освобождены откатом
+  assert(isEmptyCell(m_moves5[player].lastCell()));
+  --m_open_moves5[player];
   m_moves5[player].pop();
 }
 
-bool Gomoku::isMove5(GPlayer player, const GPoint& move) const
+bool Gomoku::isMove5(GPlayer player, const GCell& move) const
 {
   assert(isValidCell(move));
   return !m_moves5[player].isEmptyCell(move);
 }
 
-void Gomoku::addMoves4(GPlayer player, const GPoint& move1, const GPoint& move2, GMoveData& source)
+void Gomoku::addMoves4(GPlayer player, const GCell& move1, const GCell& move2, GStateBackup& source)
 {
   auto& danger_moves = dangerMoves(player);
 
@@ -1049,30 +1964,34 @@ void Gomoku::addMoves4(GPlayer player, const GPoint& move1, const GPoint& move2,
   //Одна и та же пара ходов линии 4 может встретиться при одновременной реализации нескольких линий 3
   //(ситуации ххх__х, xx_x_x, xx__xx, x_xx_x)
   //Нужно избежать дублирования при добавлении
-  if (std::find(moves5_1.begin(), moves5_1.end(), move2) != moves5_1.end())
+  if (moves5_1.contains(move2))
   {
-    assert(
-      std::find(danger_moves[move2].m_moves5.begin(), danger_moves[move2].m_moves5.end(), move1) !=
-      danger_moves[move2].m_moves5.end());
+    assert(danger_moves[move2].m_moves5.contains(move1));
     return;
   }
-  moves5_1.push() = move2;
+  assert(isEmptyCell(move1) && isEmptyCell(move2));
+  moves5_1.push(move2);
+  ++danger_moves[move1].m_open_moves5;
   auto& moves5_2 = danger_moves[move2].m_moves5;
-  assert(std::find(moves5_2.begin(), moves5_2.end(), move1) == moves5_2.end());
-  moves5_2.push() = move1;
+  assert(!moves5_2.contains(move1));
+  moves5_2.push(move1);
+  ++danger_moves[move2].m_open_moves5;
   source.pushLine4Moves(move1, move2);
 }
 
-void Gomoku::undoMoves4(GMoveData& source)
+void Gomoku::undoMoves4(GPlayer player, GStateBackup& source)
 {
-  auto& danger_moves = dangerMoves(source.player);
-  GPoint move1, move2;
+  auto& danger_moves = dangerMoves(player);
+  GCell move1, move2;
   while (!source.emptyLine4Moves())
   {
     source.popLine4Moves(move1, move2);
+    //ходы пары свободны, поскольку ходы, сделанные после ее добавления, уже откачены
+    assert(isEmptyCell(move1) && isEmptyCell(move2));
     auto& data2 = danger_moves[move2];
     assert(!data2.m_moves5.empty() && data2.m_moves5.back() == move1);
     data2.m_moves5.pop();
+    --data2.m_open_moves5;
     if (data2.empty())
     {
       assert(danger_moves.cells().back() == move2);
@@ -1081,6 +2000,7 @@ void Gomoku::undoMoves4(GMoveData& source)
     auto& data1 = danger_moves[move1];
     assert(!data1.m_moves5.empty() && data1.m_moves5.back() == move2);
     data1.m_moves5.pop();
+    --data1.m_open_moves5;
     if (data1.empty())
     {
       assert(danger_moves.cells().back() == move1);
@@ -1089,60 +2009,45 @@ void Gomoku::undoMoves4(GMoveData& source)
   }
 }
 
-bool Gomoku::isDangerMove4(GPlayer player, const GPoint& move) const
+bool Gomoku::isDangerMove4(GPlayer player, const GCell& move) const
 {
   if (!isEmptyCell(move))
     return false;
-  const auto& dangerMoveData = m_danger_moves[player].get(move);
   //ход является ходом линии 4, если для него заданы парные и хотя бы один из них не занят
-  const auto& moves5 = dangerMoveData.m_moves5;
-  for (uint i = 0; i < moves5.size(); ++i)
-  {
-    if (isEmptyCell(moves5[i]))
-      return true;
-  }
-  return false;
+  return m_danger_moves[player].get(move).m_open_moves5 > 0;
 }
 
 bool Gomoku::buildLine5()
 {
   for (int i = 0; i < 4; ++i)
   {
-    if (buildLine5(vecs1[i]))
+    if (buildLine5(i))
       return true;
   }
 
   return false;
 }
 
-bool Gomoku::buildLine5(const GVector& v1)
+bool Gomoku::buildLine5(uint dir)
 {
-  GPoint center = lastCell();
-  GPlayer player = get(center).player;
+  const GCell& center = lastCell();
+  GPlayer player = get(center);
   assert(player != G_EMPTY);
 
-  GPoint p = center;
-
-  int i;
-  for (i = 1; i < 5; ++i)
-  {
-    p += v1;
-    if (!isValidCell(p) || get(p).player != player)
-      break;
-  }
-
-  p = center;
-
-  for (; i < 5; ++i)
+  //Из нескольких заполненных окон (линия длиннее 5) выбирается окно с наибольшим началом
+  uint window_count;
+  const auto* windows = geometry.cellWindows(center, dir, window_count);
+  for (uint i = window_count; i > 0; )
   {
-    p -= v1;
-    if (!isValidCell(p) || get(p).player != player)
-      return false;
+    const uint window = windows[--i];
+    if (m_window_stones[window][player] == 5)
+    {
+      m_line5.start = geometry.window(window).start.point();
+      m_line5.v1 = vecs1[dir];
+      return true;
+    }
   }
-
-  m_line5.start = p;
-  m_line5.v1 = v1;
-  return true;
+  return false;
 }
 
 void Gomoku::undoLine5()
@@ -1152,36 +2057,18 @@ void Gomoku::undoLine5()
 
 void Gomoku::initMovesWgt()
 {
-  GPoint lineStart{0, 0};
-  do
-  {
-    for (int i = 0; i < 4; ++i)
-      initWgt({lineStart, vecs1[i]});
-  }
-  while (next(lineStart));
-}
-
-void Gomoku::initWgt(const GLine& line5)
-{
-  GPoint p = line5.start;
-  //учитываем только линии, которые полностью лежат в поле
-  if (!isValidCell(p + line5.v1 * 4))
-    return;
-  for (int i = 0; ; ++i)
+  //Начальный вес хода равен весу первого хода в каждой линии 5, содержащей ячейку,
+  //число таких линий вычислено на этапе компиляции (см. GGeometry)
+  for (int i = 0; i < GCell::INDEX_COUNT; ++i)
   {
-    addWgt(p, G_BLACK, 1);
-    addWgt(p, G_WHITE, 1);
-    if (i == 4)
-      break;
-    p += line5.v1;
-    if (!isValidCell(p))
-      break;
+    GCell cell = GCell::fromIndex(i);
+    m_wgt[G_BLACK][cell] = m_wgt[G_WHITE][cell] = geometry.initWgt(cell) * getFirstLineMoveWgt();
   }
 }
 
-void Gomoku::addWgt(const GPoint &point, GPlayer player, int wgt)
+void Gomoku::addWgt(const GCell &point, GPlayer player, int wgt)
 {
-  ref(point).wgt[player] += wgt;
+  m_wgt[player][point] += wgt;
 }
 
 void Gomoku::updateRelatedMovesState()
@@ -1190,59 +2077,49 @@ void Gomoku::updateRelatedMovesState()
 
   for (int i = 0; i < 4; ++i)
   {
-    backupRelatedMovesState(vecs1[i], related_move_iter);
-    backupRelatedMovesState(-vecs1[i], related_move_iter);
-    updateRelatedMovesState(vecs1[i]);
+    backupRelatedMovesState(i, false, related_move_iter);
+    backupRelatedMovesState(i, true, related_move_iter);
+    updateRelatedMovesState(i);
   }
 
   //ищем полушахи (открытые тройки)
   for (int i = 0; i < 4; ++i)
   {
-    updateOpen3(vecs1[i]);
-    updateOpen3(-vecs1[i]);
+    updateOpen3(dirs1[i]);
+    updateOpen3(-dirs1[i]);
   }
 }
 
-void Gomoku::updateRelatedMovesState(const GVector& v1)
+void Gomoku::updateRelatedMovesState(uint dir)
 {
-  const GPoint& last_move = lastCell();
-  GMoveData& last_move_data = ref(last_move);
-  GPlayer player = last_move_data.player;
-
-  int counts[2] = {0, 0};
+  const GCell& last_move = lastCell();
+  GStateBackup& last_move_data = backup(last_move);
+  GPlayer player = get(last_move);
 
-  GVector v4 = v1 * 4;
-  GPoint ep = last_move + v4;
-  while (!isValidCell(ep))
-    ep -= v1;
-
-  GPoint bp = ep - v4;
-  if (!isValidCell(bp))
+  //линии 5 через последний ход в заданном направлении упорядочены по возрастанию начала,
+  //рассматриваем их от последней к первой
+  uint window_count;
+  const auto* windows = geometry.cellWindows(last_move, dir, window_count);
+  if (window_count == 0)
     return;
 
-  for (; ; ep -= v1)
-  {
-    assert(isValidCell(ep));
-    if (!isEmptyCell(ep))
-      ++counts[get(ep).player];
-    if (ep == bp)
-      break;
-  }
-
-  ep = last_move - v4;
-  while (!isValidCell(ep))
-    ep += v1;
+  GOffset v1 = dirs1[dir];
+  GOffset v4 = v1 * 4;
 
   int playerWgtDelta, enemyWgtDelta;
 
-  GPoint empty_points[2];
+  GCell empty_points[2];
 
-  for (; ; )
+  for (uint w = window_count; w > 0; )
   {
+    //число камней в линии берется из счетчиков окна (см. placeStone)
+    const uint window = windows[--w];
+    const GCell& bp = geometry.window(window).start;
+    const std::uint8_t* counts = m_window_stones[window];
     assert(isValidCell(bp));
 
     assert(counts[player] > 0 && counts[player] < 5);
-    assert(counts[!player] >= 0 && counts[!player] < 5);
+    assert(counts[!player] < 5);
     assert(counts[player] + counts[!player] <= 5);
 
     //рассматриваем линию 5 от bp в направлении v1
@@ -1255,10 +2132,11 @@ void Gomoku::updateRelatedMovesState(const GVector& v1)
     //и не остается кандидатов, вес которых можно было бы изменить
     if ((counts[player] == 1 && counts[!player] < 4) || counts[!player] == 0)
     {
-      GPlayer first_player = get(bp + v4).player;
-      GPlayer last_player = get(bp).player;
-      GPlayer prev_player = isValidCell(bp + v4 + v1) ? get(bp + v4 + v1).player : G_EMPTY;
-      GPlayer next_player = isValidCell(bp - v1) ? get(bp - v1).player : G_EMPTY;
+      GPlayer first_player = get(bp + v4);
+      GPlayer last_player = get(bp);
+      //соседние с линией ячейки могут оказаться стенами
+      GPlayer prev_player = get(bp + v4 + v1);
+      GPlayer next_player = get(bp - v1);
       if (counts[!player] == 0)
       {
         //последний ход развил линию игрока
@@ -1311,7 +2189,7 @@ void Gomoku::updateRelatedMovesState(const GVector& v1)
         //фиксируем изменения во всех пустых ячейках линии
         int empty_count = 5 - counts[0] - counts[1];
         assert(empty_count > 0);
-        for (GPoint p = bp; ; p += v1)
+        for (GCell p = bp; ; p += v1)
         {
           if (!isEmptyCell(p))
             continue;
@@ -1340,18 +2218,10 @@ void Gomoku::updateRelatedMovesState(const GVector& v1)
           addMoves4(player, empty_points[0], empty_points[1], last_move_data);
       }
     }
-
-    if (bp == ep)
-      break;
-    if (!isEmptyCell(bp + v4))
-      --counts[get(bp + v4).player];
-    bp -= v1;
-    if (!isEmptyCell(bp))
-      ++counts[get(bp).player];
   }
 }
 
-void Gomoku::updateOpen3(const GVector& v1)
+void Gomoku::updateOpen3(GOffset v1)
 {
   //Рассматриваем позицию
   //753х2468
@@ -1359,28 +2229,31 @@ void Gomoku::updateOpen3(const GVector& v1)
   //В пару к нему должен быть реализован один и только один из ходов 2, 4, 6
   //Тогда некоторые из оставшихся ходов при реализации возможно образуют открытую тройку
 
-  const GPoint& p1 = lastCell();
+  //Стены рамки поля не являются пустыми ячейками,
+  //поэтому проверка ячейки на пустоту заодно проверяет ее валидность
+
+  const GCell& p1 = lastCell();
 
   //Во всех случаях ход 3 должен быть валидным и пустым
-  GPoint p3 = p1 - v1;
-  if (!isValidCell(p3) || !isEmptyCell(p3))
+  GCell p3 = p1 - v1;
+  if (!isEmptyCell(p3))
     return;
 
   //Во всех случаях ходы 2 и 4 должны быть валидными
-  GPoint p2 = p1 + v1;
-  if (!isValidCell(p2))
+  GCell p2 = p1 + v1;
+  if (get(p2) == G_WALL)
     return;
-  GPoint p4 = p2 + v1;
-  if (!isValidCell(p4))
+  GCell p4 = p2 + v1;
+  if (get(p4) == G_WALL)
     return;
 
-  GPlayer player1 = get(p1).player;
-  GPlayer player2 = get(p2).player;
+  GPlayer player1 = get(p1);
+  GPlayer player2 = get(p2);
 
   if (player2 == !player1)
     return;
 
-  GPlayer player4 = get(p4).player;
+  GPlayer player4 = get(p4);
 
   if (player2 == player1)
   {
@@ -1399,8 +2272,8 @@ void Gomoku::updateOpen3(const GVector& v1)
   assert(player2 == G_EMPTY);
 
   //Ход 6 должен быть валидным
-  GPoint p6 = p4 + v1;
-  if (!isValidCell(p6))
+  GCell p6 = p4 + v1;
+  if (get(p6) == G_WALL)
     return;
 
   if (player4 == player1)
@@ -1408,7 +2281,7 @@ void Gomoku::updateOpen3(const GVector& v1)
     //Реализован ход 4
     //75_х_х68
     //Во всех этих случаях ход 6 должен быть пустым
-    if (get(p6).player != G_EMPTY)
+    if (get(p6) != G_EMPTY)
       return;
     updateOpen3_xXx(p2, v1);
     updateOpen3_Xx_x(p3, v1);
@@ -1420,20 +2293,20 @@ void Gomoku::updateOpen3(const GVector& v1)
   if (player4 != G_EMPTY)
     return;
 
-  if (get(p6).player == player1)
+  if (get(p6) == player1)
   {
     //Реализован ход 6
     //75_х__х8
     //Ход 8 должен быть валидным и пустым
-    GPoint p8 = p6 + v1;
-    if (!isValidCell(p8) || !isEmptyCell(p8))
+    GCell p8 = p6 + v1;
+    if (!isEmptyCell(p8))
       return;
     addOpen3(p2);
     addOpen3(p4);
   }
 }
 
-void Gomoku::updateOpen3_Xxx(const GPoint& p3, const GVector &v1)
+void Gomoku::updateOpen3_Xxx(const GCell& p3, GOffset v1)
 {
   //рассматриваем позицию
   //7531246
@@ -1446,20 +2319,20 @@ void Gomoku::updateOpen3_Xxx(const GPoint& p3, const GVector &v1)
   //1. точка 5 валидна и пуста
   //2. точка 6 валидна и пуста или точка 7 валидна и пуста
   //3. точка 6 не занята игроком и точка 7 не занята игроком
-  GPoint p5 = p3 - v1;
-  if (!isValidCell(p5) || !isEmptyCell(p5))
+  GCell p5 = p3 - v1;
+  if (!isEmptyCell(p5))
     return;
-  GPoint p6 = p3 + v1 * 4;
-  GPoint p7 = p5 - v1;
-  if ((!isValidCell(p6) || !isEmptyCell(p6)) && (!isValidCell(p7) || !isEmptyCell(p7)))
+  GCell p6 = p3 + v1 * 4;
+  GCell p7 = p5 - v1;
+  if (!isEmptyCell(p6) && !isEmptyCell(p7))
     return;
   GPlayer player = lastMovePlayer();
-  if ((isValidCell(p6) && get(p6).player == player) || (isValidCell(p7) && get(p7).player == player))
+  if (get(p6) == player || get(p7) == player)
     return;
   addOpen3(p3);
 }
 
-void Gomoku::updateOpen3_X_xx(const GPoint& p5, const GVector &v1)
+void Gomoku::updateOpen3_X_xx(const GCell& p5, GOffset v1)
 {
   //рассматриваем позицию
   //7531246
@@ -1468,15 +2341,15 @@ void Gomoku::updateOpen3_X_xx(const GPoint& p5, const GVector &v1)
   //_5_хх_
   //то есть
   //точки 5, 7 должны быть валидными и пустыми
-  if (!isValidCell(p5) || !isEmptyCell(p5))
+  if (!isEmptyCell(p5))
     return;
-  GPoint p7 = p5 - v1;
-  if (!isValidCell(p7) || !isEmptyCell(p7))
+  GCell p7 = p5 - v1;
+  if (!isEmptyCell(p7))
     return;
   addOpen3(p5);
 }
 
-void Gomoku::updateOpen3_xXx(const GPoint &p2, const GVector &v1)
+void Gomoku::updateOpen3_xXx(const GCell &p2, GOffset v1)
 {
   //рассматриваем позицию
   //75312468
@@ -1489,17 +2362,17 @@ void Gomoku::updateOpen3_xXx(const GPoint &p2, const GVector &v1)
   //1. точка 5 валидна и пуста или точка 8 валидна и пуста
   //2. точка 5 не занята игроком и точка 8 не занята игроком
 
-  GPoint p5 = p2 - v1 * 3;
-  GPoint p8 = p2 + v1 * 3;
-  if ((!isValidCell(p5) || !isEmptyCell(p5)) && (!isValidCell(p8) || !isEmptyCell(p8)))
+  GCell p5 = p2 - v1 * 3;
+  GCell p8 = p2 + v1 * 3;
+  if (!isEmptyCell(p5) && !isEmptyCell(p8))
     return;
   GPlayer player = lastMovePlayer();
-  if ((isValidCell(p5) && get(p5).player == player) || (isValidCell(p8) && get(p8).player == player))
+  if (get(p5) == player || get(p8) == player)
     return;
   addOpen3(p2);
 }
 
-void Gomoku::updateOpen3_Xx_x(const GPoint &p3, const GVector &v1)
+void Gomoku::updateOpen3_Xx_x(const GCell &p3, GOffset v1)
 {
   //рассматриваем позицию
   //531246
@@ -1508,26 +2381,26 @@ void Gomoku::updateOpen3_Xx_x(const GPoint &p3, const GVector &v1)
   //_3х_х_
   //то есть
   //точка 5 валидна и пуста
-  GPoint p5 = p3 - v1;
-  if (!isValidCell(p5) || !isEmptyCell(p5))
+  GCell p5 = p3 - v1;
+  if (!isEmptyCell(p5))
     return;
   addOpen3(p3);
 }
 
-void Gomoku::addOpen3(const GPoint &move)
+void Gomoku::addOpen3(const GCell &move)
 {
   auto& move_data = dangerMoves(lastMovePlayer())[move];
   if (move_data.m_open3)
     return;
   move_data.m_open3 = true;
-  ref(lastCell()).pushOpen3(move);
+  backup(lastCell()).pushOpen3(move);
 }
 
-void Gomoku::undoOpen3(GMoveData& source)
+void Gomoku::undoOpen3(GPlayer player, GStateBackup& source)
 {
-  auto& danger_moves = dangerMoves(source.player);
+  auto& danger_moves = dangerMoves(player);
 
-  GPoint open3_move;
+  GCell open3_move;
   while (!source.m_open3_moves.empty())
   {
     source.popOpen3(open3_move);
@@ -1542,7 +2415,7 @@ void Gomoku::undoOpen3(GMoveData& source)
   }
 }
 
-bool Gomoku::isDangerOpen3(GPlayer player, const GPoint& move, GBaseStack* defense_variants)
+bool Gomoku::isDangerOpen3(GPlayer player, const GCell& move, GBaseStack* defense_variants)
 {
   if (!isEmptyCell(move))
     return false;
@@ -1555,107 +2428,121 @@ bool Gomoku::isDangerOpen3(GPlayer player, const GPoint& move, GBaseStack* defen
 
 bool Gomoku::isDangerOpen3(GBaseStack *defense_variants)
 {
-  const GMoveData& md = get(lastCell());
+  const GStateBackup& md = backup(lastCell());
   //Опасная открытая тройка должна породить как минимум две пары ходов 4,
   //и среди них хотя бы один должен встретиться дважды
   if (md.m_moves4.size() < 4)
     return false;
-  for (uint i = 0; i < md.m_moves4.size(); ++i)
+
+  //Результат зависит от позиции и последнего хода (см. backup).
+  //Вместе с ним запоминаются защитные ходы и признак возможной длинной атаки, который устанавливает поиск
+  std::uint64_t key = memoKey(G_MEMO_DANGER_OPEN3, uint(lastCell().index));
+  const GHintMemo::GEntry* entry = m_memo.find(key);
+  if (!entry)
   {
-    if (findVictoryMove4Chain(md.player, md.m_moves4[i], 0, defense_variants))
-      return true;
+    bool parent_long_attack_possible = m_long_attack_possible;
+    m_long_attack_possible = false;
+    GStack<4> variants;
+    bool result = false;
+    for (uint i = 0; i < md.m_moves4.size() && !result; ++i)
+      result = findVictoryMove4Chain(lastMovePlayer(), md.m_moves4[i], 0, &variants);
+    GHintMemo::GEntry& new_entry = m_memo.insert(key);
+    new_entry.result = result;
+    new_entry.long_attack_possible = m_long_attack_possible;
+    for (const GCell& variant: variants)
+      new_entry.variants[new_entry.variant_count++] = variant;
+    m_long_attack_possible = parent_long_attack_possible;
+    entry = &new_entry;
   }
-  return false;
+
+  m_long_attack_possible = m_long_attack_possible || entry->long_attack_possible;
+  if (entry->result && defense_variants)
+  {
+    //поиск очищает список защитных ходов перед их добавлением
+    defense_variants->clear();
+    for (uint i = 0; i < entry->variant_count; ++i)
+      defense_variants->push() = entry->variants[i];
+  }
+  return entry->result;
 }
 
-bool Gomoku::isMate(GPlayer player, const GPoint &move)
+bool Gomoku::isMate(GPlayer player, const GCell &move)
 {
   if (!isEmptyCell(move))
     return false;
-  const auto& move_data = dangerMoves(player).get(move);
-  const auto& moves5 = move_data.m_moves5;
-  uint move5_count = 0;
-  for (uint i = 0; i < moves5.size(); ++i)
-  {
-    if (!isEmptyCell(moves5[i]))
-      continue;
-    if (++move5_count == 2)
-      return true;
-  }
-  return false;
+  return dangerMoves(player).get(move).m_open_moves5 >= 2;
 }
 
 bool Gomoku::isMate()
 {
-  return get(lastCell()).m_moves5_count > 1;
+  return backup(lastCell()).m_moves5_count > 1;
 }
 
 bool Gomoku::isShah(GPlayer player)
 {
-  GPoint p;
-  return hintMove5(player, p);
+  return m_open_moves5[player] > 0;
 }
 
-void Gomoku::backupRelatedMovesState(const GVector& v1, uint& related_moves_iter)
+void Gomoku::backupRelatedMovesState(uint dir, bool backward, uint& related_moves_iter)
 {
-  GPoint p = lastCell();
-  GMoveData& last_move_data = ref(p);
+  GCell p = lastCell();
+  GStateBackup& last_move_data = backup(p);
+  GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
 
-  for (uint i = 0; ; ++i)
+  for (uint i = geometry.ray(p, dir, backward); i > 0; --i)
   {
     p += v1;
-    if (!isValidCell(p))
-      break;
     if (isEmptyCell(p))
     {
       assert(related_moves_iter < GStateBackup::RELATED_MOVES_COUNT);
-      last_move_data.related_moves_wgt_backup[related_moves_iter] = get(p).wgt;
+      GMoveWgt& wgt_backup = last_move_data.related_moves_wgt_backup[related_moves_iter];
+      wgt_backup[G_BLACK] = m_wgt[G_BLACK][p];
+      wgt_backup[G_WHITE] = m_wgt[G_WHITE][p];
       ++related_moves_iter;
     }
-    if (i == 3)
-      break;
   }
 }
 
 void Gomoku::restoreRelatedMovesState()
 {
-  GPoint p = lastCell();
-  GMoveData& last_move_data = ref(p);
+  GCell p = lastCell();
+  GStateBackup& last_move_data = backup(p);
 
-  undoOpen3(last_move_data);
+  GPlayer player = get(p);
+
+  undoOpen3(player, last_move_data);
 
   for (; last_move_data.m_moves5_count > 0; --last_move_data.m_moves5_count)
-    removeMove5(last_move_data.player);
+    removeMove5(player);
 
-  undoMoves4(last_move_data);
+  undoMoves4(player, last_move_data);
 
   uint related_moves_iter = 0;
 
   for (int i = 0; i < 4; ++i)
   {
-    restoreRelatedMovesState(vecs1[i], related_moves_iter);
-    restoreRelatedMovesState(-vecs1[i], related_moves_iter);
+    restoreRelatedMovesState(i, false, related_moves_iter);
+    restoreRelatedMovesState(i, true, related_moves_iter);
   }
 }
 
-void Gomoku::restoreRelatedMovesState(const GVector& v1, uint& related_moves_iter)
+void Gomoku::restoreRelatedMovesState(uint dir, bool backward, uint& related_moves_iter)
 {
-  GPoint p = lastCell();
-  GMoveData& last_move_data = ref(p);
+  GCell p = lastCell();
+  GStateBackup& last_move_data = backup(p);
+  GOffset v1 = backward ? -dirs1[dir] : dirs1[dir];
 
-  for (uint i = 0; ; ++i)
+  for (uint i = geometry.ray(p, dir, backward); i > 0; --i)
   {
     p += v1;
-    if (!isValidCell(p))
-      break;
     if (isEmptyCell(p))
     {
       assert(related_moves_iter < GStateBackup::RELATED_MOVES_COUNT);
-      ref(p).wgt = last_move_data.related_moves_wgt_backup[related_moves_iter];
+      const GMoveWgt& wgt_backup = last_move_data.related_moves_wgt_backup[related_moves_iter];
+      m_wgt[G_BLACK][p] = wgt_backup[G_BLACK];
+      m_wgt[G_WHITE][p] = wgt_backup[G_WHITE];
       ++related_moves_iter;
     }
-    if (i == 3)
-      break;
   }
 }
 
@@ -1679,7 +2566,7 @@ int Gomoku::getBlockingMoveWgt(int line_len)
 int Gomoku::getLineWgt(int line_len)
 {
   assert(line_len > 0 && line_len <= 5);
-  return (line_len >= 4) ? 6  : (line_len * 2 - 1);
+  return m_weights.line[line_len];
 }
 
 int Gomoku::maxStoredWgt()
@@ -1687,53 +2574,79 @@ int Gomoku::maxStoredWgt()
   GPlayer enemy = !lastMovePlayer();
   int max_wgt = -WGT_VICTORY;
 
-  GPoint move{0, 0};
-  do
+  for (const GCell& move: m_candidates.cells())
   {
-    if (!isEmptyCell(move))
-      continue;
     int wgt = getStoredWgt(enemy, move);
     if (wgt > max_wgt)
       max_wgt = wgt;
   }
-  while (next(move));
 
   return max_wgt;
 }
 
+void Gomoku::assignVariants(GVariantsIndex& variants_index) const
+{
+  //Мертвые ячейки не лежат ни в одной линии, которую можно достроить до линии 5,
+  //поэтому они не бывают ни атакующими, ни защитными ходами и в кандидаты не попадают
+  variants_index.assign(m_candidates.cells());
+  //Все ячейки рядом с камнями мертвые, но ничьей еще нет - перебираются все живые ячейки
+  if (variants_index.empty() && !cells().empty() && !isDraw())
+  {
+    GCell cell{0, 0};
+    do
+    {
+      if (isEmptyCell(cell) && !isDeadCell(cell))
+        variants_index.push() = cell;
+    }
+    while (next(cell));
+  }
+}
+
 void Gomoku::sortVariantsByWgt(GPlayer player, GVariantsIndex& variants_index)
 {
-  auto cmp = [player, this](const GPoint& variant1, const GPoint& variant2)
+  auto cmp = [player, this](const GCell& variant1, const GCell& variant2)
   {
     return cmpVariants(player, variant1, variant2);
   };
 
-  std::sort(&variants_index[0], &variants_index[0] + gridSize(), cmp);
+  //Повторные подсказки в той же позиции (например, уровни hintInTime) не сортируют варианты заново
+  GSortedVariants& sorted = m_sorted_variants[player];
+  if (!sorted.valid || sorted.hash != m_hash)
+  {
+    assignVariants(sorted.index);
+    std::sort(sorted.index.begin(), sorted.index.end(), cmp);
+    sorted.valid = true;
+    sorted.hash = m_hash;
+  }
+  variants_index.assign(sorted.index);
 }
 
 void Gomoku::sortMaxN(GPlayer player, GVariantsIndex &variants_index, uint n)
 {
-  assert(n > 0 && n <= gridSize());
+  assert(n > 0);
 
-  auto cmp = [player, this](const GPoint& variant1, const GPoint& variant2)
+  auto cmp = [player, this](const GCell& variant1, const GCell& variant2)
   {
     return cmpVariants(player, variant1, variant2);
   };
 
-  std::nth_element(&variants_index[0], &variants_index[n - 1], &variants_index[0] + gridSize(), cmp);
-  std::sort(&variants_index[0], &variants_index[n - 1], cmp);
+  assignVariants(variants_index);
+  assert(!variants_index.empty());
+  if (n > variants_index.size())
+    n = variants_index.size();
+
+  std::nth_element(variants_index.begin(), &variants_index[n - 1], variants_index.end(), cmp);
+  std::sort(variants_index.begin(), &variants_index[n - 1], cmp);
 }
 
-bool Gomoku::cmpVariants(GPlayer player, const GPoint& variant1, const GPoint& variant2)
+bool Gomoku::cmpVariants(GPlayer player, const GCell& variant1, const GCell& variant2)
 {
-  if (!isEmptyCell(variant1))
-    return false;
-  if (!isEmptyCell(variant2))
-    return true;
-  return get(variant1).wgt[player] > get(variant2).wgt[player];
+  //Кандидаты в ходы всегда пусты
+  assert(isEmptyCell(variant1) && isEmptyCell(variant2));
+  return m_wgt[player][variant1] > m_wgt[player][variant2];
 }
 
-GPoint Gomoku::randomMove(const GBaseStack& moves)
+GCell Gomoku::randomMove(const GBaseStack& moves)
 {
   return moves[(uint)random(0, moves.size())];
 }
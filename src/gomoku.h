@@ -3,11 +3,22 @@
 
 #include "igomoku.h"
 #include "ggrid.h"
+#include "ggeometry.h"
 #include "gline.h"
 #include "gstack.h"
 #include "gplayer.h"
 #include "grandom.h"
+#include "gweights.h"
+#include "gtrace.h"
+#include "gsearchlog.h"
+#include "gthreattable.h"
+#include "ghintmemo.h"
+#include "gtimer.h"
 #include <iostream>
+#include <climits>
+#include <vector>
+#include <memory>
+#include <atomic>
 
 namespace nsg
 {
@@ -32,10 +43,128 @@ protected:
   int wgt[2] = {0, 0};
 };
 
-using GBaseStack = TBaseStack<GPoint>;
+//Этап подбора хода, на котором найден ход (см. Gomoku::hintImpl)
+enum GHintKind : std::uint8_t
+{
+  G_HINT_NONE,
+  G_HINT_OPENING,             //первые ходы партии
+  G_HINT_MOVE5,               //финальный ход
+  G_HINT_BLOCK5,              //блокировка финального хода противника
+  G_HINT_VICTORY_MOVE4_CHAIN, //выигрышная цепочка шахов
+  G_HINT_VICTORY_ATTACK,      //выигрышная атака
+  G_HINT_LONG_ATTACK,         //длинная атака
+  G_HINT_POSITIONAL,          //ход с максимальным весом, не дающий противнику длинной атаки
+  G_HINT_BLOCK_THREAT,        //блокировка угрозы противника
+  G_HINT_DELAY_DEFEAT,        //затягивание выигрышной атаки противника
+  G_HINT_BOOK,                //ход дебютной книги
+  G_HINT_KIND_COUNT
+};
+
+using GBaseStack = TBaseStack<GCell>;
 
 template <uint MAXSIZE>
-using GStack = TStack<GPoint, MAXSIZE>;
+using GStack = TStack<GCell, MAXSIZE>;
+
+using GArenaStack = TArenaStack<GCell>;
+
+//Стек ячеек с компактными номерами (см. GCellId) для данных, которые хранятся для каждой ячейки поля:
+//в отличие от GStack не содержит указателя на данные, элемент занимает байт
+template <uint MAXSIZE>
+class GCellStack
+{
+public:
+  static_assert(MAXSIZE <= 255, "GCellStack size does not fit in a byte");
+
+  class const_iterator
+  {
+  public:
+    const_iterator(const GCellId* id) : m_id(id)
+    {}
+
+    GCell operator*() const
+    {
+      return fromCellId(*m_id);
+    }
+
+    const_iterator& operator++()
+    {
+      ++m_id;
+      return *this;
+    }
+
+    bool operator!=(const const_iterator& it) const
+    {
+      return m_id != it.m_id;
+    }
+
+  protected:
+    const GCellId* m_id;
+  };
+
+  bool empty() const
+  {
+    return m_size == 0;
+  }
+
+  uint size() const
+  {
+    return m_size;
+  }
+
+  GCell operator[](uint i) const
+  {
+    assert(i < m_size);
+    return fromCellId(m_ids[i]);
+  }
+
+  GCell back() const
+  {
+    assert(!empty());
+    return fromCellId(m_ids[m_size - 1]);
+  }
+
+  void push(const GCell& cell)
+  {
+    assert(m_size < MAXSIZE && cell.isValid());
+    m_ids[m_size++] = toCellId(cell);
+  }
+
+  void pop()
+  {
+    assert(!empty());
+    --m_size;
+  }
+
+  void clear()
+  {
+    m_size = 0;
+  }
+
+  bool contains(const GCell& cell) const
+  {
+    const GCellId id = toCellId(cell);
+    for (uint i = 0; i < m_size; ++i)
+    {
+      if (m_ids[i] == id)
+        return true;
+    }
+    return false;
+  }
+
+  const_iterator begin() const
+  {
+    return m_ids;
+  }
+
+  const_iterator end() const
+  {
+    return m_ids + m_size;
+  }
+
+protected:
+  std::uint8_t m_size = 0;
+  GCellId m_ids[MAXSIZE];
+};
 
 class GStateBackup
 {
@@ -43,6 +172,13 @@ public:
   GStateBackup() : m_moves5_count(0)
   {}
 
+  void clear()
+  {
+    m_moves5_count = 0;
+    m_moves4.clear();
+    m_open3_moves.clear();
+  }
+
   void addLine5Move()
   {
     ++m_moves5_count;
@@ -55,13 +191,13 @@ public:
 
   //ходы линий 4 всегда добавляются парами
   //(два свободных хода линии 3)
-  void pushLine4Moves(const GPoint& move1, const GPoint& move2)
+  void pushLine4Moves(const GCell& move1, const GCell& move2)
   {
-    m_moves4.push() = move1;
-    m_moves4.push() = move2;
+    m_moves4.push(move1);
+    m_moves4.push(move2);
   }
 
-  void popLine4Moves(GPoint& move1, GPoint& move2)
+  void popLine4Moves(GCell& move1, GCell& move2)
   {
     move2 = m_moves4.back();
     m_moves4.pop();
@@ -69,12 +205,12 @@ public:
     m_moves4.pop();
   }
 
-  void pushOpen3(const GPoint& move)
+  void pushOpen3(const GCell& move)
   {
-    m_open3_moves.push() = move;
+    m_open3_moves.push(move);
   }
 
-  void popOpen3(GPoint& move)
+  void popOpen3(GCell& move)
   {
     move = m_open3_moves.back();
     m_open3_moves.pop();
@@ -93,39 +229,24 @@ public:
 
   //новые линии 3, каждая линия 3 представлена парой свободных ходов,
   //каждый такой ход реализует линию 4
-  GStack<RELATED_MOVES_COUNT> m_moves4;
+  GCellStack<RELATED_MOVES_COUNT> m_moves4;
 
   //новые потенциальные открытые тройки
-  GStack<RELATED_MOVES_COUNT> m_open3_moves;
+  GCellStack<RELATED_MOVES_COUNT> m_open3_moves;
 };
 
-class GMoveData : public GStateBackup
-{
-public:
-  GMoveData(GPlayer _player = G_EMPTY) : player(_player)
-  {}
-
-  bool empty() const
-  {
-    return player == G_EMPTY;
-  }
-
-  void clear()
-  {
-    player = G_EMPTY;
-  }
+template<>
+const GPlayer default_empty_value<GPlayer> = G_EMPTY;
 
-public:
-  GPlayer player;
+//Данные ячеек поля хранятся в отдельных плотных массивах:
+//занятость ячеек (GGrid), веса ходов каждого игрока (GWgtGrid)
+//и редко используемые данные отката ходов (GBackupGrid)
+//Ячейки рамки поля заняты стенами (G_WALL)
+using GGrid = TGridStack<GPlayer>;
 
-  //для каждой свободной ячейки хранится вес хода каждого игрока
-  //который отражает изменение веса ситуации для игрока при реализации этого хода
-  //вес ситуации для игрока равен разнице между весом линий игрока и весом линий противника
-  GMoveWgt wgt;
-};
+using GWgtGrid = TGrid<int>;
 
-template<int W, int H>
-using GGrid = TGridStack<GMoveData, W, H>;
+using GBackupGrid = TGrid<GStateBackup>;
 
 template<>
 const bool default_empty_value<bool> = false;
@@ -147,17 +268,25 @@ public:
   {
     m_moves5.clear();
     m_open3 = false;
+    m_open_moves5 = 0;
   }
 
 public:
-  GStack<8> m_moves5; //Для шаха или вилки шахов храним множество финальных дополнений
+  GCellStack<8> m_moves5; //Для шаха или вилки шахов храним множество финальных дополнений
   bool      m_open3;  //Для открытой тройки храним признак открытой тройки
+  std::uint8_t m_open_moves5 = 0; //Число незанятых ячеек m_moves5 (см. Gomoku::placeStone)
 };
 
-class Gomoku : public IGomoku, protected GGrid<GRID_WIDTH, GRID_HEIGHT>
+class GParallelSearch;
+class GPhaseRace;
+class GLazySmp;
+class GBook;
+
+class Gomoku : public IGomoku, protected GGrid
 {
 public:
   Gomoku();
+  ~Gomoku() override;
 
   void start() override;
   bool isValidNextMove(int x, int y) const override;
@@ -168,105 +297,197 @@ public:
   bool undo(int& x, int& y) override;
   bool undo(GPoint& move);
   bool undo();
+  //После ничьей (см. isDraw) подсказывается первая свободная ячейка, после линии 5 подсказки нет
   bool hint(int& x, int& y) override;
   bool hint(int& x, int& y, GPlayer player);
+  //Подбор хода с ограничением времени (мс) вместо фиксированного уровня ии
+  bool hintInTime(int& x, int& y, GPlayer player, uint time_limit);
+  GHintKind getLastHintKind() const;
   bool isGameOver() const override;
+  //Ничья: ни в одном окне (линии 5) нельзя построить линию 5, поскольку в каждом есть камни обоих игроков
+  bool isDraw() const;
   const GLine* getLine5() const override;
   uint getAiLevel() const override;
   void setAiLevel(uint level) override;
   uint getMoveCount(GPlayer player);
 
+  //Устанавливает позицию по списку ходов (первыми ходят черные, игроки чередуются).
+  //Начало партии, совпадающее с текущим, не переигрывается
+  bool setMoves(const std::vector<GPoint>& moves);
+
+  const GWeights& getWeights() const;
+  //Веса ходов на поле пересчитываются под новые параметры оценки
+  void setWeights(const GWeights& weights);
+
+  //Радиус окрестности занятых ячеек, в которой ищутся кандидаты в ходы (1..GCell::BORDER, см. CANDIDATE_RADIUS).
+  //Как и при смене весов, партия переигрывается с начального поля
+  uint getCandidateRadius() const;
+  void setCandidateRadius(uint radius);
+
+  //Журнал этапов подбора хода (nullptr - без журнала)
+  void setTrace(GTrace* trace);
+
+  //Журнал узлов дерева поиска угроз (nullptr - без журнала)
+  void setSearchLog(GSearchLog* log);
+
+  //Число потоков поиска выигрышной и длинной атаки (см. GParallelSearch)
+  void setSearchThreads(uint thread_count);
+
+  //Одновременный запуск этапов поиска атаки и проверки позиционных вариантов на копиях поля (см. GPhaseRace).
+  //Подсказка совпадает с последовательным подбором хода
+  void setHintRace(bool race);
+
+  //Режим ленивого параллельного поиска (см. GLazySmp): при нескольких потоках поиска (см. setSearchThreads)
+  //каждый поток подбирает ход целиком со своим порядком перебора, а ход дает первый завершившийся поток
+  void setLazySmp(bool lazy_smp);
+
+  //Дебютная книга (nullptr - без книги). Книга должна жить, пока поле ее использует
+  void setBook(const GBook* book);
+
+  //Ходы игрока с наибольшим весом (не больше count) в порядке убывания веса
+  void getBestVariants(GPlayer player, uint count, std::vector<GPoint>& variants);
+
 protected:
 
   friend class GMoveMaker;
   friend class GCounterShahChainMaker;
+  friend class GParallelSearch;
+  friend class GPhaseRace;
+  friend class GLazySmp;
 
+  //Индекс вариантов заполняется текущими кандидатами в ходы (см. m_candidates)
   class GVariantsIndex : public GStack<gridSize()>
   {
   public:
-    GVariantsIndex()
+    void assign(const GBaseStack& cells)
     {
-      GPoint p{0, 0};
-      do
-      {
-        push() = p;
-      }
-      while (next(p));
+      clear();
+      for (const GCell& cell: cells)
+        push() = cell;
     }
   };
 
-  bool randomFromTwo(GVariantsIndex& var_index, GPoint*& cur, const GPoint* end);
+  bool randomFromTwo(GVariantsIndex& var_index, GCell*& cur, const GCell* end);
+
+  //Свойства варианта, общие для запасных стратегий подсказки (см. hintImpl)
+  struct GVariantInfo
+  {
+    bool known = false;  //вариант уже классифицирован
+    bool shah = false;
+    bool open3 = false;  //опасный полушах (см. isDangerOpen3)
+    GStack<4> blocks;    //защитные ходы противника от полушаха
+  };
 
   void copyFrom(const Gomoku& g);
 
   void undoImpl();
-  void doInMind(const GPoint& move, GPlayer player);
+  void doInMind(const GCell& move, GPlayer player);
   void undoInMind();
 
-  GPoint hintImpl(GPlayer player);
-  GPoint hintSecondMove() const;
-  GPoint hintThirdMove(GPlayer player);
-  GPoint hintForthMove(GPlayer player);
+  //Ставит и снимает камень, обновляя данные, которые зависят только от занятости ячеек
+  void placeStone(const GCell& move, GPlayer player);
+  void removeStone();
+  //Окно закрыто для игрока, если в нем есть камни противника (см. m_live_windows)
+  void setWindowLive(uint window, GPlayer player, bool live);
+
+  //Ячейка без живых окон обоих игроков (мертвая) не влияет на исход партии
+  bool isDeadCell(const GCell& cell) const
+  {
+    return m_live_windows[G_BLACK][cell] == 0 && m_live_windows[G_WHITE][cell] == 0;
+  }
 
-  bool hintMove5(GPlayer player, GPoint& move) const;
-  bool hintBlock5(GPlayer player, GPoint& move) const;
+  //Мертвые ячейки исключаются из кандидатов (см. m_dead_candidate_pos)
+  void addCandidates();
+  void removeCandidates();
+
+  //Запоминает ходы партии и возвращает поле в начало, чтобы переиграть их с новыми параметрами
+  void takeMoves(std::vector<std::pair<GPoint, GPlayer>>& moves);
+  void replayMoves(const std::vector<std::pair<GPoint, GPlayer>>& moves);
+
+  GCell hintImpl(GPlayer player);
+  //Ход дебютной книги (см. setBook), если в книге есть поиск позиции уровня не выше уровня ии
+  bool hintBook(GPlayer player, GCell& move) const;
+  GCell hintSecondMove() const;
+  GCell hintThirdMove(GPlayer player);
+  GCell hintForthMove(GPlayer player);
+
+  bool hintMove5(GPlayer player, GCell& move) const;
+  bool hintBlock5(GPlayer player, GCell& move) const;
+
+  //Этапы подбора хода, которые можно выполнять одновременно (см. GPhaseRace)
+  bool hintVictoryMove4Chain(GPlayer player, GCell& move);
+  //Оставляет признак возможной длинной атаки последнего поиска
+  bool hintVictoryAttack(GPlayer player, GCell& move);
+  bool hintLongAttack(GPlayer player, GCell& move);
+  //Вариант из [begin, end), который продолжается длинной атакой игрока или хотя бы не допускает длинной атаки противника.
+  //Возвращает невалидную ячейку, если такого варианта нет
+  GCell hintDefenseVariant(GPlayer player, const GCell* begin, const GCell* end);
+
+  bool isCancelled() const
+  {
+    return (m_cancel && m_cancel->load(std::memory_order_relaxed)) || (m_deadline && m_deadline->expired());
+  }
 
   //Поиск выигрышной цепочки шахов
   bool findVictoryMove4Chain(
     GPlayer player,
     uint depth,
     GBaseStack* defense_variants = 0,
-    GPoint* victory_move = 0);
+    GCell* victory_move = 0);
 
   bool completeVictoryMove4Chain(
     GPlayer player,
     uint depth,
     GBaseStack* defense_variants = 0,
-    GPoint* victory_move = 0);
+    GCell* victory_move = 0);
 
   bool findVictoryMove4Chain(
     GPlayer player,
     const GBaseStack& variants,
     uint depth,
     GBaseStack* defense_variants = 0,
-    GPoint* victory_move = 0);
+    GCell* victory_move = 0);
 
   //Поиск выигрышной цепочки шахов с заданным начальным шахом
   bool findVictoryMove4Chain(
     GPlayer player,
-    const GPoint& move4,
+    const GCell& move4,
     uint depth,
     GBaseStack* defense_variants = 0);
 
   //Вес блокировки шаха противника в цепочке шахов противника
   bool isDefeatBlock5(
     GPlayer player,
-    const GPoint& block,
+    const GCell& block,
     uint depth,
     GBaseStack* defense_variants = 0);
 
   bool findLongOrVictoryMove4Chain(GPlayer player, uint depth);
   bool completeLongOrVictoryMove4Chain(GPlayer player, uint depth);
   bool findLongOrVictoryMove4Chain(GPlayer player, const GBaseStack &variants, uint depth);
-  bool findLongOrVictoryMove4Chain(GPlayer player, const GPoint& move4, uint depth);
-  bool isLongOrDefeatBlock5(GPlayer player, const GPoint &block, uint depth);
-
-  bool findVictoryAttack(GPlayer player, uint depth, GPoint* victory_move = 0);
-  bool findVictoryAttack(GPlayer player, const GBaseStack& variants, uint depth, GPoint* victory_move = 0);
-  bool isVictoryMove(GPlayer player, const GPoint& move, uint depth);
-  bool isVictoryMove4(GPlayer player, const GPoint& move, uint depth);
-  bool isNearVictoryOpen3(GPlayer player, const GPoint &move, uint depth);
-  bool isDefeatMove(GPlayer player, const GPoint& move, uint depth);
-
-  bool findLongAttack(GPlayer player, uint depth, GPoint* move = 0);
-  bool findLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth, GPoint* move = 0);
-  bool findLongAttack(GPlayer player, const GPoint& move, uint depth);
-  bool isLongDefense(GPlayer player, const GPoint& move, uint depth);
-
-  void getChainMoves(GStack<32>& chain_moves);
-  void getChainMoves(GPlayer player, GPoint center, const GVector& v1, GStack<32>& chain_moves);
-  bool isSpace5(GPlayer player, const GPoint& center, const GVector& v1);
-  void getSpace(GPlayer player, GPoint move, const GVector& v1, int& space);
+  bool findLongOrVictoryMove4Chain(GPlayer player, const GCell& move4, uint depth);
+  bool isLongOrDefeatBlock5(GPlayer player, const GCell &block, uint depth);
+
+  //Поиск выигрышной атаки (см. GAttackSearch)
+  bool findVictoryAttack(GPlayer player, uint depth, GCell* victory_move = 0);
+  bool findVictoryAttack(GPlayer player, const GBaseStack& variants, uint depth, GCell* victory_move = 0);
+  bool isVictoryMove(GPlayer player, const GCell& move, uint depth);
+  bool isVictoryMove4(GPlayer player, const GCell& move, uint depth);
+  bool isNearVictoryOpen3(GPlayer player, const GCell &move, uint depth);
+  bool isDefeatMove(GPlayer player, const GCell& move, uint depth);
+
+  //Поиск длинной атаки (см. GAttackSearch)
+  bool findLongAttack(GPlayer player, uint depth, GCell* move = 0);
+  bool findLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth, GCell* move = 0);
+  bool findLongAttack(GPlayer player, const GCell& move, uint depth);
+  //Оценка атакующего хода, сделанного в уме, на нулевой глубине
+  bool isLongAttackLeaf(GPlayer player, bool shah);
+
+  //Ходы цепочки выделяются в арене на текущем уровне (см. m_arena)
+  void getChainMoves(GArenaStack& chain_moves);
+  void getChainMoves(GPlayer player, GCell center, uint dir, bool backward, GBaseStack& chain_moves);
+  bool isSpace5(GPlayer player, const GCell& center, uint dir);
+  void getSpace(GPlayer player, GCell move, uint dir, bool backward, int& space);
 
   GPlayer lastMovePlayer() const;
   GPlayer curPlayer() const;
@@ -275,40 +496,52 @@ protected:
   //за которого в данный момент играет ии
   bool isAiDepth(uint depth) const;
 
-  void addMove5(GPlayer player, const GPoint& move5);
+  void addMove5(GPlayer player, const GCell& move5);
   void removeMove5(GPlayer player);
-  bool isMove5(GPlayer player, const GPoint& move) const;
-  void addMoves4(GPlayer player, const GPoint& move1, const GPoint& move2, GMoveData& source);
-  void undoMoves4(GMoveData& source);
-  bool isDangerMove4(GPlayer player, const GPoint& move) const;
+  bool isMove5(GPlayer player, const GCell& move) const;
+  void addMoves4(GPlayer player, const GCell& move1, const GCell& move2, GStateBackup& source);
+  void undoMoves4(GPlayer player, GStateBackup& source);
+  bool isDangerMove4(GPlayer player, const GCell& move) const;
 
   bool buildLine5();
-  bool buildLine5(const GVector& v1);
+  bool buildLine5(uint dir);
   void undoLine5();
 
   void initMovesWgt();
-  void initWgt(const GLine& line5);
 
-  void addWgt(const GPoint& p, GPlayer player, int wgt_delta);
+  void addWgt(const GCell& p, GPlayer player, int wgt_delta);
 
   void updateRelatedMovesState();
-  void updateRelatedMovesState(const GVector& v1);
-  void updateOpen3(const GVector& v1);
-  void updateOpen3_Xxx(const GPoint& p3, const GVector& v1);
-  void updateOpen3_X_xx(const GPoint& p5, const GVector& v1);
-  void updateOpen3_xXx(const GPoint& p2, const GVector& v1);
-  void updateOpen3_Xx_x(const GPoint& p3, const GVector& v1);
-  void addOpen3(const GPoint& move);
-  void undoOpen3(GMoveData& moveData);
-  bool isDangerOpen3(GPlayer player, const GPoint& move, GBaseStack* defense_variants = 0);
+  void updateRelatedMovesState(uint dir);
+  void updateOpen3(GOffset v1);
+  void updateOpen3_Xxx(const GCell& p3, GOffset v1);
+  void updateOpen3_X_xx(const GCell& p5, GOffset v1);
+  void updateOpen3_xXx(const GCell& p2, GOffset v1);
+  void updateOpen3_Xx_x(const GCell& p3, GOffset v1);
+  void addOpen3(const GCell& move);
+  void undoOpen3(GPlayer player, GStateBackup& source);
+  bool isDangerOpen3(GPlayer player, const GCell& move, GBaseStack* defense_variants = 0);
   bool isDangerOpen3(GBaseStack* defense_variants = 0);
-  bool isMate(GPlayer player, const GPoint& move);
+
+  //Виды проверок, результаты которых запоминаются в m_memo
+  enum GMemoCheck : std::uint8_t
+  {
+    G_MEMO_LONG_CHAIN,   //findLongOrVictoryMove4Chain по всем шахам игрока
+    G_MEMO_DANGER_OPEN3  //isDangerOpen3 последнего хода
+  };
+
+  //Ключ результата проверки: хэш позиции и параметры проверки
+  std::uint64_t memoKey(GMemoCheck check, uint params) const
+  {
+    return m_hash ^ ((std::uint64_t(check) << 32 | params) + 1) * 0x9e3779b97f4a7c15ull;
+  }
+  bool isMate(GPlayer player, const GCell& move);
   bool isMate();
   bool isShah(GPlayer player);
 
-  void backupRelatedMovesState(const GVector& v1, uint& related_moves_iter);
+  void backupRelatedMovesState(uint dir, bool backward, uint& related_moves_iter);
   void restoreRelatedMovesState();
-  void restoreRelatedMovesState(const GVector& v1, uint& related_moves_iter);
+  void restoreRelatedMovesState(uint dir, bool backward, uint& related_moves_iter);
 
   int getFirstLineMoveWgt();
   int getFurtherMoveWgt(int line_len);
@@ -320,20 +553,32 @@ protected:
     return getAiLevel() * 2;
   }
 
-  int getStoredWgt(GPlayer player, const GPoint& move)
+  int getStoredWgt(GPlayer player, const GCell& move)
+  {
+    assert(get(move) != !player);
+    return m_wgt[player][move];
+  }
+
+  GStateBackup& backup(const GCell& move)
+  {
+    return m_backup[move];
+  }
+
+  const GStateBackup& backup(const GCell& move) const
   {
-    assert(get(move).player != !player);
-    return get(move).wgt[player];
+    return m_backup[move];
   }
 
   int maxStoredWgt();
 
+  //Заполняет индекс вариантов кандидатами, а если живых ячеек рядом с камнями нет - всеми живыми ячейками
+  void assignVariants(GVariantsIndex& variants_index) const;
   void sortVariantsByWgt(GPlayer player, GVariantsIndex& variants_index);
   void sortMaxN(GPlayer player, GVariantsIndex& variants_index, uint n);
 
-  bool cmpVariants(GPlayer player, const GPoint& variant1, const GPoint& variant2);
+  bool cmpVariants(GPlayer player, const GCell& variant1, const GCell& variant2);
 
-  static GPoint randomMove(const GBaseStack& moves);
+  static GCell randomMove(const GBaseStack& moves);
 
 protected:
   static const int WGT_VICTORY     = 1000000;
@@ -372,7 +617,7 @@ protected:
       return m_variants[depth - 1].m_cur_index;
     }
 
-    const GPoint& getMove(uint depth, uint index)
+    const GCell& getMove(uint depth, uint index)
     {
       assert(depth > 0 && depth <= Depth);
       assert(index < MaxWgtChildrenCount);
@@ -395,14 +640,14 @@ protected:
     {
       if (m_cur_depth == Depth)
         return setWgt(curStoredWgt() - m_g->maxStoredWgt());
-      else if (!m_g->isEmptyCell(getMove(m_cur_depth + 1, 0))) //все клетки заняты
+      else if (m_g->m_candidates.cells().empty()) //все клетки заняты
         return setWgt(curStoredWgt());
       return firstChild();
     }
 
     bool nextBrother()
     {
-      if (++curIndex() == MaxWgtChildrenCount || !m_g->isEmptyCell(curMove()))
+      if (++curIndex() == MaxWgtChildrenCount || curIndex() == curVariants().size())
         return nextParent(curMaxWgt());
       undo();
       doMove();
@@ -451,7 +696,7 @@ protected:
       return m_g->getStoredWgt(m_g->lastMovePlayer(), curMove());
     }
 
-    GPoint best()
+    GCell best()
     {
       assert(!m_maxwgt_moves.empty());
       return m_maxwgt_moves[random(0, m_maxwgt_moves.size())];
@@ -479,7 +724,7 @@ protected:
       return curVariants().m_cur_index;
     }
 
-    const GPoint& curMove() const
+    const GCell& curMove() const
     {
       assert(curDepth() > 0 && curDepth() <= Depth);
       const GVariants& variants = m_variants[curDepth() - 1];
@@ -504,7 +749,7 @@ protected:
     bool firstChild()
     {
       assert(m_cur_depth < Depth);
-      assert(m_g->isEmptyCell(getMove(m_cur_depth + 1, 0)));
+      assert(!m_g->m_candidates.cells().empty());
 
       ++m_cur_depth;
       sortCurVariants();
@@ -532,25 +777,281 @@ protected:
     GStack<MaxWgtChildrenCount> m_maxwgt_moves;
   };
 
-protected:
-  static const GVector vecs1[];  //{1, 0}, {1, 1}, {0, 1}, {-1, 1}
+  static constexpr uint MAX_ATTACK_DEPTH = getMaxAiLevel() * 2;
+
+public:
+  //Поиск выигрышной или длинной атаки без рекурсии.
+  //Состояние поиска хранится в явном стеке кадров, поэтому поиск можно выполнять по частям (см. step)
+  //и прерывать (см. cancel). Пока поиск не завершен, на поле остаются ходы, сделанные в уме,
+  //поэтому между шагами нельзя менять позицию.
+  //Поиск цепочек шахов и защит от полушаха, которые ведут только к вынужденным ответам,
+  //выполняется внутри одного шага как проверка (см. step).
+  class GAttackSearch
+  {
+  public:
+    GAttackSearch(Gomoku* g) : m_g(g)
+    {
+      assert(g);
+    }
+
+    DELETE_COPY(GAttackSearch)
+
+    ~GAttackSearch()
+    {
+      cancel();
+    }
+
+    //Выигрышная атака игрока player глубины depth (см. findVictoryAttack)
+    void startVictoryAttack(GPlayer player, uint depth);
+
+    //Длинная атака игрока player глубины depth (см. findLongAttack)
+    void startLongAttack(GPlayer player, uint depth);
 
+    //Выигрышная атака одним из ходов attack_moves: сначала шахи, затем полушахи.
+    //Список должен оставаться неизменным до завершения поиска.
+    void startVictoryAttack(GPlayer player, const GBaseStack& attack_moves, uint depth);
+
+    //Выигрышный шах, выигрышный полушах (см. isVictoryMove4, isNearVictoryOpen3)
+    //и проигрышная защита от атаки (см. isDefeatMove) заданным ходом
+    void startVictoryMove4(GPlayer player, const GCell& move, uint depth);
+    void startNearVictoryOpen3(GPlayer player, const GCell& move, uint depth);
+    void startDefeatMove(GPlayer player, const GCell& move, uint depth);
+
+    //Длинная атака одним из ходов attack_moves, которые перебираются с конца.
+    //Список должен оставаться неизменным до завершения поиска.
+    void startLongAttack(GPlayer player, const GBaseStack& attack_moves, uint depth);
+
+    //Длинная атака заданным ходом
+    void startLongAttack(GPlayer player, const GCell& move, uint depth);
+
+    //Выполняет шаги поиска, пока число шагов вместе с ходами в уме (см. m_node_count) меньше budget,
+    //возвращает true, если поиск завершен. Шаг выполняется целиком, поэтому бюджет может быть превышен
+    //на ходы одной проверки шага: поиска цепочки шахов глубины не больше maxAttackDepth() или защит от полушаха
+    bool step(uint budget);
+
+    //Выполняет поиск до завершения и возвращает результат.
+    //Поиск, отмененный признаком отмены поля (см. m_cancel), прерывается и возвращает false
+    bool run();
+
+    bool isFinished() const
+    {
+      return m_frame_count == 0;
+    }
+
+    bool result() const
+    {
+      assert(isFinished());
+      return m_result;
+    }
+
+    //Начальный ход найденной атаки (для поиска по списку ходов)
+    const GCell& move() const
+    {
+      assert(isFinished() && m_result);
+      return m_move;
+    }
+
+    //Прерывает поиск и откатывает ходы, сделанные в уме
+    void cancel();
+
+  protected:
+    enum GFrameKind : std::uint8_t
+    {
+      G_ATTACK_LIST,    //перебор ходов длинной атаки
+      G_ATTACK_MOVE,    //ход длинной атаки (шах или полушах)
+      G_DEFENSE,        //защитный ход противника против длинной атаки
+      G_VICTORY_LIST,   //перебор ходов выигрышной атаки (findVictoryAttack)
+      G_VICTORY_MOVE4,  //шах выигрышной атаки (isVictoryMove4)
+      G_VICTORY_OPEN3,  //полушах выигрышной атаки (isNearVictoryOpen3)
+      G_DEFEAT          //защитный ход противника против выигрышной атаки (isDefeatMove)
+    };
+
+    enum GFramePhase : std::uint8_t
+    {
+      G_START,
+      G_WAIT_CHILD,   //ожидание результата единственного дочернего кадра
+      G_NEXT_CHILD    //перебор дочерних кадров
+    };
+
+    struct GFrame
+    {
+      GFrameKind kind;
+      GFramePhase phase;
+      GPlayer player;
+      bool made;  //ход кадра сделан в уме
+      bool logged;  //кадр записан в журнал поиска
+      bool open3;   //перебор выигрышной атаки перешел к полушахам
+      bool cached;  //результат кадра запоминается в таблице угроз (см. m_threat_table)
+      bool long_attack_possible;  //признак возможной длинной атаки родительского поиска
+      uint depth;
+      GCell move;
+      const GBaseStack* list; //внешний список ходов, если 0 - используется moves
+      GArenaStack moves;      //ходы цепочки или защиты от полушаха, в арене на уровне хода кадра или родителя
+      uint iter;
+      uint shift;             //сдвиг начала перебора выигрышной атаки (см. m_search_order)
+      std::uint64_t key;      //ключ таблицы угроз
+
+      const GBaseStack& variants() const
+      {
+        return list ? *list : moves;
+      }
+    };
+
+    //Максимальная глубина стека: на каждом уровне перебор атак, атака и защита
+    static constexpr uint MAX_FRAMES = 3 * (MAX_ATTACK_DEPTH + 1);
+
+    //Число шагов поиска между проверками отмены
+    static const uint CANCEL_CHECK_STEPS = 64;
+
+    GFrame& push(GFrameKind kind, GPlayer player, uint depth, const GCell& move = GCell());
+    void finish(bool result);
+    void doMove(GFrame& frame);
+
+    void stepAttackList(GFrame& frame);
+    void stepAttackMove(GFrame& frame);
+    void stepDefense(GFrame& frame);
+
+    void stepVictoryList(GFrame& frame);
+    void stepVictoryMove4(GFrame& frame);
+    void stepVictoryOpen3(GFrame& frame);
+    void stepDefeat(GFrame& frame);
+    void finishDefeat(GFrame& frame, bool result);
+
+  protected:
+    Gomoku* m_g;
+
+    GFrame m_frames[MAX_FRAMES];
+
+    uint m_frame_count = 0;
+
+    //результат последнего завершенного кадра
+    bool m_result = false;
+
+    GCell m_move;
+  };
+
+protected:
   uint m_ai_level;
 
   GLine m_line5;
 
+  //для каждой свободной ячейки хранится вес хода каждого игрока
+  //который отражает изменение веса ситуации для игрока при реализации этого хода
+  //вес ситуации для игрока равен разнице между весом линий игрока и весом линий противника
+  GWgtGrid m_wgt[2];
+
+  //данные для отката каждого реализованного хода
+  GBackupGrid m_backup;
+
   GPointStack m_moves5[2];
+  //Число незанятых ячеек m_moves5 (ход 5 есть, если число больше нуля)
+  uint m_open_moves5[2] = {};
 
   TGridStack<GDangerMoveData> m_danger_moves[2];
 
+  //Пустые ячейки вблизи занятых, среди которых выбираются ходы
+  GGridSet m_candidates;
+
+  //Число занятых ячеек в окрестности каждой ячейки
+  TGrid<std::uint8_t> m_neighbours;
+
+  //Место ячейки хода в списке кандидатов до хода (см. GGridSet::remove)
+  TGrid<std::uint8_t> m_candidate_pos;
+
+  //Место кандидата, ставшего мертвым, в списке кандидатов до хода и число ходов на поле после этого хода.
+  //Ячейка умирает не больше одного раза, пока ход, который ее убил, не откачен
+  TGrid<std::uint8_t> m_dead_candidate_pos;
+  TGrid<std::uint8_t> m_dead_candidate_move;
+  //Направления линий, на которых ход убил окна (бит направления), только в них могут умереть кандидаты
+  TGrid<std::uint8_t> m_dead_dirs;
+
   GVariantsIndex m_variants_index[2];
 
+  //Варианты, отсортированные по весу в позиции с хэшем hash (см. sortVariantsByWgt).
+  //Порядок зависит только от позиции и весов, поэтому сбрасывается при смене весов
+  struct GSortedVariants
+  {
+    bool valid = false;
+    std::uint64_t hash = 0;
+    GVariantsIndex index;
+  };
+  GSortedVariants m_sorted_variants[2];
+
   //При неудачном поиске выигрышной атаки определяем,
   //возможна ли длинная атака
   //false - длинной атаки нет, можно не искать
   //true - длинная атака возможна
   bool m_long_attack_possible;
 
+  //Этап подбора хода, на котором найден ход последней подсказки
+  GHintKind m_hint_kind = G_HINT_NONE;
+
+  //Контекст поиска для подсказок (см. hint). При удалении поля возвращается в пул контекстов потока,
+  //поэтому поле с подсказками не должно удаляться после завершения потока (например, статическим объектом)
+  std::unique_ptr<Gomoku> m_search_context;
+
+  //Параметры оценки ходов
+  GWeights m_weights;
+
+  uint m_candidate_radius = CANDIDATE_RADIUS;
+
+  GTrace* m_trace = nullptr;
+
+  GSearchLog* m_search_log = nullptr;
+
+  uint m_search_threads = 1;
+  //Пул потоков поиска, создается при первом поиске с несколькими потоками
+  std::unique_ptr<GParallelSearch> m_parallel;
+
+  bool m_hint_race = false;
+  //Копии поля для одновременных этапов подсказки, создаются при первой подсказке в этом режиме
+  std::unique_ptr<GPhaseRace> m_race;
+
+  bool m_lazy_smp = false;
+  std::unique_ptr<GLazySmp> m_lazy;
+
+  const GBook* m_book = nullptr;
+
+  //Хэш позиции (см. GGeometry::zobrist)
+  std::uint64_t m_hash = 0;
+
+  //Число камней каждого игрока в каждом окне (линии 5, см. GGeometry::window),
+  //обновляется при установке и снятии камня
+  std::uint8_t m_window_stones[GGeometry::WINDOW_COUNT][2] = {};
+
+  //Число мертвых окон, содержащих камни обоих игроков (все окна мертвы - ничья)
+  uint m_dead_windows = 0;
+
+  //Для каждого игрока число живых для него окон (без камней противника), содержащих ячейку
+  TGrid<std::uint8_t> m_live_windows[2];
+
+  //Результаты проверок безопасности, которые циклы подсказки повторяют для одних и тех же позиций.
+  //Записи не очищаются в конце подсказки, а сохраняются между подсказками контекста поиска:
+  //ключ включает хэш позиции, игрока и глубину проверки (см. memoKey), а сами проверки зависят только от камней,
+  //поэтому запись остается верной в любой позиции с тем же хэшем, в том числе после отката ходов
+  //и смены радиуса кандидатов. Размер таблицы фиксирован, прежние записи вытесняются новыми.
+  //Таблица очищается при смене уровня ии или весов
+  GHintMemo m_memo;
+
+  //Временные данные поиска, уровни арены соответствуют ходам в уме (см. doInMind)
+  GStackArena m_arena;
+
+  //Общая таблица результатов isDefeatMove потоков ленивого параллельного поиска (nullptr - без таблицы)
+  GThreatTable* m_threat_table = nullptr;
+
+  //Номер потока ленивого параллельного поиска, задает сдвиг порядка перебора атак и начальной глубины
+  uint m_search_order = 0;
+
+  //Признак отмены поиска, который выполняет поле (см. GParallelSearch, GPhaseRace, GLazySmp)
+  const std::atomic<bool>* m_cancel = nullptr;
+
+  //Срок подбора хода (см. hintInTime), по истечении которого поиск отменяется так же, как по m_cancel.
+  //Передается копиям поля вместе с позицией (см. copyFrom)
+  const GDeadline* m_deadline = nullptr;
+
+  //Число ходов в уме, сделанных полем, - объем выполненного поиска
+  std::uint64_t m_node_count = 0;
+
 protected:
   decltype(m_danger_moves[G_BLACK]) dangerMoves(GPlayer player)
   {
@@ -565,7 +1066,7 @@ public:
   GMoveMaker() : m_g(0)
   {}
 
-  GMoveMaker(Gomoku* g, GPlayer player, const GPoint& move) : m_g(0)
+  GMoveMaker(Gomoku* g, GPlayer player, const GCell& move) : m_g(0)
   {
     doMove(g, player, move);
   }
@@ -576,7 +1077,7 @@ public:
       m_g->undoInMind();
   }
 
-  void doMove(Gomoku* g, GPlayer player, const GPoint& move)
+  void doMove(Gomoku* g, GPlayer player, const GCell& move)
   {
     assert(!m_g);
     m_g = g;
@@ -597,11 +1098,12 @@ public:
     assert(g);
     for (; ; )
     {
-      const auto& last_move_data = m_g->get(m_g->lastCell());
-      if (last_move_data.m_moves5_count != 1)
+      const GCell& last_move = m_g->lastCell();
+      if (m_g->backup(last_move).m_moves5_count != 1)
         break;
-      const GPoint& block = m_g->m_moves5[last_move_data.player].lastCell();
-      m_g->doInMind(block, !last_move_data.player);
+      GPlayer last_player = m_g->get(last_move);
+      const GCell& block = m_g->m_moves5[last_player].lastCell();
+      m_g->doInMind(block, !last_player);
       ++m_counter;
     }
   }
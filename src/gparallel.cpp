@@ -0,0 +1,531 @@
+#include "gparallel.h"
+#include <algorithm>
+
+namespace nsg
+{
+
+GParallelSearch::GParallelSearch(uint thread_count)
+{
+  assert(thread_count > 0);
+  for (uint i = 0; i < thread_count; ++i)
+  {
+    m_workers.push_back(std::make_unique<GWorker>());
+    m_workers.back()->g = std::make_unique<Gomoku>();
+  }
+  for (uint i = 0; i < thread_count; ++i)
+    m_workers[i]->thread = std::thread(&GParallelSearch::work, this, i);
+}
+
+GParallelSearch::~GParallelSearch()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_work_ready.notify_all();
+  for (auto& worker: m_workers)
+    worker->thread.join();
+}
+
+bool GParallelSearch::findLongAttack(const Gomoku& root, GPlayer player, const GBaseStack& attack_moves, uint depth, GCell* move)
+{
+  GNode node;
+  node.kind = G_LONG_LIST;
+  node.player = player;
+  node.depth = depth;
+  for (const GCell& attack_move: attack_moves)
+    node.moves.push() = attack_move;
+
+  if (!search(root, node))
+    return false;
+  if (move)
+    *move = node.children[node.decisive]->move;
+  return true;
+}
+
+bool GParallelSearch::findVictoryAttack(const Gomoku& root, GPlayer player, const GBaseStack& attack_moves, uint depth,
+                                        GCell* move, bool& long_attack_possible)
+{
+  GNode node;
+  node.kind = G_VICTORY_LIST;
+  node.player = player;
+  node.depth = depth;
+  for (const GCell& attack_move: attack_moves)
+    node.moves.push() = attack_move;
+
+  bool result = search(root, node);
+  long_attack_possible = node.long_attack_possible;
+  if (result && move)
+    *move = node.children[node.decisive]->move;
+  return result;
+}
+
+bool GParallelSearch::search(const Gomoku& root, GNode& node)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_root = &root;
+  ++m_generation;
+  ++m_active;
+  push(0, &node);
+  //Отмененные задачи могут выполняться и после завершения корня, а они используют корневую позицию
+  m_done.wait(lock, [this, &node]{ return node.resolved && m_active == 0; });
+  m_root = nullptr;
+  return node.result;
+}
+
+void GParallelSearch::work(uint index)
+{
+  for (; ; )
+  {
+    if (GNode* node = take(index))
+    {
+      execute(index, *node);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_work_ready.wait(lock, [this]{ return m_stop || m_queued > 0; });
+    if (m_stop)
+      return;
+  }
+}
+
+GParallelSearch::GNode* GParallelSearch::take(uint index)
+{
+  //Своя очередь обрабатывается с конца (в глубину), чужие - с начала (крупные задачи)
+  {
+    GWorker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty())
+    {
+      GNode* node = worker.tasks.back();
+      worker.tasks.pop_back();
+      --m_queued;
+      return node;
+    }
+  }
+  for (uint i = 1; i < m_workers.size(); ++i)
+  {
+    GWorker& victim = *m_workers[(index + i) % m_workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      GNode* node = victim.tasks.front();
+      victim.tasks.pop_front();
+      --m_queued;
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+void GParallelSearch::push(uint index, GNode* node)
+{
+  {
+    GWorker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(node);
+  }
+  ++m_queued;
+  m_work_ready.notify_one();
+}
+
+void GParallelSearch::execute(uint index, GNode& node)
+{
+  GWorker& worker = *m_workers[index];
+  std::vector<std::unique_ptr<GNode>> children;
+  bool result = false;
+  bool flag = false;
+  if (!node.cancelled)
+  {
+    Gomoku& g = *worker.g;
+    if (worker.generation != m_generation)
+    {
+      g.copyFrom(*m_root);
+      //Запомненные результаты прежнего поиска на этом поле не переиспользуются
+      g.m_memo.clear();
+      worker.generation = m_generation;
+    }
+    for (const auto& [move, player]: node.path)
+      g.doInMind(move, player);
+    //Признак возможной длинной атаки может установить как последовательный поиск, так и разбор хода узла
+    g.m_cancel = &node.cancelled;
+    g.m_long_attack_possible = false;
+    run(g, node, children, result);
+    flag = g.m_long_attack_possible;
+    g.m_cancel = nullptr;
+    for (uint i = 0; i < node.path.size(); ++i)
+      g.undoInMind();
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (children.empty())
+    resolve(node, result, flag);
+  else
+  {
+    node.long_attack_possible = flag;
+    addChildren(index, node, children);
+  }
+  if (--m_active == 0)
+    m_done.notify_all();
+}
+
+void GParallelSearch::run(Gomoku& g, GNode& node, std::vector<std::unique_ptr<GNode>>& children, bool& result)
+{
+  const GPlayer player = node.player;
+  const uint depth = node.depth;
+  const GCell& move = node.move;
+
+  //Последовательный поиск длинной атаки, прерываемый отменой узла (см. Gomoku::m_cancel)
+  auto runLongAttack = [&g, &node](bool list)
+  {
+    Gomoku::GAttackSearch search(&g);
+    if (list)
+      search.startLongAttack(node.player, node.moves, node.depth);
+    else
+      search.startLongAttack(node.player, node.move, node.depth);
+    return search.run();
+  };
+
+  switch (node.kind)
+  {
+  case G_LONG_LIST:
+    if (node.level >= SPLIT_LEVEL)
+    {
+      result = runLongAttack(true);
+      return;
+    }
+    for (const GCell* attack_move = node.moves.end(); attack_move != node.moves.begin(); )
+    {
+      --attack_move;
+      children.push_back(makeChild(node, G_LONG_ATTACK, player, depth, *attack_move));
+    }
+    return;
+
+  case G_LONG_ATTACK:
+  {
+    if (node.level >= SPLIT_LEVEL || depth == 0)
+    {
+      result = runLongAttack(false);
+      return;
+    }
+    //Разбор хода повторяет Gomoku::GAttackSearch::stepAttackMove
+    if (!g.isEmptyCell(move))
+      return;
+    const auto& danger_move_data = g.dangerMoves(player).get(move);
+    const uint moves5_count = danger_move_data.m_open_moves5;
+    if (moves5_count >= 2)  //мат
+    {
+      result = true;
+      return;
+    }
+    if (moves5_count == 0 && !danger_move_data.m_open3)
+      return;
+    GMoveMaker gmm(&g, player, move);
+    if (moves5_count == 1)  //шах
+    {
+      children.push_back(makeChild(node, G_LONG_DEFENSE, !player, depth, g.m_moves5[player].lastCell()));
+      return;
+    }
+    GStack<32> defense_variants;
+    if (!g.isDangerOpen3(&defense_variants))
+      return;
+    if (g.findLongOrVictoryMove4Chain(!player, g.maxAttackDepth()))
+      return;
+    node.is_and = true;
+    for (const GCell& defense: defense_variants)
+      children.push_back(makeChild(node, G_LONG_DEFENSE, !player, depth, defense));
+    //Защит нет - атака удалась
+    result = true;
+    return;
+  }
+
+  case G_LONG_DEFENSE:
+  {
+    //Разбор хода повторяет Gomoku::GAttackSearch::stepDefense
+    assert(depth > 0);
+    GMoveMaker gmm(&g, player, move);
+    const GStateBackup& md = g.backup(move);
+    if (md.m_moves5_count > 1)  //контрмат
+      return;
+    if (md.m_moves5_count == 1)  //контршах
+    {
+      children.push_back(makeChild(node, G_LONG_ATTACK, !player, depth - 1, g.m_moves5[player].lastCell()));
+      return;
+    }
+    GArenaStack chain_moves;
+    g.getChainMoves(chain_moves);
+    auto child = makeChild(node, G_LONG_LIST, !player, depth - 1, move);
+    for (const GCell& chain_move: chain_moves)
+      child->moves.push() = chain_move;
+    children.push_back(std::move(child));
+    return;
+  }
+
+  case G_VICTORY_LIST:
+    //Порядок перебора повторяет Gomoku::GAttackSearch::stepVictoryList: сначала шахи, затем полушахи
+    for (const GCell* attack_move = node.moves.end(); attack_move != node.moves.begin(); )
+    {
+      --attack_move;
+      children.push_back(makeChild(node, G_VICTORY_MOVE4, player, depth, *attack_move));
+    }
+    if (depth > 0)
+    {
+      for (const GCell* attack_move = node.moves.end(); attack_move != node.moves.begin(); )
+      {
+        --attack_move;
+        children.push_back(makeChild(node, G_VICTORY_OPEN3, player, depth, *attack_move));
+      }
+    }
+    return;
+
+  case G_VICTORY_MOVE4:
+    result = g.isVictoryMove4(player, move, depth);
+    return;
+
+  case G_VICTORY_OPEN3:
+  {
+    if (node.level >= SPLIT_LEVEL)
+    {
+      result = g.isNearVictoryOpen3(player, move, depth);
+      return;
+    }
+    //Разбор хода повторяет Gomoku::GAttackSearch::stepVictoryOpen3
+    if (depth == 0 || !g.isEmptyCell(move))
+      return;
+    if (!g.dangerMoves(player).get(move).m_open3 || g.isDangerMove4(player, move))
+      return;
+    GMoveMaker gmm(&g, player, move);
+    GStack<4> defense_variants;
+    if (!g.isDangerOpen3(&defense_variants))
+      return;
+    if (g.findLongOrVictoryMove4Chain(!player, g.maxAttackDepth()))
+      return;
+    node.is_and = true;
+    for (const GCell& defense: defense_variants)
+      children.push_back(makeChild(node, G_DEFEAT, !player, depth, defense));
+    result = true;
+    return;
+  }
+
+  case G_DEFEAT:
+    result = g.isDefeatMove(player, move, depth);
+    return;
+  }
+}
+
+std::unique_ptr<GParallelSearch::GNode> GParallelSearch::makeChild(GNode& node, GNodeKind kind, GPlayer player, uint depth, const GCell& move)
+{
+  auto child = std::make_unique<GNode>();
+  child->kind = kind;
+  child->player = player;
+  child->depth = depth;
+  child->move = move;
+  child->path = node.path;
+  //Потомки перебора ходов строятся в позиции узла, остальные - после хода узла
+  if (node.kind != G_LONG_LIST && node.kind != G_VICTORY_LIST)
+    child->path.emplace_back(node.move, node.player);
+  child->parent = &node;
+  child->level = node.level + 1;
+  return child;
+}
+
+void GParallelSearch::addChildren(uint index, GNode& node, std::vector<std::unique_ptr<GNode>>& children)
+{
+  uint count = (uint)children.size();
+  node.children = std::move(children);
+  node.results.assign(count, G_PENDING);
+  node.flags.assign(count, false);
+  //Первый в порядке перебора потомок кладется в конец очереди и выполняется этим же потоком первым
+  for (uint i = count; i > 0; --i)
+  {
+    GNode& child = *node.children[i - 1];
+    child.index = i - 1;
+    child.cancelled = node.cancelled.load();
+    ++m_active;
+    push(index, &child);
+  }
+}
+
+void GParallelSearch::resolve(GNode& node, bool result, bool flag)
+{
+  assert(!node.resolved);
+  node.resolved = true;
+  node.result = result;
+  //Выигрышная атака глубины 0 без мата оставляет возможность длинной атаки (см. Gomoku::GAttackSearch::stepVictoryList)
+  node.long_attack_possible = flag || (node.kind == G_VICTORY_LIST && !result && node.depth == 0);
+  if (node.parent)
+    childDone(*node.parent, node.index, node.result, node.long_attack_possible);
+}
+
+void GParallelSearch::childDone(GNode& node, uint index, bool result, bool flag)
+{
+  if (node.resolved)
+    return;
+  node.results[index] = result ? G_TRUE : G_FALSE;
+  node.flags[index] = flag;
+
+  //Решающий результат: удачная атака для узла ИЛИ, удачная защита для узла И
+  bool decisive_result = !node.is_and;
+  uint count = (uint)node.children.size();
+  if (result == decisive_result && index < node.decisive)
+  {
+    node.decisive = index;
+    for (uint i = index + 1; i < count; ++i)
+      cancel(*node.children[i]);
+  }
+
+  //Узел завершается, когда известны результаты всех потомков до решающего
+  uint last = std::min(node.decisive, count - 1);
+  //Разбор хода узла предшествует перебору потомков
+  bool long_attack_possible = node.long_attack_possible;
+  for (uint i = 0; i <= last; ++i)
+  {
+    if (node.results[i] == G_PENDING)
+      return;
+    long_attack_possible = long_attack_possible || node.flags[i];
+  }
+  resolve(node, node.decisive < count ? decisive_result : !decisive_result, long_attack_possible);
+}
+
+void GParallelSearch::cancel(GNode& node)
+{
+  if (node.cancelled)
+    return;
+  node.cancelled = true;
+  for (auto& child: node.children)
+    cancel(*child);
+}
+
+bool GPhaseRace::run(Gomoku& g, GPlayer player, const GCell* begin, const GCell* end, GCell& move)
+{
+  m_variants.assign(begin, end);
+  //Копии синхронизируются до запуска поиска на поле g, поскольку поиск меняет поле ходами в уме
+  for (uint i = 0; i < G_RACER_COUNT; ++i)
+  {
+    GRacer& racer = m_racers[i];
+    racer.g.copyFrom(g);
+    racer.g.m_trace = g.m_trace;
+    racer.g.m_cancel = &racer.cancelled;
+    racer.cancelled = false;
+    racer.thread = std::thread(&GPhaseRace::race, this, GRacerKind(i), player);
+  }
+
+  bool found;
+  {
+    GTraceScope scope(g.m_trace, "victoryMove4Chain");
+    found = g.hintVictoryMove4Chain(player, move);
+  }
+  GHintKind kind = G_HINT_VICTORY_MOVE4_CHAIN;
+  if (found)
+    cancel(0);
+
+  static const GHintKind kinds[G_RACER_COUNT] = {G_HINT_VICTORY_ATTACK, G_HINT_LONG_ATTACK, G_HINT_POSITIONAL};
+  for (uint i = 0; i < G_RACER_COUNT; ++i)
+  {
+    GRacer& racer = m_racers[i];
+    racer.thread.join();
+    racer.g.m_cancel = nullptr;
+    racer.g.m_memo.clear();
+    //результат отмененного этапа не нужен и может быть неверным
+    if (racer.cancelled)
+      continue;
+    if (racer.found)
+    {
+      found = true;
+      kind = kinds[i];
+      move = racer.move;
+      cancel(i + 1);
+    }
+    //Последовательный подбор не ищет длинную атаку, если ее исключил поиск выигрышной атаки
+    else if (i == G_VICTORY_ATTACK && !racer.long_attack_possible)
+      m_racers[G_LONG_ATTACK].cancelled = true;
+  }
+  if (found)
+    g.m_hint_kind = kind;
+  return found;
+}
+
+void GPhaseRace::race(GRacerKind kind, GPlayer player)
+{
+  GRacer& racer = m_racers[kind];
+  Gomoku& g = racer.g;
+  switch (kind)
+  {
+  case G_VICTORY_ATTACK:
+  {
+    GTraceScope scope(g.m_trace, "victoryAttack");
+    racer.found = g.hintVictoryAttack(player, racer.move);
+    racer.long_attack_possible = g.m_long_attack_possible;
+    break;
+  }
+  case G_LONG_ATTACK:
+  {
+    GTraceScope scope(g.m_trace, "longAttack");
+    racer.found = g.hintLongAttack(player, racer.move);
+    break;
+  }
+  case G_DEFENSE_VARIANT:
+  {
+    GTraceScope scope(g.m_trace, "defenseVariants");
+    racer.move = g.hintDefenseVariant(player, m_variants.data(), m_variants.data() + m_variants.size());
+    racer.found = g.isValidCell(racer.move);
+    break;
+  }
+  default:
+    assert(false);
+  }
+}
+
+void GPhaseRace::cancel(uint from)
+{
+  for (uint i = from; i < G_RACER_COUNT; ++i)
+    m_racers[i].cancelled = true;
+}
+
+GLazySmp::GLazySmp(uint thread_count)
+{
+  assert(thread_count > 0);
+  for (uint i = 0; i < thread_count; ++i)
+    m_helpers.push_back(std::make_unique<GHelper>());
+}
+
+GCell GLazySmp::hint(Gomoku& g, GPlayer player)
+{
+  //Результаты поиска зависят от уровня ии, поэтому таблица заполняется заново для каждой подсказки
+  m_table.clear();
+  m_stop = false;
+  m_winner = -1;
+  for (uint i = 0; i < m_helpers.size(); ++i)
+  {
+    Gomoku& helper = m_helpers[i]->g;
+    helper.copyFrom(g);
+    helper.m_trace = g.m_trace;
+    helper.m_threat_table = &m_table;
+    helper.m_search_order = i;
+    helper.m_cancel = &m_stop;
+  }
+  for (uint i = 0; i < m_helpers.size(); ++i)
+    m_helpers[i]->thread = std::thread(&GLazySmp::search, this, i, player);
+  for (auto& helper: m_helpers)
+  {
+    helper->thread.join();
+    helper->g.m_memo.clear();
+  }
+
+  const GHelper& winner = *m_helpers[m_winner];
+  g.m_hint_kind = winner.g.m_hint_kind;
+  return winner.move;
+}
+
+void GLazySmp::search(uint index, GPlayer player)
+{
+  GHelper& helper = *m_helpers[index];
+  GTraceScope scope(helper.g.m_trace, "lazySmp", "order", (int)index);
+  helper.move = helper.g.hintImpl(player);
+  //Первый завершившийся поток отменяет остальные
+  int none = -1;
+  if (m_winner.compare_exchange_strong(none, (int)index))
+    m_stop = true;
+}
+
+} //namespace nsg
@@ -0,0 +1,226 @@
+#ifndef GPARALLEL_H
+#define GPARALLEL_H
+
+#include "gomoku.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nsg
+{
+
+//Параллельный поиск выигрышной и длинной атаки.
+//Верхние уровни дерева поиска разбиваются на задачи:
+//перебор атакующих ходов - узел ИЛИ (атака удалась, если удалась одна из атак),
+//защиты от полушаха - узел И (атака удалась, если не помогла ни одна из защит).
+//Каждый рабочий поток ведет свою копию поля и свою очередь задач:
+//новые задачи поток берет с конца своей очереди, а при пустой очереди забирает задачи из начала чужих очередей.
+//
+//Узел завершается по первому в порядке перебора решающему потомку (удачной атаке для ИЛИ, удачной защите для И),
+//потомки после него отменяются, а потомки до него досчитываются.
+//Поэтому результат, найденный ход и признак возможной длинной атаки совпадают с последовательным поиском.
+class GParallelSearch
+{
+public:
+  explicit GParallelSearch(uint thread_count);
+
+  DELETE_COPY(GParallelSearch)
+
+  ~GParallelSearch();
+
+  uint threadCount() const
+  {
+    return (uint)m_workers.size();
+  }
+
+  //См. Gomoku::findLongAttack. Позиция root не должна меняться до завершения поиска
+  bool findLongAttack(const Gomoku& root, GPlayer player, const GBaseStack& attack_moves, uint depth, GCell* move);
+
+  //См. Gomoku::findVictoryAttack. long_attack_possible принимает значение последовательного поиска
+  bool findVictoryAttack(const Gomoku& root, GPlayer player, const GBaseStack& attack_moves, uint depth,
+                         GCell* move, bool& long_attack_possible);
+
+protected:
+  enum GNodeKind : std::uint8_t
+  {
+    G_LONG_LIST,      //перебор ходов длинной атаки (ИЛИ)
+    G_LONG_ATTACK,    //ход длинной атаки, для полушаха - перебор защит (И)
+    G_LONG_DEFENSE,   //защитный ход против длинной атаки
+    G_VICTORY_LIST,   //перебор ходов выигрышной атаки (ИЛИ)
+    G_VICTORY_MOVE4,  //шах выигрышной атаки
+    G_VICTORY_OPEN3,  //полушах выигрышной атаки, перебор защит (И)
+    G_DEFEAT          //защитный ход против выигрышной атаки
+  };
+
+  //Результаты потомков
+  enum GChildResult : std::int8_t
+  {
+    G_PENDING = -1,
+    G_FALSE,
+    G_TRUE
+  };
+
+  struct GNode
+  {
+    GNodeKind kind;
+    GPlayer player;
+    uint depth;
+    GCell move;
+    GStack<GRID_CELL_COUNT> moves;  //ходы перебора для G_*_LIST
+    //Ходы в уме от корневой позиции до узла
+    std::vector<std::pair<GCell, GPlayer>> path;
+
+    GNode* parent = nullptr;
+    uint index = 0;  //номер в порядке перебора родителя
+    uint level = 0;
+
+    bool is_and = false;
+    std::vector<std::unique_ptr<GNode>> children;
+    std::vector<GChildResult> results;
+    std::vector<bool> flags;
+    uint decisive = UINT_MAX;  //номер первого решающего потомка
+
+    bool resolved = false;
+    bool result = false;
+    //До завершения узла - признак, установленный разбором хода узла
+    bool long_attack_possible = false;
+
+    std::atomic<bool> cancelled{false};
+  };
+
+  struct GWorker
+  {
+    std::unique_ptr<Gomoku> g;
+    std::mutex mutex;
+    std::deque<GNode*> tasks;
+    uint generation = 0;
+    std::thread thread;
+  };
+
+  //Узлы до этого уровня разбиваются на задачи, более глубокие поддеревья считаются последовательно
+  static const uint SPLIT_LEVEL = 4;
+
+  bool search(const Gomoku& root, GNode& node);
+
+  void work(uint index);
+  GNode* take(uint index);
+  void push(uint index, GNode* node);
+
+  void execute(uint index, GNode& node);
+  //Последовательный поиск или разбиение узла на потомков (children)
+  void run(Gomoku& g, GNode& node, std::vector<std::unique_ptr<GNode>>& children, bool& result);
+
+  std::unique_ptr<GNode> makeChild(GNode& node, GNodeKind kind, GPlayer player, uint depth, const GCell& move);
+
+  //Вызываются под блокировкой m_mutex
+  void addChildren(uint index, GNode& node, std::vector<std::unique_ptr<GNode>>& children);
+  void resolve(GNode& node, bool result, bool flag);
+  void childDone(GNode& node, uint index, bool result, bool flag);
+  void cancel(GNode& node);
+
+protected:
+  std::vector<std::unique_ptr<GWorker>> m_workers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_ready;
+  std::condition_variable m_done;
+
+  const Gomoku* m_root = nullptr;
+  uint m_generation = 0;
+
+  //Задачи в очередях и задачи, выполняемые потоками
+  std::atomic<uint> m_queued{0};
+  uint m_active = 0;
+
+  bool m_stop = false;
+};
+
+//Одновременное выполнение этапов подбора хода (см. Gomoku::hintImpl).
+//Поиск выигрышной цепочки шахов идет на самом поле, а поиск выигрышной атаки, поиск длинной атаки
+//и проверка позиционных вариантов - в отдельных потоках на копиях поля.
+//Ход выбирается в порядке приоритета этапов: успешный этап отменяет этапы с меньшим приоритетом,
+//а этапы с большим приоритетом досчитываются. Поэтому ход совпадает с последовательным подбором.
+class GPhaseRace
+{
+public:
+  GPhaseRace() = default;
+
+  DELETE_COPY(GPhaseRace)
+
+  //[begin, end) - варианты позиционного этапа (см. Gomoku::hintDefenseVariant).
+  //Устанавливает g.m_hint_kind по выбранному этапу, возвращает false, если ни один этап не дал хода
+  bool run(Gomoku& g, GPlayer player, const GCell* begin, const GCell* end, GCell& move);
+
+protected:
+  //Этапы в порядке убывания приоритета после поиска выигрышной цепочки шахов
+  enum GRacerKind : std::uint8_t
+  {
+    G_VICTORY_ATTACK,
+    G_LONG_ATTACK,
+    G_DEFENSE_VARIANT,
+    G_RACER_COUNT
+  };
+
+  struct GRacer
+  {
+    Gomoku g;
+    std::thread thread;
+    std::atomic<bool> cancelled{false};
+    bool found = false;
+    GCell move;
+    bool long_attack_possible = false;
+  };
+
+  void race(GRacerKind kind, GPlayer player);
+  void cancel(uint from);
+
+protected:
+  GRacer m_racers[G_RACER_COUNT];
+  std::vector<GCell> m_variants;
+};
+
+//Ленивый параллельный поиск: потоки подбирают ход целиком, каждый на своей копии поля,
+//с разным порядком перебора атак и разной начальной глубиной (см. Gomoku::m_search_order)
+//и обмениваются результатами isDefeatMove через общую таблицу без блокировок (см. GThreatTable).
+//Ход дает поток, первым завершивший подбор, остальные потоки отменяются.
+//Поэтому подсказка зависит от скорости потоков и не обязательно совпадает с последовательным подбором.
+class GLazySmp
+{
+public:
+  explicit GLazySmp(uint thread_count);
+
+  DELETE_COPY(GLazySmp)
+
+  uint threadCount() const
+  {
+    return (uint)m_helpers.size();
+  }
+
+  //Подбирает ход в позиции g, устанавливает g.m_hint_kind по ходу первого завершившегося потока
+  GCell hint(Gomoku& g, GPlayer player);
+
+protected:
+  struct GHelper
+  {
+    Gomoku g;
+    std::thread thread;
+    GCell move;
+  };
+
+  void search(uint index, GPlayer player);
+
+protected:
+  std::vector<std::unique_ptr<GHelper>> m_helpers;
+  GThreatTable m_table;
+
+  std::atomic<bool> m_stop{false};
+  std::atomic<int> m_winner{-1};
+};
+
+} //namespace nsg
+
+#endif
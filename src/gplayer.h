@@ -2,15 +2,18 @@
 #define GPLAYER_H
 
 #include "assert.h"
+#include <cstdint>
 
 namespace nsg
 {
 
-enum GPlayer
+//Игрок хранится в одном байте, чтобы массив занятости поля был плотным
+enum GPlayer : std::int8_t
 {
   G_BLACK = 0,
   G_WHITE = 1,
-  G_EMPTY = -1
+  G_EMPTY = -1,
+  G_WALL  = -2  //ячейка рамки вокруг поля
 };
 
 inline GPlayer operator!(GPlayer player)
@@ -0,0 +1,55 @@
+#ifndef GPOOL_H
+#define GPOOL_H
+
+#include "gdefs.h"
+#include "gint.h"
+#include <memory>
+#include <vector>
+#include <cassert>
+
+namespace nsg
+{
+
+//Пул объектов, которые дорого создавать.
+//Объекты создаются в куче при первой необходимости и после использования
+//возвращаются в пул, поэтому повторное использование не требует конструирования.
+//Пул хранит не больше max_free свободных объектов, лишние удаляются при возврате.
+//Пул не потокобезопасен: предполагается отдельный пул для каждого потока.
+template <typename T>
+class TPool
+{
+public:
+  explicit TPool(uint max_free) : m_max_free(max_free)
+  {}
+
+  DELETE_COPY(TPool)
+
+  std::unique_ptr<T> acquire()
+  {
+    if (m_free.empty())
+      return std::make_unique<T>();
+    std::unique_ptr<T> object = std::move(m_free.back());
+    m_free.pop_back();
+    return object;
+  }
+
+  void release(std::unique_ptr<T> object)
+  {
+    assert(object);
+    if (m_free.size() < m_max_free)
+      m_free.push_back(std::move(object));
+  }
+
+  uint freeCount() const
+  {
+    return (uint)m_free.size();
+  }
+
+protected:
+  const uint m_max_free;
+  std::vector<std::unique_ptr<T>> m_free;
+};
+
+} //namespace nsg
+
+#endif
@@ -1,12 +1,14 @@
 #include "grandom.h"
 #include "assert.h"
 #include <ctime>
+#include <thread>
 
 namespace nsg
 {
 
-std::default_random_engine random_engine((uint)time(0));
-static std::uniform_int_distribution dist;
+thread_local std::default_random_engine random_engine(
+  (uint)time(0) ^ (uint)std::hash<std::thread::id>()(std::this_thread::get_id()));
+static thread_local std::uniform_int_distribution dist;
 
 int random(int base, uint count)
 {
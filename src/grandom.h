@@ -8,7 +8,8 @@
 namespace nsg
 {
 
-extern std::default_random_engine random_engine;
+//Генератор свой у каждого потока, чтобы ии можно было запускать в нескольких потоках
+extern thread_local std::default_random_engine random_engine;
 
 int random(int base, uint count);
 
@@ -0,0 +1,100 @@
+#include "gsearchlog.h"
+#include <cstring>
+#include <fstream>
+
+namespace nsg
+{
+
+const char* searchNodeName(GSearchNodeKind kind)
+{
+  static const char* names[G_NODE_KIND_COUNT] =
+  {
+    "exit",
+    "hint",
+    "move4Chain",
+    "longMove4Chain",
+    "victoryMove4",
+    "victoryOpen3",
+    "defeatMove",
+    "longAttack",
+    "longAttackMove",
+    "longDefense"
+  };
+  return kind < G_NODE_KIND_COUNT ? names[kind] : "unknown";
+}
+
+GSearchLog::GSearchLog(uint capacity) :
+  m_capacity(capacity)
+{}
+
+bool GSearchLog::enter(GSearchNodeKind kind, GPlayer player, uint depth, const GCell& move)
+{
+  assert(move.isValid());
+  return enter(kind, player, depth, toCellId(move));
+}
+
+bool GSearchLog::enter(GSearchNodeKind kind, GPlayer player, uint depth)
+{
+  return enter(kind, player, depth, GSearchRecord::NO_MOVE);
+}
+
+bool GSearchLog::enter(GSearchNodeKind kind, GPlayer player, uint depth, std::uint8_t move)
+{
+  //Запись входа и выхода нового узла плюс выходы открытых узлов
+  if (m_records.size() + m_open + 2 > m_capacity)
+  {
+    ++m_dropped;
+    return false;
+  }
+  m_records.push_back({kind, move, std::uint8_t(depth), std::uint8_t(player)});
+  ++m_open;
+  return true;
+}
+
+void GSearchLog::exit(std::uint8_t result)
+{
+  assert(m_open > 0);
+  --m_open;
+  m_records.push_back({G_NODE_EXIT, GSearchRecord::NO_MOVE, 0, result});
+}
+
+void GSearchLog::clear()
+{
+  assert(m_open == 0);
+  m_records.clear();
+  m_dropped = 0;
+}
+
+void GSearchLog::save(std::ostream& out) const
+{
+  const char magic[4] = {'G', 'S', 'L', '1'};
+  std::uint32_t count = (std::uint32_t)m_records.size();
+  out.write(magic, sizeof(magic));
+  out.write((const char*)&count, sizeof(count));
+  out.write((const char*)m_records.data(), std::streamsize(count * sizeof(GSearchRecord)));
+}
+
+bool GSearchLog::save(const char* path) const
+{
+  std::ofstream out(path, std::ios::binary);
+  save(out);
+  return (bool)out;
+}
+
+bool GSearchLog::load(std::istream& in)
+{
+  char magic[4];
+  std::uint32_t count;
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, "GSL1", sizeof(magic)) != 0 ||
+      !in.read((char*)&count, sizeof(count)))
+    return false;
+  std::vector<GSearchRecord> records(count);
+  if (!in.read((char*)records.data(), std::streamsize(count * sizeof(GSearchRecord))))
+    return false;
+  m_records = std::move(records);
+  m_open = 0;
+  m_dropped = 0;
+  return true;
+}
+
+} //namespace nsg
@@ -0,0 +1,130 @@
+#ifndef GSEARCHLOG_H
+#define GSEARCHLOG_H
+
+#include "gcell.h"
+#include "gplayer.h"
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace nsg
+{
+
+//Тип узла дерева поиска
+enum GSearchNodeKind : std::uint8_t
+{
+  G_NODE_EXIT,                //завершение узла (не является узлом)
+  G_NODE_HINT,                //подбор хода (depth - число ходов на поле)
+  G_NODE_MOVE4_CHAIN,         //шах цепочки шахов (findVictoryMove4Chain)
+  G_NODE_LONG_MOVE4_CHAIN,    //шах длинной или выигрышной цепочки шахов (findLongOrVictoryMove4Chain)
+  G_NODE_VICTORY_MOVE4,       //шах выигрышной атаки (isVictoryMove4)
+  G_NODE_VICTORY_OPEN3,       //полушах выигрышной атаки (isNearVictoryOpen3)
+  G_NODE_DEFEAT_MOVE,         //защитный ход против выигрышной атаки (isDefeatMove)
+  G_NODE_LONG_ATTACK,         //перебор ходов длинной атаки (findLongAttack)
+  G_NODE_LONG_ATTACK_MOVE,    //ход длинной атаки
+  G_NODE_LONG_DEFENSE,        //защитный ход против длинной атаки
+  G_NODE_KIND_COUNT
+};
+
+const char* searchNodeName(GSearchNodeKind kind);
+
+//Запись журнала поиска (4 байта).
+//Узел записывается при входе (kind, player, move, depth), при выходе записывается G_NODE_EXIT с результатом,
+//поэтому журнал является обходом дерева в глубину
+struct GSearchRecord
+{
+  static constexpr std::uint8_t NO_MOVE = 0xff;
+  static constexpr std::uint8_t NO_RESULT = 2;
+
+  std::uint8_t kind;
+  std::uint8_t move;    //y * GRID_WIDTH + x или NO_MOVE
+  std::uint8_t depth;
+  std::uint8_t value;   //при входе - игрок, при выходе - результат (0, 1 или NO_RESULT)
+};
+
+static_assert(sizeof(GSearchRecord) == 4);
+static_assert(GRID_WIDTH * GRID_HEIGHT <= GSearchRecord::NO_MOVE);
+
+//Ограниченный журнал узлов дерева поиска угроз.
+//Журнал подключается к полю явно (см. Gomoku::setSearchLog) и предназначен для одного потока.
+//Для каждого открытого узла в буфере зарезервировано место под запись выхода,
+//поэтому при заполнении буфера новые узлы отбрасываются, а дерево остается согласованным.
+//
+//Формат файла: заголовок (4 байта "GSL1", 4 байта число записей) и записи GSearchRecord.
+class GSearchLog
+{
+public:
+  explicit GSearchLog(uint capacity = 1 << 22);
+
+  DELETE_COPY(GSearchLog)
+
+  //Возвращает false, если узел отброшен (для него не нужно вызывать exit)
+  bool enter(GSearchNodeKind kind, GPlayer player, uint depth, const GCell& move);
+  bool enter(GSearchNodeKind kind, GPlayer player, uint depth);
+  void exit(std::uint8_t result);
+
+  void clear();
+
+  const std::vector<GSearchRecord>& records() const
+  {
+    return m_records;
+  }
+
+  //Число отброшенных узлов
+  std::uint64_t dropped() const
+  {
+    return m_dropped;
+  }
+
+  void save(std::ostream& out) const;
+  bool save(const char* path) const;
+  bool load(std::istream& in);
+
+protected:
+  bool enter(GSearchNodeKind kind, GPlayer player, uint depth, std::uint8_t move);
+
+protected:
+  const uint m_capacity;
+  std::vector<GSearchRecord> m_records;
+  uint m_open = 0;
+  std::uint64_t m_dropped = 0;
+};
+
+//Узел журнала от создания до разрушения объекта. Без журнала ничего не записывает
+class GSearchNode
+{
+public:
+  GSearchNode(GSearchLog* log, GSearchNodeKind kind, GPlayer player, uint depth, const GCell& move) :
+    m_log(log && log->enter(kind, player, depth, move) ? log : nullptr)
+  {}
+
+  GSearchNode(GSearchLog* log, GSearchNodeKind kind, GPlayer player, uint depth) :
+    m_log(log && log->enter(kind, player, depth) ? log : nullptr)
+  {}
+
+  DELETE_COPY(GSearchNode)
+
+  ~GSearchNode()
+  {
+    if (m_log)
+      m_log->exit(GSearchRecord::NO_RESULT);
+  }
+
+  //Завершает узел с результатом, возвращает результат
+  bool exit(bool result)
+  {
+    if (m_log)
+    {
+      m_log->exit(result);
+      m_log = nullptr;
+    }
+    return result;
+  }
+
+protected:
+  GSearchLog* m_log;
+};
+
+} //namespace nsg
+
+#endif
@@ -6,7 +6,9 @@
 #include <cassert>
 #include <type_traits>
 #include <cstdint>
-#include <forward_list>
+#include <memory>
+#include <new>
+#include <vector>
 
 namespace nsg
 {
@@ -35,11 +37,18 @@ template<typename T>
 class TBaseStack : public BaseArray
 {
 public:
-  TBaseStack(T* data) : m_data(data)
+  TBaseStack(T* data, uint capacity) : m_data(data), m_capacity(capacity)
   {
     assert(data);
   }
 
+protected:
+  //Для стеков, память которых назначается позже (см. TArenaStack)
+  TBaseStack() : m_data(nullptr), m_capacity(0)
+  {}
+
+public:
+
   DELETE_COPY(TBaseStack)
 
   T& operator[](uint i)
@@ -68,6 +77,8 @@ public:
 
   T& push()
   {
+    //Переполнение резерва портит соседние данные (например, следующий стек в арене)
+    assert(m_size < m_capacity);
     T* item = new (m_data + m_size++) T;
     return *item;
   }
@@ -109,15 +120,21 @@ public:
     return m_data + m_size;
   }
 
+  uint capacity() const
+  {
+    return m_capacity;
+  }
+
 protected:
   T* m_data;
+  uint m_capacity;
 };
 
 template<typename T, uint MAXSIZE>
 class TStack : public TBaseStack<T>
 {
 public:
-  TStack() : TBaseStack<T>((T*)m_array)
+  TStack() : TBaseStack<T>((T*)m_array, MAXSIZE)
   {}
 
 protected:
@@ -126,14 +143,235 @@ protected:
   std::uint8_t m_array[MAXSIZE * sizeof(T)];
 };
 
+//Арена для временных данных поиска: память выделяется сдвигом вершины
+//и возвращается целиком при выходе из уровня (см. enter, leave).
+//Уровни вложены так же, как ходы в уме: Gomoku::doInMind входит в уровень, Gomoku::undoInMind выходит из него.
+//Память состоит из цепочки блоков: когда текущий блок заполнен, выделение продолжается в следующем,
+//поэтому глубина поиска не ограничена размером блока. Блоки освобождаются только вместе с ареной
+//и используются повторно после выхода из уровня
+class GStackArena
+{
+public:
+  static const uint DEFAULT_CAPACITY = 1 << 16;
+
+  //Память выделяется при первом входе в уровень, поэтому поле без поиска арену не заполняет.
+  //capacity - размер блока
+  explicit GStackArena(uint capacity = DEFAULT_CAPACITY) :
+    m_capacity(capacity)
+  {}
+
+  DELETE_COPY(GStackArena)
+
+  //Память не инициализируется и не освобождается по отдельности
+  void* allocate(uint size, uint align)
+  {
+    if (m_blocks.empty())
+      addBlock(size + align);
+    uint begin = (m_top + align - 1) & ~(align - 1);
+    while (begin + size > m_blocks[m_block].capacity)
+    {
+      //Остаток блока не используется до выхода из уровня, на котором начат следующий блок
+      if (++m_block == m_blocks.size())
+        addBlock(size + align);
+      m_top = 0;
+      begin = 0;
+    }
+    m_top = begin + size;
+    return m_blocks[m_block].data.get() + begin;
+  }
+
+  template<typename T>
+  T* allocate(uint count)
+  {
+    return (T*)allocate(count * uint(sizeof(T)), uint(alignof(T)));
+  }
+
+  //Возвращает арене память после end, если она выделена последней на текущем уровне
+  void shrink(const void* end, const void* allocated_end)
+  {
+    assert(end <= allocated_end);
+    std::uint8_t* data = m_blocks[m_block].data.get();
+    if (allocated_end == data + m_top)
+      m_top = uint((const std::uint8_t*)end - data);
+  }
+
+  void enter()
+  {
+    //В начале уровня хранятся начало предыдущего уровня и вершина до входа
+    GMark mark = {m_level, m_block, m_top};
+    m_level = allocate<GMark>(1);
+    *m_level = mark;
+  }
+
+  void leave()
+  {
+    assert(m_level);
+    const GMark mark = *m_level;
+    m_level = mark.level;
+    m_block = mark.block;
+    m_top = mark.top;
+  }
+
+  bool empty() const
+  {
+    return m_block == 0 && m_top == 0;
+  }
+
+  //Объем памяти от начала арены до вершины, включая неиспользованные остатки заполненных блоков
+  uint used() const
+  {
+    uint size = m_top;
+    for (uint i = 0; i < m_block; ++i)
+      size += m_blocks[i].capacity;
+    return size;
+  }
+
+  bool isAllocated() const
+  {
+    return !m_blocks.empty();
+  }
+
+  uint blockCount() const
+  {
+    return uint(m_blocks.size());
+  }
+
+protected:
+  struct GBlock
+  {
+    std::unique_ptr<std::uint8_t[]> data;
+    uint capacity;
+  };
+
+  struct GMark
+  {
+    GMark* level;
+    uint block;
+    uint top;
+  };
+
+  //Блок вмещает и выделение, которое больше размера блока
+  void addBlock(uint min_capacity)
+  {
+    const uint capacity = min_capacity > m_capacity ? min_capacity : m_capacity;
+    m_blocks.push_back({std::unique_ptr<std::uint8_t[]>(new std::uint8_t[capacity]), capacity});
+  }
+
+protected:
+  std::vector<GBlock> m_blocks;
+  uint m_capacity;
+  //текущий блок и вершина в нем
+  uint m_block = 0;
+  uint m_top = 0;
+  GMark* m_level = nullptr;
+};
+
+//Уровень арены на время жизни объекта
+class GStackArenaScope
+{
+public:
+  explicit GStackArenaScope(GStackArena& arena) : m_arena(arena)
+  {
+    m_arena.enter();
+  }
+
+  DELETE_COPY(GStackArenaScope)
+
+  ~GStackArenaScope()
+  {
+    m_arena.leave();
+  }
+
+protected:
+  GStackArena& m_arena;
+};
+
+//Стек в памяти арены. Резерв выделяется заранее, а fit возвращает арене неиспользованную часть резерва,
+//поэтому стек занимает столько памяти, сколько в нем элементов.
+//Память освобождается при выходе из уровня арены, на котором она выделена
 template<typename T>
-class TStackAllocator : public std::allocator<T>
+class TArenaStack : public TBaseStack<T>
 {
+  static_assert(std::is_trivially_destructible_v<T>, "arena memory is released without destructors");
+
+public:
+  TArenaStack() = default;
+
+  TArenaStack(GStackArena& arena, uint capacity)
+  {
+    reserve(arena, capacity);
+  }
+
+  void reserve(GStackArena& arena, uint capacity)
+  {
+    this->m_data = arena.template allocate<T>(capacity);
+    this->m_size = 0;
+    this->m_capacity = capacity;
+    m_arena = &arena;
+  }
+
+  //Отвязывает стек от памяти арены
+  void reset()
+  {
+    this->m_data = nullptr;
+    this->m_size = 0;
+    this->m_capacity = 0;
+    m_arena = nullptr;
+  }
+
+  void fit()
+  {
+    assert(m_arena && this->m_size <= this->m_capacity);
+    m_arena->shrink(this->m_data + this->m_size, this->m_data + this->m_capacity);
+    this->m_capacity = this->m_size;
+  }
+
+protected:
+  GStackArena* m_arena = nullptr;
 };
 
+//Распределитель памяти арены для стандартных контейнеров
 template<typename T>
-class TGomokuStack : public std::forward_list<T, TStackAllocator<T>>
+class TStackAllocator
 {
+public:
+  using value_type = T;
+
+  explicit TStackAllocator(GStackArena& arena) : m_arena(&arena)
+  {}
+
+  template<typename U>
+  TStackAllocator(const TStackAllocator<U>& allocator) : m_arena(allocator.arena())
+  {}
+
+  T* allocate(std::size_t count)
+  {
+    return m_arena->allocate<T>(uint(count));
+  }
+
+  //Память возвращается при выходе из уровня арены
+  void deallocate(T*, std::size_t)
+  {}
+
+  GStackArena* arena() const
+  {
+    return m_arena;
+  }
+
+  template<typename U>
+  bool operator==(const TStackAllocator<U>& allocator) const
+  {
+    return m_arena == allocator.arena();
+  }
+
+  template<typename U>
+  bool operator!=(const TStackAllocator<U>& allocator) const
+  {
+    return m_arena != allocator.arena();
+  }
+
+protected:
+  GStackArena* m_arena;
 };
 
 } //namespace nsg
@@ -0,0 +1,36 @@
+#include "gthreattable.h"
+
+namespace nsg
+{
+
+GThreatTable::GThreatTable(uint size_log2) :
+  m_mask((std::uint64_t(1) << size_log2) - 1),
+  m_entries(new std::atomic<std::uint64_t>[m_mask + 1])
+{
+  clear();
+}
+
+bool GThreatTable::find(std::uint64_t key, bool& result, bool& long_attack_possible) const
+{
+  std::uint64_t entry = m_entries[index(key)].load(std::memory_order_relaxed);
+  //Нулевое слово - пустая запись
+  if (entry == 0 || (entry ^ key) & ~VALUE_MASK)
+    return false;
+  result = entry & 1;
+  long_attack_possible = entry & 2;
+  return true;
+}
+
+void GThreatTable::store(std::uint64_t key, bool result, bool long_attack_possible)
+{
+  std::uint64_t entry = (key & ~VALUE_MASK) | std::uint64_t(result) | std::uint64_t(long_attack_possible) << 1;
+  m_entries[index(key)].store(entry, std::memory_order_relaxed);
+}
+
+void GThreatTable::clear()
+{
+  for (std::uint64_t i = 0; i <= m_mask; ++i)
+    m_entries[i].store(0, std::memory_order_relaxed);
+}
+
+} //namespace nsg
@@ -0,0 +1,48 @@
+#ifndef GTHREATTABLE_H
+#define GTHREATTABLE_H
+
+#include "gdefs.h"
+#include "gint.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace nsg
+{
+
+//Таблица доказанных и опровергнутых позиций поиска угроз, общая для нескольких потоков.
+//Запись занимает одно 64-битное атомарное слово: старшие биты ключа и значение,
+//поэтому запись читается и пишется целиком без блокировок.
+//При совпадении номера записи новая запись вытесняет старую.
+class GThreatTable
+{
+public:
+  explicit GThreatTable(uint size_log2 = 20);
+
+  DELETE_COPY(GThreatTable)
+
+  //Ключ должен учитывать все, от чего зависит результат поиска (позицию, ход, глубину)
+  bool find(std::uint64_t key, bool& result, bool& long_attack_possible) const;
+  void store(std::uint64_t key, bool result, bool long_attack_possible);
+
+  //Не потокобезопасна, вызывается до начала поиска
+  void clear();
+
+protected:
+  //Младшие биты слова: результат и признак возможной длинной атаки
+  static const std::uint64_t VALUE_MASK = 3;
+
+  //Номер записи берется из битов ключа, которые хранятся в записи
+  std::uint64_t index(std::uint64_t key) const
+  {
+    return (key >> 2) & m_mask;
+  }
+
+protected:
+  const std::uint64_t m_mask;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> m_entries;
+};
+
+} //namespace nsg
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef GTIMER_H
 #define GTIMER_H
 
+#include "gint.h"
+#include <atomic>
 #include <chrono>
 
 namespace nsg
@@ -32,6 +34,38 @@ protected:
   Time m_start;
 };
 
+//Срок окончания поиска, общий для всех потоков поиска.
+//Истечение срока запоминается признаком, после этого часы не опрашиваются
+class GDeadline
+{
+public:
+  explicit GDeadline(uint time_limit) : m_time(Clock::now() + std::chrono::milliseconds(time_limit))
+  {}
+
+  //Опрашивает часы и поднимает признак, если срок истек
+  bool expired() const
+  {
+    if (m_expired.load(std::memory_order_relaxed))
+      return true;
+    if (Clock::now() < m_time)
+      return false;
+    m_expired.store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  //Признак без опроса часов: поднят, если поиск проверил срок после его истечения
+  bool tripped() const
+  {
+    return m_expired.load(std::memory_order_relaxed);
+  }
+
+protected:
+  using Clock = std::chrono::steady_clock;
+
+  Clock::time_point m_time;
+  mutable std::atomic<bool> m_expired{false};
+};
+
 } //namespace nsg
 
 #endif
@@ -0,0 +1,74 @@
+#include "gtrace.h"
+#include <algorithm>
+#include <fstream>
+
+namespace nsg
+{
+
+GTrace::GTrace(uint max_events) :
+  m_max_events(max_events),
+  m_start(Clock::now())
+{}
+
+void GTrace::add(const char* name, Clock::time_point start, Clock::time_point end,
+                 const char* arg_name, int arg_value)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_events.size() >= m_max_events)
+  {
+    ++m_dropped;
+    return;
+  }
+  m_events.push_back({name, arg_name, arg_value, threadId(std::this_thread::get_id()),
+                      duration_cast<microseconds>(start - m_start).count(),
+                      duration_cast<microseconds>(end - start).count()});
+}
+
+uint GTrace::threadId(std::thread::id id)
+{
+  auto it = std::find(m_threads.begin(), m_threads.end(), id);
+  if (it == m_threads.end())
+    it = m_threads.insert(it, id);
+  return uint(it - m_threads.begin()) + 1;
+}
+
+void GTrace::save(std::ostream& out) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  out << "{\"traceEvents\":[";
+  for (std::size_t i = 0; i < m_events.size(); ++i)
+  {
+    const GEvent& e = m_events[i];
+    out << (i ? ",\n" : "\n")
+        << "{\"name\":\"" << e.name << "\",\"cat\":\"hint\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+        << ",\"ts\":" << e.start << ",\"dur\":" << e.duration;
+    if (e.arg_name)
+      out << ",\"args\":{\"" << e.arg_name << "\":" << e.arg_value << "}";
+    out << "}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << m_dropped << "}}" << std::endl;
+}
+
+bool GTrace::save(const char* path) const
+{
+  std::ofstream out(path);
+  save(out);
+  return (bool)out;
+}
+
+uint GTrace::size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return (uint)m_events.size();
+}
+
+uint GTrace::dropped() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dropped;
+}
+
+} //namespace nsg
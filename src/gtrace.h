@@ -0,0 +1,127 @@
+#ifndef GTRACE_H
+#define GTRACE_H
+
+#include "gdefs.h"
+#include "gint.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nsg
+{
+
+//Журнал этапов подбора хода в формате Chrome trace event JSON
+//(открывается в chrome://tracing, Perfetto и других просмотрщиках временных диаграмм).
+//События добавляются из нескольких потоков, каждый поток отображается отдельной дорожкой.
+//Число событий ограничено, события сверх предела отбрасываются и подсчитываются.
+class GTrace
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit GTrace(uint max_events = 1 << 20);
+
+  DELETE_COPY(GTrace)
+
+  //name и arg_name должны жить не меньше журнала (строковые литералы)
+  void add(const char* name, Clock::time_point start, Clock::time_point end,
+           const char* arg_name = nullptr, int arg_value = 0);
+
+  void save(std::ostream& out) const;
+  bool save(const char* path) const;
+
+  uint size() const;
+  uint dropped() const;
+
+protected:
+  struct GEvent
+  {
+    const char* name;
+    const char* arg_name;
+    int arg_value;
+    uint tid;
+    std::int64_t start; //мкс от создания журнала
+    std::int64_t duration;
+  };
+
+  uint threadId(std::thread::id id);
+
+protected:
+  const uint m_max_events;
+  const Clock::time_point m_start;
+
+  mutable std::mutex m_mutex;
+  std::vector<GEvent> m_events;
+  std::vector<std::thread::id> m_threads;
+  uint m_dropped = 0;
+};
+
+//Событие от создания до разрушения объекта. Без журнала ничего не измеряет
+class GTraceScope
+{
+public:
+  GTraceScope(GTrace* trace, const char* name, const char* arg_name = nullptr, int arg_value = 0) :
+    m_trace(trace),
+    m_name(name),
+    m_arg_name(arg_name),
+    m_arg_value(arg_value)
+  {
+    if (m_trace)
+      m_start = GTrace::Clock::now();
+  }
+
+  DELETE_COPY(GTraceScope)
+
+  ~GTraceScope()
+  {
+    if (m_trace)
+      m_trace->add(m_name, m_start, GTrace::Clock::now(), m_arg_name, m_arg_value);
+  }
+
+protected:
+  GTrace* m_trace;
+  const char* m_name;
+  const char* m_arg_name;
+  int m_arg_value;
+  GTrace::Clock::time_point m_start;
+};
+
+//Последовательность этапов: очередной этап завершает предыдущий,
+//последний этап завершается при разрушении объекта
+class GTracePhase
+{
+public:
+  explicit GTracePhase(GTrace* trace) :
+    m_trace(trace)
+  {}
+
+  DELETE_COPY(GTracePhase)
+
+  ~GTracePhase()
+  {
+    next(nullptr);
+  }
+
+  void next(const char* name)
+  {
+    if (!m_trace)
+      return;
+    auto now = GTrace::Clock::now();
+    if (m_name)
+      m_trace->add(m_name, m_start, now);
+    m_name = name;
+    m_start = now;
+  }
+
+protected:
+  GTrace* m_trace;
+  const char* m_name = nullptr;
+  GTrace::Clock::time_point m_start;
+};
+
+} //namespace nsg
+
+#endif
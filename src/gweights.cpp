@@ -0,0 +1,84 @@
+#include "gweights.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace nsg
+{
+
+bool GWeights::operator==(const GWeights& weights) const
+{
+  for (uint i = 0; i <= MAX_LINE; ++i)
+  {
+    if (line[i] != weights.line[i])
+      return false;
+  }
+  return variants == weights.variants;
+}
+
+bool GWeights::isValid() const
+{
+  if (line[0] != 0 || variants == 0)
+    return false;
+  for (uint i = 1; i <= MAX_LINE; ++i)
+  {
+    if (line[i] <= 0 || line[i] < line[i - 1])
+      return false;
+  }
+  return true;
+}
+
+bool GWeights::load(std::istream& in)
+{
+  GWeights weights;
+  std::string text;
+  while (std::getline(in, text))
+  {
+    std::istringstream stream(text);
+    std::string key;
+    if (!(stream >> key) || key[0] == '#')
+      continue;
+    if (key == "line")
+    {
+      for (uint i = 1; i <= MAX_LINE; ++i)
+      {
+        if (!(stream >> weights.line[i]))
+          return false;
+      }
+    }
+    else if (key == "variants")
+    {
+      if (!(stream >> weights.variants))
+        return false;
+    }
+    else
+      return false;
+  }
+  if (!weights.isValid())
+    return false;
+  *this = weights;
+  return true;
+}
+
+bool GWeights::load(const char* path)
+{
+  std::ifstream in(path);
+  return in && load(in);
+}
+
+void GWeights::save(std::ostream& out) const
+{
+  out << "line";
+  for (uint i = 1; i <= MAX_LINE; ++i)
+    out << " " << line[i];
+  out << std::endl << "variants " << variants << std::endl;
+}
+
+bool GWeights::save(const char* path) const
+{
+  std::ofstream out(path);
+  save(out);
+  return (bool)out;
+}
+
+} //namespace nsg
@@ -0,0 +1,45 @@
+#ifndef GWEIGHTS_H
+#define GWEIGHTS_H
+
+#include "gint.h"
+#include <iostream>
+
+namespace nsg
+{
+
+//Настраиваемые параметры оценки ходов.
+//Веса хранятся в файле в текстовом виде, по одному параметру в строке:
+//  line 1 3 5 6 6
+//  variants 60
+//Строки, начинающиеся с #, пропускаются.
+struct GWeights
+{
+  //Максимальная длина линии
+  static const uint MAX_LINE = 5;
+
+  //Вес линии 5 по числу камней игрока в ней (индекс 1..MAX_LINE).
+  //Вес хода для игрока складывается из приращений весов линий, которые ход развивает или блокирует
+  int line[MAX_LINE + 1] = {0, 1, 3, 5, 6, 6};
+
+  //Число вариантов с максимальным весом, которые проверяются на безопасность (см. Gomoku::hintImpl)
+  uint variants = 60;
+
+  bool operator==(const GWeights& weights) const;
+
+  bool operator!=(const GWeights& weights) const
+  {
+    return !operator==(weights);
+  }
+
+  //Веса линий должны быть положительными и не убывать с длиной линии
+  bool isValid() const;
+
+  bool load(std::istream& in);
+  bool load(const char* path);
+  void save(std::ostream& out) const;
+  bool save(const char* path) const;
+};
+
+} //namespace nsg
+
+#endif
@@ -2,23 +2,33 @@
 #include "../src/gomoku.h"
 #include "../src/gline.h"
 #include "../src/grandom.h"
+#include "../enginesrc/gengine.h"
+#include "../enginesrc/gserver.h"
+#include "../enginesrc/gselfplay.h"
+#include "../enginesrc/gtuner.h"
+#include "../enginesrc/gsearchdump.h"
+#include "../enginesrc/gbookbuilder.h"
 #include <iostream>
 #include <algorithm>
+#include <sstream>
+#include <cstring>
 
 using namespace nsg;
 
 class GTestGrid : public GPointStack
 {
 public:
-  GTestGrid(const GBaseStack& stack)
+  template<typename TCells>
+  GTestGrid(const TCells& stack)
   {
     operator=(stack);
   }
 
-  GTestGrid& operator=(const GBaseStack& stack)
+  template<typename TCells>
+  GTestGrid& operator=(const TCells& stack)
   {
     clear();
-    for (const GPoint& p: stack)
+    for (const GCell& p: stack)
       (*this)[p] = true;
     return *this;
   }
@@ -33,6 +43,8 @@ public:
 
   void testIsGameOver();
 
+  void testFullBoardUndo();
+
   //Обновление и откат пятёрок
   void testMoves5();
 
@@ -42,12 +54,27 @@ public:
   //Обновление и откат открытых троек
   void testOpen3();
 
+  //Обновление и откат кандидатов в ходы
+  void testCandidates();
+
   void testHintMove5();
 
   void testHintVictoryMove4Chain();
 
   void testFindLongAttack();
 
+  void testLongAttackSearchStep();
+
+  void testSearchContext();
+  void testWeights();
+  void testParallelSearch();
+  void testLazySmp();
+  void testHintMemo();
+  void testOpenMoves5();
+
+  //Счетчики камней в окнах, живые окна ячеек и построение линии 5 по счетчикам
+  void testWindowStones();
+
 protected:
   void testEmpty();
 
@@ -68,11 +95,11 @@ void TestGomoku::testDoMove()
 {
   assert(!doMove(-1, -1));
   assert(doMove(7, 7));
-  assert(get({7, 7}).player == G_BLACK);
+  assert(get({7, 7}) == G_BLACK);
   //ход в занятую точку запрещен
   assert(!doMove(7, 7));
   assert(doMove(8, 7));
-  assert(get({8, 7}).player == G_WHITE);
+  assert(get({8, 7}) == G_WHITE);
   assert(doMove(8, 8, G_BLACK));
   assert(doMove(9, 9, G_BLACK));
   assert(doMove(10, 10, G_BLACK));
@@ -100,6 +127,35 @@ void TestGomoku::testUndo()
   testEmpty();
 }
 
+void TestGomoku::testFullBoardUndo()
+{
+  //Раскраска поля без линий 5: черных на один камень больше, чем белых
+  auto color = [](int x, int y)
+  {
+    return GPlayer((x / 2 + y) % 2);
+  };
+  GCell p{0, 0};
+  do
+    assert(doMove(p.point(), color(p.x(), p.y())));
+  while (next(p));
+  assert(isGameOver() && !getLine5());
+
+  //Ход, заполнивший поле, откатывается как обычный ход.
+  //Ничья наступила раньше заполнения поля, поэтому подсказывается единственная свободная ячейка
+  assert(undo());
+  assert(isGameOver() && isDraw());
+  GCell last_cell{width() - 1, height() - 1};
+  doInMind(last_cell, color(width() - 1, height() - 1));
+  assert(isGameOver());
+  undoInMind();
+  assert(isDraw());
+  int x, y;
+  assert(hint(x, y, color(width() - 1, height() - 1)) && x == width() - 1 && y == height() - 1);
+
+  while (undo());
+  testEmpty();
+}
+
 void TestGomoku::testEmpty()
 {
   TestGomoku tmp;
@@ -108,17 +164,15 @@ void TestGomoku::testEmpty()
   assert(cells().empty());
   assert(m_moves5[G_BLACK].cells().empty());
   assert(m_moves5[G_WHITE].cells().empty());
-  GPoint p{0, 0};
+  GCell p{0, 0};
   do
   {
     assert(isEmptyCell(p));
     assert(m_moves5[G_BLACK].isEmptyCell(p));
     assert(m_moves5[G_WHITE].isEmptyCell(p));
-    const GMoveData& data = get(p);
-    const GMoveData& tmp_data = tmp.get(p);
-    assert(data.wgt[G_BLACK] == tmp_data.wgt[G_BLACK]);
-    assert(data.wgt[G_WHITE] == tmp_data.wgt[G_WHITE]);
-    assert(data.m_moves5_count == 0);
+    assert(m_wgt[G_BLACK][p] == tmp.m_wgt[G_BLACK][p]);
+    assert(m_wgt[G_WHITE][p] == tmp.m_wgt[G_WHITE][p]);
+    assert(backup(p).m_moves5_count == 0);
   }
   while (next(p));
 }
@@ -136,24 +190,33 @@ void TestGomoku::testIsGameOver()
   assert(isGameOver());
 
   start();
-  //Окончание игры при отсутствии свободных ячеек
+  //Ничья, когда линию 5 построить уже нельзя, до заполнения поля
   //хохо
   //хохо
   //хохо
   //охох
   //охох
   //охох
-  GPoint move{0, 0};
+  GCell move{0, 0};
   GPlayer player = G_BLACK;
+  uint draw_move_count = 0;
 
   auto fillRowWithout5 = [&]()
   {
-    assert(move.x == 0);
+    assert(move.x() == 0);
     for (; ; )
     {
-      assert(!isGameOver());
-      assert(doMove(move, player));
-      if (!next(move) || move.x == 0)
+      assert(isGameOver() == (draw_move_count > 0));
+      //После ничьей ходы и подсказки принимаются до заполнения поля
+      if (draw_move_count > 0)
+      {
+        int x, y;
+        assert(hint(x, y, player) && isValidNextMove(x, y));
+      }
+      assert(doMove(move.point(), player));
+      if (draw_move_count == 0 && isDraw())
+        draw_move_count = cells().size();
+      if (!next(move) || move.x() == 0)
         break;
       player = !player;
     }
@@ -167,7 +230,13 @@ void TestGomoku::testIsGameOver()
 
   for (int i = 0; i < 5; ++i, player = !player)
     fill3RowsWithout5();
-  assert(isGameOver());
+  assert(isGameOver() && !getLine5());
+  assert(draw_move_count > 0 && draw_move_count < GRID_CELL_COUNT);
+
+  //Откат хода, после которого наступила ничья, возвращает игру
+  while (cells().size() >= draw_move_count)
+    undo();
+  assert(!isGameOver() && !isDraw());
 }
 
 void TestGomoku::testMoves5()
@@ -180,12 +249,12 @@ void TestGomoku::testMoves5()
   }
   assert(moves5.cells().size() == 2 && !moves5.isEmptyCell({6, 7}) && !moves5.isEmptyCell({11, 7}));
   //число потенциальных ходов 5 фиксируется в порождающем ходе для возможности отмены
-  assert(get({10, 7}).m_moves5_count == 2);
+  assert(backup({10, 7}).m_moves5_count == 2);
 
   undo();
   //При откате ходы 5 пропадают
   assert(moves5.cells().empty());
-  assert(get({10, 7}).m_moves5_count == 0);
+  assert(backup({10, 7}).m_moves5_count == 0);
 
   //Если ход занят противником, то он не фиксируется как ход 5
   doMove(11, 7, G_WHITE);
@@ -198,7 +267,7 @@ void TestGomoku::testMoves5()
   doMove(5, 8, G_BLACK);
   doMove(8, 5, G_BLACK);
   doMove(4, 9, G_BLACK);
-  assert(get(lastCell()).m_moves5_count == 0);
+  assert(backup(lastCell()).m_moves5_count == 0);
   //При откате ход 5 остается
   undo();
   assert(!moves5.isEmptyCell({6, 7}));
@@ -214,7 +283,7 @@ void TestGomoku::testMoves4()
   doMove(9, 7, G_BLACK);
   //Следующие ходы являются шахами
   assert(isDangerMove4(G_BLACK, {5, 7}) && isDangerMove4(G_BLACK, {6, 7}) && isDangerMove4(G_BLACK, {10, 7}) && isDangerMove4(G_BLACK, {11, 7}));
-  const auto& move_data_97 = get({9, 7});
+  const auto& move_data_97 = backup({9, 7});
   //В порождающем ходе шахи фиксируются парами
   assert(move_data_97.m_moves4.size() == 6);
   const auto& move4_data_57 = danger_moves[{5, 7}];
@@ -249,7 +318,7 @@ void TestGomoku::testMoves4()
   doMove(6, 6, G_BLACK);
   moves5 = move4_data_67.m_moves5;
   assert(moves5.cells().size() == 3 && !moves5.isEmptyCell({6, 9}));
-  assert(get({6, 6}).m_moves4.size() == 2);
+  assert(backup({6, 6}).m_moves4.size() == 2);
   //При откате этот ход 4 не пропадает, но пропадает один связанный с ним ход 5
   undo();
   moves5 = move4_data_67.m_moves5;
@@ -264,7 +333,7 @@ void TestGomoku::testOpen3()
   assert(danger_moves.cells().empty());
 
   doMove(8, 7, G_BLACK);
-  const auto& last_move_data = get({8, 7});
+  const auto& last_move_data = backup({8, 7});
   assert(last_move_data.m_open3_moves.size() == 4);
   //xxX
   assert(isOpen3(G_BLACK, 9, 7));
@@ -457,16 +526,59 @@ void TestGomoku::testOpen3()
   assert(!danger_moves.isEmptyCell({9, 5}));
   doMove(10, 6, G_BLACK);
   doMove(8, 4, G_BLACK);
-  const auto& open3_moves = get({8, 4}).m_open3_moves;
+  const auto& open3_moves = backup({8, 4}).m_open3_moves;
   assert(open3_moves.size() == 2 && open3_moves[0] != (GPoint{9, 5}) && open3_moves[1] != (GPoint{9, 5}));
   //При откате последнего хода возможность открытой тройки сохраняется
   undo();
   assert(!danger_moves.isEmptyCell({9, 5}));
 }
 
+void TestGomoku::testCandidates()
+{
+  assert(m_candidates.cells().empty());
+
+  doMove(7, 7, G_BLACK);
+  //Окрестность хода 5х5 без самого хода
+  assert(m_candidates.cells().size() == 24);
+  assert(m_candidates.contains({5, 5}) && m_candidates.contains({9, 9}) && m_candidates.contains({7, 8}));
+  assert(!m_candidates.contains({7, 7}) && !m_candidates.contains({4, 7}) && !m_candidates.contains({10, 10}));
+
+  doMove(8, 7, G_WHITE);
+  //Занятая ячейка перестает быть кандидатом, окрестность расширяется на один столбец
+  assert(m_candidates.cells().size() == 28);
+  assert(!m_candidates.contains({8, 7}) && m_candidates.contains({10, 7}));
+
+  undo();
+  assert(m_candidates.cells().size() == 24);
+  assert(!m_candidates.contains({10, 7}) && m_candidates.contains({8, 7}));
+
+  //Окрестность в углу обрезается стенами
+  doMove(0, 0, G_WHITE);
+  assert(m_candidates.cells().size() == 32);
+  assert(m_candidates.contains({1, 2}) && !m_candidates.contains({0, 0}));
+
+  undo();
+  undo();
+  assert(m_candidates.cells().empty());
+
+  //Радиус меняется без пересборки, позиция переигрывается с новой окрестностью
+  doMove(7, 7, G_BLACK);
+  doMove(8, 7, G_WHITE);
+  setCandidateRadius(1);
+  assert(getCandidateRadius() == 1 && cells().size() == 2);
+  assert(m_candidates.cells().size() == 10 && !m_candidates.contains({6, 9}));
+  setCandidateRadius(3);
+  assert(m_candidates.cells().size() == 54 && m_candidates.contains({11, 10}));
+  undo();
+  assert(m_candidates.cells().size() == 48);
+  undo();
+  assert(m_candidates.cells().empty());
+  setCandidateRadius(CANDIDATE_RADIUS);
+}
+
 void TestGomoku::testHintMove5()
 {
-  GPoint move5;
+  GCell move5;
 
   doMove(7, 7, G_BLACK);
   doMove(8, 7, G_BLACK);
@@ -489,7 +601,7 @@ void TestGomoku::testHintVictoryMove4Chain()
   assert(!findVictoryMove4Chain(G_BLACK, {9, 7}, 0));
   doMove(6, 7, G_BLACK);
 
-  GPoint move4;
+  GCell move4;
   assert(findVictoryMove4Chain(G_BLACK, 0, 0, &move4));
   assert((move4 == GPoint{5, 7} || move4 == GPoint{9, 7}));
 
@@ -642,6 +754,1109 @@ void TestGomoku::testFindLongAttack()
   assert(findLongAttack(G_WHITE, {7, 3}, 5));
 }
 
+void TestGomoku::testLongAttackSearchStep()
+{
+  setAiLevel(4);
+
+  doMove(7, 7); //
+  doMove(6, 8);
+  doMove(7, 6); //
+  doMove(7, 8);
+  doMove(8, 8); //
+  doMove(8, 7);
+  doMove(9, 6); //
+  doMove(6, 6);
+  doMove(6, 7); //
+  doMove(5, 8);
+  doMove(9, 4); //
+  doMove(4, 8);
+  doMove(3, 8); //
+  doMove(7, 5);
+  doMove(5, 7); //
+  doMove(8, 5);
+  doMove(10, 5); //
+  doMove(9, 7);
+  doMove(10, 4); //
+  doMove(8, 6);
+  doMove(10, 8); //
+  doMove(5, 5);
+  doMove(4, 5); //
+  doMove(6, 4);
+  doMove(5, 3); //
+
+  uint move_count = cells().size();
+
+  //Поиск по шагам дает тот же результат, что и поиск целиком
+  GAttackSearch search(this);
+  search.startLongAttack(G_WHITE, GCell(7, 3), 5);
+  uint steps = 0;
+  while (!search.step(1))
+    ++steps;
+  assert(steps > 1);
+  assert(search.result());
+  assert(cells().size() == move_count);
+
+  //Бюджет расходуется и на ходы в уме, в том числе на ходы вложенных проверок
+  search.startLongAttack(G_WHITE, GCell(7, 3), 5);
+  std::uint64_t node_count = m_node_count;
+  assert(!search.step(steps + 1));
+  assert(m_node_count - node_count > 0);
+  while (!search.step(steps + 1));
+  assert(search.result());
+  assert(cells().size() == move_count);
+
+  //Прерванный поиск откатывает ходы, сделанные в уме
+  search.startLongAttack(G_WHITE, GCell(7, 3), 5);
+  assert(!search.step(steps / 2));
+  assert(cells().size() > move_count);
+  search.cancel();
+  assert(search.isFinished());
+  assert(cells().size() == move_count);
+
+  GCell move;
+  search.startLongAttack(G_WHITE, dangerMoves(G_WHITE).cells(), 5);
+  assert(search.run() == findLongAttack(G_WHITE, 5, &move));
+  if (search.result())
+    assert(search.move() == move);
+
+  //Выигрышная атака выполняется на том же стеке кадров и по шагам дает тот же результат
+  for (GPlayer player: {G_BLACK, G_WHITE})
+  {
+    for (uint depth = 0; depth <= 3; ++depth)
+    {
+      GCell victory_move;
+      bool victory = findVictoryAttack(player, depth, &victory_move);
+      bool long_attack_possible = m_long_attack_possible;
+      search.startVictoryAttack(player, depth);
+      while (!search.step(1))
+        assert(cells().size() >= move_count);
+      assert(search.result() == victory);
+      assert(m_long_attack_possible == long_attack_possible);
+      if (victory)
+        assert(search.move() == victory_move);
+      assert(cells().size() == move_count);
+    }
+  }
+
+  //Подсказка с ограничением времени прерывает уровень по сроку и возвращает ход
+  for (uint time_limit: {0u, 1u, 10u})
+  {
+    GTimer timer;
+    int x, y;
+    assert(hintInTime(x, y, G_WHITE, time_limit));
+    assert(timer.elapsed() < time_limit + 500);
+    assert(isValidNextMove(x, y));
+    assert(!m_deadline);
+    assert(getAiLevel() == 4);
+    assert(cells().size() == move_count);
+  }
+}
+
+void TestGomoku::testSearchContext()
+{
+  setAiLevel(2);
+  int x, y;
+  //Контекст строится в куче при первой подсказке, поле без подсказок его не строит
+  assert(!m_search_context);
+  doMove(7, 7);
+  assert(hint(x, y));
+  Gomoku* context = m_search_context.get();
+  assert(context);
+  auto contextMoveCount = [context]()
+  {
+    return context->getMoveCount(G_BLACK) + context->getMoveCount(G_WHITE);
+  };
+  assert(contextMoveCount() == 1);
+
+  //Контекст сохраняется между подсказками и догоняет партию
+  assert(doMove(x, y));
+  assert(doMove(6, 6) || doMove(9, 9));
+  assert(hint(x, y));
+  assert(m_search_context.get() == context);
+  assert(contextMoveCount() == cells().size());
+  for (const GCell& move: cells())
+    assert(!context->isValidNextMove(move.x(), move.y()));
+
+  //После отката контекст возвращается к общему началу партии
+  undo();
+  undo();
+  assert(hint(x, y));
+  assert(contextMoveCount() == cells().size());
+
+  //Новая партия на том же поле использует тот же контекст
+  start();
+  assert(hint(x, y) && x == 7 && y == 7);
+  assert(m_search_context.get() == context && contextMoveCount() == 0);
+
+  //Поиск идет в контексте, поэтому поле партии не выделяет таблицу результатов и арену
+  assert(!m_memo.isAllocated() && !m_arena.isAllocated());
+
+  //Контекст удаленного поля возвращается в пул потока и достается следующей партии
+  Gomoku* released;
+  {
+    TestGomoku first;
+    assert(first.doMove(7, 7) && first.doMove(8, 8) && first.hint(x, y));
+    released = first.m_search_context.get();
+    assert(released);
+  }
+  TestGomoku second;
+  assert(second.doMove(6, 6) && second.hint(x, y));
+  assert(second.m_search_context.get() == released);
+  assert(released->getMoveCount(G_BLACK) == 1 && released->getMoveCount(G_WHITE) == 0);
+}
+
+void TestGomoku::testWeights()
+{
+  GWeights weights;
+  const int line[] = {0, 1, 3, 5, 6, 6};
+  assert(std::equal(line, line + 6, weights.line) && weights.variants == 60);
+  assert(getWeights() == weights);
+
+  std::stringstream file;
+  weights.line[2] = 4;
+  weights.variants = 30;
+  weights.save(file);
+  GWeights loaded;
+  assert(loaded.load(file) && loaded == weights);
+
+  //Убывающие веса линий и неизвестные параметры отвергаются
+  std::istringstream bad_line("line 1 3 2 6 6\n"), bad_key("depth 3\n");
+  assert(!loaded.load(bad_line) && !loaded.load(bad_key) && loaded == weights);
+
+  //Умножение весов линий на общий множитель умножает веса ходов и не меняет их порядок
+  assert(doMove(7, 7) && doMove(8, 8) && doMove(8, 7));
+  TestGomoku scaled;
+  scaled.doMove(7, 7);
+  scaled.doMove(8, 8);
+  GWeights scaled_weights;
+  for (int& wgt: scaled_weights.line)
+    wgt *= 10;
+  scaled.setWeights(scaled_weights);
+  scaled.doMove(8, 7);
+  for (int i = 0; i < GCell::INDEX_COUNT; ++i)
+  {
+    GCell cell = GCell::fromIndex(i);
+    assert(scaled.m_wgt[G_BLACK][cell] == m_wgt[G_BLACK][cell] * 10);
+    assert(scaled.m_wgt[G_WHITE][cell] == m_wgt[G_WHITE][cell] * 10);
+  }
+
+  //Контекст поиска получает веса поля
+  int x, y;
+  assert(scaled.hint(x, y));
+  assert(scaled.m_search_context->getWeights() == scaled_weights);
+}
+
+void TestGomoku::testParallelSearch()
+{
+  //Параллельный поиск дает те же результаты, ходы и признак длинной атаки, что и последовательный
+  TestGomoku parallel;
+  parallel.setSearchThreads(3);
+  setAiLevel(2);
+  parallel.setAiLevel(2);
+  random_engine.seed(1);
+  uint victory_count = 0, long_count = 0;
+  int x = 7, y = 7;
+  do
+  {
+    doMove(x, y);
+    parallel.doMove(x, y);
+    //Поиск атак выполняется, только если ни у одного из игроков нет хода 5 (см. hintImpl)
+    if (isGameOver() || isShah(G_BLACK) || isShah(G_WHITE))
+      continue;
+    for (GPlayer player: {G_BLACK, G_WHITE})
+    {
+      for (uint depth = 0; depth <= maxAttackDepth(); ++depth)
+      {
+        GCell move{-1, -1}, parallel_move{-1, -1};
+        bool victory = findVictoryAttack(player, depth, &move);
+        assert(parallel.findVictoryAttack(player, depth, &parallel_move) == victory);
+        assert(parallel.m_long_attack_possible == m_long_attack_possible);
+        assert(!victory || parallel_move == move);
+        victory_count += victory;
+      }
+      GCell move{-1, -1}, parallel_move{-1, -1};
+      bool long_attack = findLongAttack(player, maxAttackDepth(), &move);
+      assert(parallel.findLongAttack(player, maxAttackDepth(), &parallel_move) == long_attack);
+      assert(!long_attack || parallel_move == move);
+      long_count += long_attack;
+    }
+  }
+  while (!isGameOver() && hint(x, y));
+  assert(victory_count > 0 && long_count > 0);
+}
+
+void testHintRace()
+{
+  //Одновременные этапы подбора хода дают тот же ход и тот же этап, что и последовательный подбор
+  Gomoku sequential, race;
+  race.setHintRace(true);
+  sequential.setAiLevel(2);
+  race.setAiLevel(2);
+  bool kinds[G_HINT_KIND_COUNT] = {};
+  int x = 7, y = 7;
+  for (uint i = 0; !sequential.isGameOver(); ++i)
+  {
+    assert(sequential.doMove(x, y) && race.doMove(x, y));
+    if (sequential.isGameOver())
+      break;
+    int race_x, race_y;
+    //случайный выбор между соседними вариантами одинаков при одинаковом состоянии генератора
+    random_engine.seed(i);
+    assert(race.hint(race_x, race_y));
+    random_engine.seed(i);
+    assert(sequential.hint(x, y));
+    assert(race_x == x && race_y == y);
+    assert(race.getLastHintKind() == sequential.getLastHintKind());
+    kinds[sequential.getLastHintKind()] = true;
+  }
+  assert(kinds[G_HINT_POSITIONAL] && kinds[G_HINT_VICTORY_ATTACK]);
+}
+
+void TestGomoku::testHintMemo()
+{
+  //Запомненные результаты проверок совпадают с вычисленными заново
+  setAiLevel(2);
+  random_engine.seed(3);
+  uint danger_count = 0;
+  int x = 7, y = 7;
+  do
+  {
+    doMove(x, y);
+    if (isGameOver() || isShah(G_BLACK) || isShah(G_WHITE))
+      continue;
+    for (GPlayer player: {G_BLACK, G_WHITE})
+    {
+      m_memo.clear();
+      bool long_chain = findLongOrVictoryMove4Chain(player, maxAttackDepth());
+      assert(findLongOrVictoryMove4Chain(player, maxAttackDepth()) == long_chain);
+      for (const GCell& move: dangerMoves(player).cells())
+      {
+        if (!isEmptyCell(move) || !dangerMoves(player).get(move).m_open3 || isDangerMove4(player, move))
+          continue;
+        GMoveMaker gmm(this, player, move);
+        GStack<4> variants, memo_variants;
+        m_memo.clear();
+        m_long_attack_possible = false;
+        bool danger = isDangerOpen3(&variants);
+        bool long_attack_possible = m_long_attack_possible;
+        m_long_attack_possible = false;
+        assert(isDangerOpen3(&memo_variants) == danger);
+        assert(m_long_attack_possible == long_attack_possible);
+        assert(memo_variants.size() == variants.size() &&
+               std::equal(variants.begin(), variants.end(), memo_variants.begin()));
+        danger_count += danger;
+      }
+    }
+  }
+  while (!isGameOver() && hint(x, y));
+  assert(danger_count > 0);
+
+  //Контекст поиска сохраняет результаты между подсказками и очищает их при смене уровня ии
+  assert(setMoves({{7, 7}, {6, 8}, {7, 6}, {7, 8}, {8, 8}, {8, 7}, {9, 6}, {6, 6}, {6, 7}, {5, 8}, {9, 4}, {4, 8}, {3, 8},
+                   {7, 5}, {5, 7}, {8, 5}, {10, 5}, {9, 7}, {10, 4}, {8, 6}, {10, 8}, {5, 5}, {4, 5}, {6, 4}, {5, 3}}));
+  GSearchLog log;
+  setSearchLog(&log);
+  auto hintNodes = [this, &log](GPoint& move)
+  {
+    log.clear();
+    random_engine.seed(5);
+    assert(hint(move.x, move.y));
+    return log.records().size();
+  };
+  GPoint move1, move2, move3;
+  std::size_t nodes1 = hintNodes(move1);
+  std::size_t nodes2 = hintNodes(move2);
+  assert(move2 == move1 && nodes2 < nodes1);
+  setAiLevel(3);
+  hintNodes(move3);
+  setAiLevel(2);
+  assert(hintNodes(move3) == nodes1 && move3 == move1);
+  setSearchLog(nullptr);
+}
+
+void TestGomoku::testOpenMoves5()
+{
+  //Счетчики незанятых завершений линий 5 совпадают с перебором при ходах и откатах
+  auto check = [this]()
+  {
+    for (GPlayer player: {G_BLACK, G_WHITE})
+    {
+      uint open_moves5 = 0;
+      for (const GCell& move5: m_moves5[player].cells())
+        open_moves5 += isEmptyCell(move5);
+      assert(m_open_moves5[player] == open_moves5);
+      for (const GCell& move4: dangerMoves(player).cells())
+      {
+        const auto& data = dangerMoves(player).get(move4);
+        uint count = 0;
+        for (const GCell& move5: data.m_moves5)
+          count += isEmptyCell(move5);
+        assert(data.m_open_moves5 == count);
+      }
+    }
+  };
+  random_engine.seed(4);
+  for (uint game = 0; game < 5; ++game)
+  {
+    while (!isGameOver())
+    {
+      GVariantsIndex variants;
+      assignVariants(variants);
+      GCell move = cells().empty() ? GCell(7, 7) : randomMove(variants);
+      assert(doMove(move.x(), move.y()));
+      check();
+    }
+    while (undo())
+      check();
+  }
+}
+
+void TestGomoku::testWindowStones()
+{
+  //Снимки кандидатов после каждого хода: откат возвращает и порядок списка
+  std::vector<std::vector<GCell>> history;
+  auto check = [this, &history]()
+  {
+    TGrid<std::uint8_t> live_windows[2];
+    uint dead_windows = 0;
+    for (uint window = 0; window < geometry.windowCount(); ++window)
+    {
+      uint counts[2] = {};
+      GCell cell = geometry.window(window).start;
+      for (uint i = 0; i < 5; ++i, cell += dirs1[geometry.window(window).dir])
+      {
+        if (!isEmptyCell(cell))
+          ++counts[get(cell)];
+      }
+      assert(m_window_stones[window][G_BLACK] == counts[G_BLACK] &&
+             m_window_stones[window][G_WHITE] == counts[G_WHITE]);
+      dead_windows += counts[G_BLACK] > 0 && counts[G_WHITE] > 0;
+      for (GPlayer player: {G_BLACK, G_WHITE})
+      {
+        cell = geometry.window(window).start;
+        for (uint i = 0; i < 5 && counts[!player] == 0; ++i, cell += dirs1[geometry.window(window).dir])
+          ++live_windows[player][cell];
+      }
+    }
+    assert(m_dead_windows == dead_windows);
+    uint candidate_count = 0;
+    GCell cell{0, 0};
+    do
+    {
+      assert(m_live_windows[G_BLACK][cell] == live_windows[G_BLACK][cell]);
+      assert(m_live_windows[G_WHITE][cell] == live_windows[G_WHITE][cell]);
+      //Кандидаты - живые пустые ячейки рядом с камнями
+      bool candidate = isEmptyCell(cell) && m_neighbours[cell] > 0 && !isDeadCell(cell);
+      assert(m_candidates.contains(cell) == candidate);
+      candidate_count += candidate;
+    }
+    while (next(cell));
+    assert(m_candidates.cells().size() == candidate_count);
+
+    //Варианты пусты только после ничьей
+    GVariantsIndex variants;
+    assignVariants(variants);
+    assert(!variants.empty() || cells().empty() || isGameOver());
+    for (const GCell& variant: variants)
+      assert(!isDeadCell(variant));
+
+    if (history.size() > cells().size())
+    {
+      history.resize(cells().size() + 1);
+      assert(std::equal(history.back().begin(), history.back().end(),
+                        m_candidates.cells().begin(), m_candidates.cells().end()));
+    }
+    else
+      history.emplace_back(m_candidates.cells().begin(), m_candidates.cells().end());
+  };
+  random_engine.seed(5);
+  for (uint game = 0; game < 3; ++game)
+  {
+    history.clear();
+    check();
+    while (!isGameOver())
+    {
+      GVariantsIndex variants;
+      assignVariants(variants);
+      GCell move = cells().empty() ? GCell(7, 7) : randomMove(variants);
+      assert(doMove(move.x(), move.y()));
+      check();
+    }
+    while (undo())
+      check();
+  }
+  //Камни обоих игроков на каждой линии по обе стороны от ячейки убивают все ее окна:
+  //ячейка перестает быть кандидатом, а откат возвращает ее на прежнее место
+  for (int dx = -1; dx <= 1; ++dx)
+  {
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+      if (dx == 0 && dy == 0)
+        continue;
+      doMove(7 + dx, 7 + dy, G_BLACK);
+      if (dx != 1 || dy != 1)
+        doMove(7 + 2 * dx, 7 + 2 * dy, G_WHITE);
+    }
+  }
+  history.clear();
+  assert(!isDeadCell({7, 7}) && m_candidates.contains({7, 7}));
+  std::vector<GCell> candidates(m_candidates.cells().begin(), m_candidates.cells().end());
+  doMove(9, 9, G_WHITE);
+  assert(isDeadCell({7, 7}) && m_neighbours[GCell(7, 7)] > 0 && !m_candidates.contains({7, 7}));
+  //Окна, содержащие камень черных, живые только для черных
+  assert(m_live_windows[G_BLACK][GCell(7, 6)] > 0 && m_live_windows[G_WHITE][GCell(7, 6)] == 0);
+  undo();
+  assert(std::equal(candidates.begin(), candidates.end(), m_candidates.cells().begin(), m_candidates.cells().end()));
+  start();
+
+  //Линия из шести камней: выбирается окно с наибольшим началом
+  for (int x: {2, 3, 4, 5, 7})
+  {
+    doMove(x, 3, G_BLACK);
+    doMove(x * 2 % 15, 14, G_WHITE);
+  }
+  assert(!getLine5());
+  doMove(6, 3, G_BLACK);
+  const GLine* line5 = getLine5();
+  assert(line5 && (line5->start == GPoint{3, 3}) && line5->v1 == vecs1[0]);
+  start();
+}
+
+void testThreatTable()
+{
+  GThreatTable table(4);
+  bool result, long_attack_possible;
+  assert(!table.find(0x1234, result, long_attack_possible));
+  table.store(0x1234, true, false);
+  assert(table.find(0x1234, result, long_attack_possible) && result && !long_attack_possible);
+  //ключ с тем же номером записи вытесняет прежний
+  table.store(0x5674, false, true);
+  assert(!table.find(0x1234, result, long_attack_possible));
+  assert(table.find(0x5674, result, long_attack_possible) && !result && long_attack_possible);
+  //ключ, отличающийся только битами значения, считается тем же ключом
+  assert(table.find(0x5677, result, long_attack_possible));
+  table.clear();
+  assert(!table.find(0x5674, result, long_attack_possible));
+}
+
+void TestGomoku::testLazySmp()
+{
+  //Хэш позиции не зависит от порядка ходов
+  doMove(7, 7, G_BLACK);
+  doMove(8, 8, G_WHITE);
+  doMove(9, 7, G_BLACK);
+  std::uint64_t hash = m_hash;
+  while (undo());
+  assert(m_hash == 0);
+  doMove(9, 7, G_BLACK);
+  doMove(8, 8, G_WHITE);
+  doMove(7, 7, G_BLACK);
+  assert(m_hash == hash);
+  while (undo());
+
+  //Результаты поиска с таблицей совпадают с результатами без таблицы
+  GThreatTable table;
+  TestGomoku cached;
+  cached.m_threat_table = &table;
+  setAiLevel(2);
+  cached.setAiLevel(2);
+  random_engine.seed(2);
+  uint victory_count = 0;
+  int x = 7, y = 7;
+  do
+  {
+    doMove(x, y);
+    cached.doMove(x, y);
+    if (isGameOver() || isShah(G_BLACK) || isShah(G_WHITE))
+      continue;
+    for (GPlayer player: {G_BLACK, G_WHITE})
+    {
+      for (uint depth = 0; depth <= maxAttackDepth(); ++depth)
+      {
+        bool victory = findVictoryAttack(player, depth);
+        assert(cached.findVictoryAttack(player, depth) == victory);
+        victory_count += victory;
+      }
+    }
+  }
+  while (!isGameOver() && hint(x, y));
+  assert(victory_count > 0);
+
+  //Ленивый параллельный поиск доигрывает партию допустимыми ходами
+  Gomoku lazy;
+  lazy.setSearchThreads(3);
+  lazy.setLazySmp(true);
+  lazy.setAiLevel(2);
+  x = 7, y = 7;
+  for (uint i = 0; i < 30 && lazy.doMove(x, y) && !lazy.isGameOver(); ++i)
+  {
+    assert(lazy.hint(x, y));
+    assert(lazy.isValidNextMove(x, y));
+  }
+}
+
+void testGeometry()
+{
+  static_assert(GGeometry::WINDOW_COUNT == 572);
+
+  //Вес ячейки на пустом поле равен числу содержащих ее линий 5
+  assert(geometry.initWgt({0, 0}) == 3);
+  assert(geometry.initWgt({7, 7}) == 20);
+  assert(geometry.initWgt({1, 0}) == 4);
+
+  assert(geometry.ray({0, 0}, 0, false) == 4 && geometry.ray({0, 0}, 0, true) == 0);
+  assert(geometry.ray({2, 7}, 1, true) == 2);
+
+  uint count;
+  const auto* windows = geometry.cellWindows({7, 7}, 1, count);
+  assert(count == 5);
+  assert(geometry.window(windows[0]).start == GCell(3, 3));
+  assert(geometry.window(windows[4]).start == GCell(7, 7));
+  for (uint i = 0; i < count; ++i)
+    assert(geometry.window(windows[i]).dir == 1);
+}
+
+void testCellStack()
+{
+  for (int y = 0; y < GRID_HEIGHT; ++y)
+  {
+    for (int x = 0; x < GRID_WIDTH; ++x)
+      assert(fromCellId(toCellId({x, y})) == GCell(x, y));
+  }
+  assert(toCellId({GRID_WIDTH - 1, GRID_HEIGHT - 1}) == GRID_CELL_COUNT - 1);
+
+  GCellStack<4> stack;
+  static_assert(sizeof(stack) == 5);
+  stack.push({0, 0});
+  stack.push({14, 14});
+  stack.push({7, 3});
+  assert(stack.size() == 3 && stack[1] == GCell(14, 14) && stack.back() == GCell(7, 3));
+  assert(stack.contains({14, 14}) && !stack.contains({3, 7}));
+  GTestGrid grid(stack);
+  assert(grid.cells().size() == 3 && !grid.isEmptyCell({0, 0}));
+  stack.pop();
+  assert(stack.size() == 2 && !stack.contains({7, 3}));
+  stack.clear();
+  assert(stack.empty());
+}
+
+void testStackArena()
+{
+  GStackArena arena(1024);
+  assert(!arena.isAllocated());
+  {
+    GStackArenaScope scope(arena);
+    assert(arena.isAllocated());
+    uint used = arena.used();
+    GArenaStack stack(arena, 32);
+    assert(arena.used() == used + 32 * sizeof(GCell) && stack.capacity() == 32);
+    stack.push() = GCell(1, 1);
+    stack.push() = GCell(2, 2);
+    stack.fit();
+    assert(arena.used() == used + 2 * sizeof(GCell) && stack.size() == 2 && stack[1] == GCell(2, 2));
+    //После fit резерв равен размеру, и push проверяет переполнение по нему
+    assert(stack.capacity() == 2);
+
+    //Вложенный уровень возвращает всю свою память
+    {
+      GStackArenaScope nested(arena);
+      std::vector<int, TStackAllocator<int>> numbers(10, 1, TStackAllocator<int>(arena));
+      assert(numbers.back() == 1);
+      assert(arena.used() > used + 2 * sizeof(GCell) + 10 * sizeof(int));
+      //Контейнеры уничтожаются до выхода из уровня
+    }
+    assert(arena.used() == used + 2 * sizeof(GCell));
+
+    //Заполненный блок продолжается следующим, в том числе блоком больше обычного размера
+    {
+      GStackArenaScope nested(arena);
+      GArenaStack big(arena, 1000);
+      GArenaStack huge(arena, 4000);
+      assert(arena.blockCount() == 3 && big.capacity() == 1000 && huge.capacity() == 4000);
+      huge.push() = GCell(3, 3);
+      assert(stack[1] == GCell(2, 2));
+    }
+    assert(arena.used() == used + 2 * sizeof(GCell));
+    {
+      //После выхода из уровня блоки используются повторно
+      GStackArenaScope nested(arena);
+      GArenaStack big(arena, 1000);
+      assert(arena.blockCount() == 3);
+    }
+
+    //Резерв, за которым выделена другая память, не возвращается
+    GArenaStack first(arena, 8);
+    GArenaStack second(arena, 8);
+    uint before_fit = arena.used();
+    first.fit();
+    assert(arena.used() == before_fit);
+  }
+  assert(arena.empty());
+}
+
+void testBook()
+{
+  //Преобразования симметрии обратимы
+  for (uint symmetry = 0; symmetry < GSymmetry::COUNT; ++symmetry)
+  {
+    for (int i = 0; i < GRID_CELL_COUNT; ++i)
+    {
+      GCell cell = fromCellId(GCellId(i));
+      GCell image = GSymmetry::apply(cell, symmetry);
+      assert(image.isValid() && GSymmetry::apply(image, GSymmetry::inverse(symmetry)) == cell);
+    }
+  }
+
+  //Ключ одинаков для симметричных позиций и перестановок ходов и зависит от очереди хода
+  const GPoint moves[] = {{7, 7}, {8, 6}, {9, 9}, {3, 4}, {10, 7}};
+  GBookPosition position;
+  for (uint i = 0; i < 5; ++i)
+    position.add(moves[i], GPlayer(i % 2));
+  std::uint64_t key = position.key(G_WHITE);
+  assert(key != position.key(G_BLACK));
+  for (uint symmetry = 0; symmetry < GSymmetry::COUNT; ++symmetry)
+  {
+    GBookPosition image;
+    for (int i = 4; i >= 0; --i)
+      image.add(GSymmetry::apply(moves[i], symmetry), GPlayer(i % 2));
+    assert(image.key(G_WHITE) == key);
+  }
+  GBookPosition swapped;
+  for (uint i = 0; i < 5; ++i)
+    swapped.add(moves[i], GPlayer((i + 1) % 2));
+  assert(swapped.key(G_WHITE) != key);
+  position.add(moves[4], G_BLACK);
+  position.add(moves[4], G_BLACK);
+  assert(position.key(G_WHITE) == key);
+
+  //Записи с одной позицией и ходом объединяются
+  uint symmetry;
+  key = position.key(G_WHITE, &symmetry);
+  const GCell search_move(8, 8), played_move(6, 6);
+  GBook book;
+  book.merge({{key, 0, 0, toCellId(GSymmetry::apply(search_move, symmetry)), 2, G_HINT_POSITIONAL, 5},
+              {key, 40000, 60000, toCellId(GSymmetry::apply(played_move, symmetry)), 0, G_HINT_NONE, 5}});
+  book.merge({{key, 40000, 40000, toCellId(GSymmetry::apply(played_move, symmetry)), 0, G_HINT_NONE, 5},
+              {key, 0, 0, toCellId(GSymmetry::apply(search_move, symmetry)), 3, G_HINT_LONG_ATTACK, 5}});
+  assert(book.size() == 2 && book.maxPly() == 5 && book.searchLevel(key) == 3 && book.searchLevel(key + 1) == 0);
+  auto [first, last] = book.find(key);
+  assert(last - first == 2);
+  for (const GBookEntry* entry = first; entry != last; ++entry)
+  {
+    if (entry->level > 0)
+      assert(entry->level == 3 && entry->hint_kind == G_HINT_LONG_ATTACK);
+    else
+      assert(entry->games == 40000 && entry->points == 50000);
+  }
+
+  std::stringstream stream;
+  book.save(stream);
+  GBook loaded;
+  assert(loaded.load(stream) && loaded.entries().size() == 2 && loaded.maxPly() == 5);
+  std::istringstream bad("GBK2");
+  assert(!loaded.load(bad) && loaded.size() == 2);
+
+  //Подсказка берет ход поиска, ход возвращается в симметричную позицию
+  for (uint symmetry = 0; symmetry < GSymmetry::COUNT; ++symmetry)
+  {
+    Gomoku g;
+    g.setAiLevel(3);
+    g.setBook(&book);
+    for (uint i = 0; i < 5; ++i)
+      assert(g.doMove(GSymmetry::apply(moves[i], symmetry).point()));
+    int x, y;
+    assert(g.hint(x, y) && g.getLastHintKind() == G_HINT_BOOK);
+    assert((GCell(x, y) == GSymmetry::apply(search_move, symmetry)));
+  }
+  GBook played;
+  played.merge({{key, GBook::MIN_GAMES, 0, toCellId(GSymmetry::apply(search_move, symmetry)), 0, G_HINT_NONE, 5},
+                {key, GBook::MIN_GAMES, 1, toCellId(GSymmetry::apply(played_move, symmetry)), 0, G_HINT_NONE, 5}});
+  Gomoku g;
+  g.setAiLevel(3);
+  g.setBook(&played);
+  for (uint i = 0; i < 5; ++i)
+    assert(g.doMove(moves[i]));
+  //Статистика партий и поиск уровня выше уровня ии в подсказке не участвуют
+  int x, y;
+  assert(g.hint(x, y) && g.getLastHintKind() != G_HINT_BOOK);
+  g.setBook(&book);
+  g.setAiLevel(2);
+  assert(g.hint(x, y) && g.getLastHintKind() != G_HINT_BOOK);
+  //Позиции нет в книге
+  g.setAiLevel(3);
+  g.undo();
+  assert(g.hint(x, y) && g.getLastHintKind() != G_HINT_BOOK);
+
+  //Ход книги не заменяет финальный ход
+  Gomoku g5;
+  g5.setAiLevel(3);
+  GBookPosition position5;
+  GPlayer player = G_BLACK;
+  for (const GPoint& move: {GPoint{7, 7}, GPoint{0, 0}, GPoint{8, 7}, GPoint{0, 2}, GPoint{9, 7}, GPoint{0, 4},
+                            GPoint{10, 7}, GPoint{0, 6}})
+  {
+    assert(g5.doMove(move));
+    position5.add(move, player);
+    player = !player;
+  }
+  key = position5.key(G_BLACK, &symmetry);
+  GBook book5;
+  book5.merge({{key, 0, 0, toCellId(GSymmetry::apply(GCell(1, 1), symmetry)), 3, G_HINT_POSITIONAL, 8}});
+  g5.setBook(&book5);
+  assert(g5.hint(x, y) && g5.getLastHintKind() == G_HINT_MOVE5 && y == 7 && (x == 6 || x == 11));
+}
+
+void testEngine()
+{
+  std::ostringstream out;
+  auto engine = std::make_unique<GEngine>(out);
+  auto answer = [&](const std::string& line)
+  {
+    out.str("");
+    engine->command(line);
+    return out.str();
+  };
+
+  assert(answer("START 20").rfind("ERROR", 0) == 0);
+  assert(answer("START 15") == "OK\n");
+
+  //Ограничения времени на ход и на партию
+  answer("INFO timeout_turn 0");
+  assert(engine->turnTime() == 0);
+  answer("INFO timeout_turn 5000");
+  answer("INFO timeout_match 20000");
+  assert(engine->turnTime() < 1000);
+  answer("INFO timeout_match 0");
+  assert(engine->turnTime() > 4000);
+  answer("INFO timeout_turn 100");
+
+  assert(answer("BEGIN") == "7,7\n");
+  std::string move = answer("TURN 8,8");
+  assert(move != "ERROR invalid move\n" && move != "7,7\n" && move != "8,8\n");
+  assert(answer("TURN 8,8").rfind("ERROR", 0) == 0);
+
+  //Движок завершает свою линию 4
+  answer("BOARD");
+  for (const char* line: {"7,7,1", "0,0,2", "8,7,1", "0,1,2", "9,7,1", "0,2,2", "10,7,1", "0,3,2"})
+    assert(answer(line).empty());
+  move = answer("DONE");
+  assert(move == "6,7\n" || move == "11,7\n");
+
+  assert(answer("FOO").rfind("UNKNOWN", 0) == 0);
+  assert(!engine->command("END"));
+}
+
+void testServer()
+{
+  GSession session;
+  for (int i = 0; i < 4; ++i)
+  {
+    assert(session.doMove({i, 0}));
+    assert(session.doMove({i, 1}));
+  }
+  assert(!session.doMove({0, 0}));
+  assert(!session.isGameOver());
+  assert(session.doMove({4, 0}));
+  assert(session.isGameOver());
+  assert(!session.doMove({4, 1}));
+  assert(session.memory() < 1000);
+
+  //Ничья сессии совпадает с ничьей поля, ходы после нее принимаются до заполнения поля.
+  //Черные и белые чередуются полосами по две ячейки, поэтому линии 5 нет
+  std::vector<GPoint> stripes[2];
+  for (int y = 0; y < GRID_HEIGHT; ++y)
+  {
+    for (int x = 0; x < GRID_WIDTH; ++x)
+      stripes[(x / 2 + y) % 2].push_back({x, y});
+  }
+  assert(stripes[G_BLACK].size() == stripes[G_WHITE].size() + 1);
+  std::vector<GPoint> draw_moves;
+  for (uint i = 0; i < GRID_CELL_COUNT; ++i)
+    draw_moves.push_back(stripes[i % 2][i / 2]);
+  GSession draw_session;
+  Gomoku g;
+  uint draw_move_count = 0;
+  for (const GPoint& move: draw_moves)
+  {
+    assert(draw_session.doMove(move) && g.doMove(move));
+    assert(draw_session.isDraw() == g.isDraw() && draw_session.isGameOver() == g.isGameOver());
+    if (draw_move_count == 0 && g.isDraw())
+      draw_move_count = g.getMoveCount(G_BLACK) + g.getMoveCount(G_WHITE);
+  }
+  assert(draw_move_count > 0 && draw_move_count < GRID_CELL_COUNT);
+  assert(!draw_session.isMoveAllowed() && !g.getLine5());
+
+  std::ostringstream out;
+  {
+    GServer server(out, 2, 1);
+    server.request("{\"cmd\":\"new\",\"level\":1}");
+    server.request("{\"cmd\":\"move\",\"session\":1,\"x\":7,\"y\":7}");
+    server.request("{\"cmd\":\"move\",\"session\":1,\"x\":7,\"y\":7}");
+    server.request("{\"cmd\":\"hint\",\"session\":1,\"id\":\"h1\"}");
+    server.wait();
+    server.request("{\"cmd\":\"move\",\"session\":2,\"x\":7,\"y\":7}");
+    server.request("{\"cmd\":\"stats\"}");
+    server.request("{\"cmd\":\"close\",\"session\":1}");
+    server.request("not json");
+  }
+
+  std::istringstream in(out.str());
+  std::string line;
+  std::vector<GJsonObject> answers;
+  while (std::getline(in, line))
+  {
+    GJsonObject answer;
+    assert(parseJsonLine(line, answer));
+    answers.push_back(answer);
+  }
+  assert(answers.size() == 8);
+  assert(answers[0]["session"] == "1");
+  assert(answers[1]["ok"] == "true");
+  assert(answers[2]["error"] == "invalid move");
+  assert(answers[3]["id"] == "h1" && !answers[3]["x"].empty() && !answers[3]["queue_ms"].empty());
+  assert(answers[4]["error"] == "unknown session");
+  assert(answers[5]["sessions"] == "1" && answers[5]["hints"] == "1");
+  assert(answers[6]["ok"] == "true");
+  assert(answers[7]["error"] == "invalid request");
+
+  //Ответы сообщают о ничьей, подсказка после нее возвращает ход
+  std::ostringstream draw_out;
+  {
+    GServer server(draw_out, 1, 1);
+    server.request("{\"cmd\":\"new\",\"level\":1}");
+    auto move = [&server](const GPoint& p)
+    {
+      server.request("{\"cmd\":\"move\",\"session\":1,\"x\":" + std::to_string(p.x) +
+                     ",\"y\":" + std::to_string(p.y) + "}");
+    };
+    for (uint i = 0; i < draw_move_count; ++i)
+      move(draw_moves[i]);
+    server.request("{\"cmd\":\"hint\",\"session\":1,\"id\":\"draw\"}");
+    server.wait();
+    for (uint i = draw_move_count; i < GRID_CELL_COUNT; ++i)
+      move(draw_moves[i]);
+    server.request("{\"cmd\":\"hint\",\"session\":1,\"id\":\"full\"}");
+  }
+  std::vector<GJsonObject> draw_answers;
+  std::istringstream draw_in(draw_out.str());
+  while (std::getline(draw_in, line))
+  {
+    GJsonObject answer;
+    assert(parseJsonLine(line, answer));
+    draw_answers.push_back(answer);
+  }
+  assert(draw_answers.size() == GRID_CELL_COUNT + 3);
+  for (uint i = 1; i <= GRID_CELL_COUNT; ++i)
+  {
+    const GJsonObject& answer = draw_answers[i < draw_move_count + 1 ? i : i + 1];
+    assert(answer.at("ok") == "true");
+    assert(answer.count("game_over") == (i >= draw_move_count));
+  }
+  const GJsonObject& draw_hint = draw_answers[draw_move_count + 1];
+  assert(draw_hint.at("id") == "draw" && !draw_hint.at("x").empty() && draw_hint.at("game_over") == "true");
+  assert(draw_answers.back().at("id") == "full" && draw_answers.back().at("error") == "game over");
+}
+
+void testSelfPlay()
+{
+  GSelfPlay::GOptions options;
+  options.games = 2;
+  options.threads = 2;
+  options.ai_level = 1;
+
+  std::ostringstream out;
+  GSelfPlay selfplay(out, options);
+  selfplay.run();
+
+  std::string data = out.str();
+  assert(data.compare(0, 4, "GSP1") == 0);
+  std::uint32_t record_size;
+  memcpy(&record_size, data.data() + 4, sizeof(record_size));
+  assert(record_size == sizeof(GSampleRecord));
+  assert((data.size() - 8) % record_size == 0);
+
+  uint count = uint((data.size() - 8) / record_size);
+  //При полной выборке в нее попадают все позиции, кроме случайного первого хода
+  assert(count > 0 && count == selfplay.positionCount() && count == selfplay.sampleCount());
+  for (uint i = 0; i < count; ++i)
+  {
+    GSampleRecord record;
+    memcpy(&record, data.data() + 8 + i * record_size, sizeof(record));
+    assert(record.player == G_BLACK || record.player == G_WHITE);
+    assert(record.move < GRID_CELL_COUNT);
+    assert(record.hint_kind > G_HINT_NONE && record.hint_kind < G_HINT_KIND_COUNT);
+    assert(record.result >= -1 && record.result <= 1);
+    //Выбранный ход делается в пустую ячейку
+    assert(!(record.stones[G_BLACK][record.move / 8] & (1 << (record.move % 8))));
+    assert(!(record.stones[G_WHITE][record.move / 8] & (1 << (record.move % 8))));
+  }
+
+  //Партии выводятся в порядке номеров, поэтому выборка не зависит от числа потоков.
+  //Партий больше, чем может ожидать вывода (см. GSelfPlay::MAX_PENDING_GAMES), поэтому потоки ждут вывода
+  options.games = 6;
+  std::ostringstream out1, out2;
+  GSelfPlay selfplay1(out1, options);
+  selfplay1.run();
+  options.threads = 1;
+  GSelfPlay selfplay2(out2, options);
+  selfplay2.run();
+  assert(out1.str() == out2.str());
+}
+
+void testTrace()
+{
+  GTrace trace;
+  Gomoku g;
+  g.setTrace(&trace);
+  g.setAiLevel(2);
+  int x, y;
+  for (int i = 0; i < 6 && g.hint(x, y); ++i)
+    g.doMove(x, y);
+  assert(trace.size() > 0 && trace.dropped() == 0);
+
+  std::ostringstream out;
+  trace.save(out);
+  std::string json = out.str();
+  assert(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+  assert(json.find("\"name\":\"hint\"") != std::string::npos);
+  assert(json.find("\"name\":\"hintMove5\"") != std::string::npos);
+  assert(json.find("\"args\":{\"depth\":0}") != std::string::npos);
+  assert(std::count(json.begin(), json.end(), '{') == std::count(json.begin(), json.end(), '}'));
+
+  //Без журнала события не пишутся, сверх предела - отбрасываются
+  g.setTrace(nullptr);
+  uint size = trace.size();
+  assert(g.hint(x, y) && trace.size() == size);
+  GTrace small(1);
+  g.setTrace(&small);
+  assert(g.hint(x, y) && small.size() == 1 && small.dropped() > 0);
+}
+
+void testSearchLog()
+{
+  Gomoku g;
+  g.setAiLevel(2);
+  assert(g.setMoves({{7, 7}, {8, 8}, {8, 6}, {6, 8}, {9, 7}, {7, 9}, {10, 8}, {6, 6}}));
+  GSearchLog log;
+  g.setSearchLog(&log);
+  int x, y;
+  assert(g.hint(x, y));
+  assert(log.records().size() > 2 && log.dropped() == 0);
+
+  std::stringstream file;
+  log.save(file);
+  GSearchLog loaded;
+  assert(loaded.load(file) && loaded.records().size() == log.records().size());
+
+  GSearchDump dump;
+  assert(dump.build(loaded.records()));
+  const auto& nodes = dump.nodes();
+  assert(nodes.size() * 2 == log.records().size());
+  assert(nodes[0].kind == G_NODE_HINT && nodes[0].subtree == nodes.size());
+  for (uint i = 1; i < nodes.size(); ++i)
+  {
+    assert(nodes[i].level > 0 && nodes[i].kind != G_NODE_HINT);
+    assert(i + nodes[i].subtree <= nodes.size());
+  }
+  std::ostringstream out;
+  dump.printSummary(out);
+  dump.print(out, 1, 1);
+  assert(out.str().find("hint") != std::string::npos);
+
+  //При заполнении буфера узлы отбрасываются, а дерево остается согласованным
+  GSearchLog small(20);
+  g.setSearchLog(&small);
+  g.undo();
+  assert(g.hint(x, y));
+  assert(small.records().size() <= 20 && small.dropped() > 0);
+  assert(dump.build(small.records()));
+}
+
+void testTuner()
+{
+  GTuner::GOptions options;
+  options.iterations = 1;
+  options.games = 2;
+  options.time_limit = 1;
+
+  GTuner tuner(options, GWeights());
+  std::ostringstream log;
+  tuner.run(log);
+  assert(tuner.iteration() == 1);
+  assert(tuner.weights().isValid());
+  assert(log.str().find("line") != std::string::npos);
+
+  //Матч равных наборов с обменом цветами
+  double score = tuner.playMatch(GWeights(), GWeights());
+  assert(score >= 0 && score <= 1);
+}
+
+void testBookBuilder()
+{
+  GBookBuilder::GOptions options;
+  options.ply = 3;
+  options.width = 2;
+  options.threads = 2;
+  options.ai_level = 1;
+
+  GBook book;
+  std::ostringstream log;
+  uint checkpoints = 0;
+  {
+    GBookBuilder builder(book, options);
+    builder.run(log, [&checkpoints](){ ++checkpoints; return true; });
+    //На пустом поле нет кандидатов, поэтому первый уровень продолжается только ходом поиска
+    assert(checkpoints == 3 && builder.positionCount() >= 3 && builder.positionCount() <= 4);
+    assert(builder.searchCount() == builder.positionCount() && book.size() == builder.searchCount());
+  }
+  for (const GBookEntry& entry: book.entries())
+    assert(entry.level == 1 && entry.games == 0 && entry.ply < 3);
+
+  //Повторное построение продолжает книгу: просчитываются только позиции нового уровня
+  uint size = book.size();
+  {
+    GBookBuilder builder(book, options);
+    builder.run(log);
+    assert(builder.searchCount() == 0 && book.size() == size);
+  }
+  options.ply = 4;
+  {
+    GBookBuilder builder(book, options);
+    builder.run(log);
+    assert(builder.searchCount() > 0 && book.size() == size + builder.searchCount());
+    assert(book.maxPly() == 3);
+  }
+
+  //Статистика партий
+  GBook games;
+  GBookBuilder builder(games, options);
+  std::istringstream text("7,7 0,0 7,8 0,2 7,9 0,4 7,10 0,6 7,11\n"
+                          "7,7 0,0 7,8 0,2 7,9 0,4 7,10 0,6 7,11\r\n"
+                          "\n"
+                          "7,7 0,0\n");
+  assert(builder.importGames(text));
+  //Незавершенная партия пропускается, позиции после ply камней не записываются
+  assert(games.size() == 4 && games.maxPly() == 3);
+  GBookPosition position;
+  auto [first, last] = games.find(position.key(G_BLACK));
+  assert(last - first == 1 && first->games == 2 && first->points == 4 && first->level == 0);
+  position.add(GCell(7, 7), G_BLACK);
+  std::tie(first, last) = games.find(position.key(G_WHITE));
+  assert(last - first == 1 && first->games == 2 && first->points == 0);
+  std::istringstream bad("7,7 7,7\n");
+  assert(!builder.importGames(bad));
+
+  GSelfPlay::GOptions selfplay_options;
+  selfplay_options.games = 1;
+  std::stringstream samples;
+  GSelfPlay selfplay(samples, selfplay_options);
+  selfplay.run();
+  size = games.size();
+  assert(builder.importSamples(samples) && games.size() > size && games.maxPly() == 3);
+  std::istringstream not_samples("GSP2");
+  assert(!builder.importSamples(not_samples));
+}
+
 using TestFunc = void();
 void gtest(const char* name, TestFunc f, uint count = 1)
 {
@@ -668,13 +1883,36 @@ void gtest(const char* name, TestMember<T> f, uint count = 1)
 
 int main()
 {
+  gtest("testGeometry", testGeometry);
+  gtest("testCellStack", testCellStack);
+  gtest("testStackArena", testStackArena);
   gtest("testDoMove", &TestGomoku::testDoMove);
   gtest("testUndo", &TestGomoku::testUndo);
   gtest("testIsGameOver", &TestGomoku::testIsGameOver);
+  gtest("testFullBoardUndo", &TestGomoku::testFullBoardUndo);
   gtest("testMoves5", &TestGomoku::testMoves5);
   gtest("testMoves4", &TestGomoku::testMoves4);
   gtest("testOpen3", &TestGomoku::testOpen3);
+  gtest("testCandidates", &TestGomoku::testCandidates);
   gtest("testHintMove5", &TestGomoku::testHintMove5);
   gtest("testHintVictoryMove4Chain", &TestGomoku::testHintVictoryMove4Chain);
   gtest("testFindLongAttack", &TestGomoku::testFindLongAttack);
+  gtest("testLongAttackSearchStep", &TestGomoku::testLongAttackSearchStep);
+  gtest("testSearchContext", &TestGomoku::testSearchContext);
+  gtest("testWeights", &TestGomoku::testWeights);
+  gtest("testParallelSearch", &TestGomoku::testParallelSearch);
+  gtest("testHintRace", testHintRace);
+  gtest("testThreatTable", testThreatTable);
+  gtest("testLazySmp", &TestGomoku::testLazySmp);
+  gtest("testHintMemo", &TestGomoku::testHintMemo);
+  gtest("testOpenMoves5", &TestGomoku::testOpenMoves5);
+  gtest("testWindowStones", &TestGomoku::testWindowStones);
+  gtest("testBook", testBook);
+  gtest("testEngine", testEngine);
+  gtest("testServer", testServer);
+  gtest("testSelfPlay", testSelfPlay);
+  gtest("testTuner", testTuner);
+  gtest("testTrace", testTrace);
+  gtest("testSearchLog", testSearchLog);
+  gtest("testBookBuilder", testBookBuilder);
 }